@@ -0,0 +1,137 @@
+#include <cmath>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <string>
+#include <iostream>
+#include <iomanip>
+
+#include "../src/common/types.hpp"
+#include "../src/common/pcm_codec.hpp"
+
+namespace {
+    using bench_clock = std::chrono::steady_clock;
+    namespace kernels = sikradio::common::pcm_kernels;
+
+    const size_t psize = 512;
+    const size_t packets = 1 << 12;
+    const size_t rounds = 64;
+    // samples of one channel of a packet
+    const size_t kernel_len = psize / 4;
+    const size_t kernel_rounds = 1 << 21;
+
+    double ns_since(bench_clock::time_point start, size_t ops) {
+        auto elapsed = std::chrono::duration<double, std::nano>(bench_clock::now() - start);
+        return elapsed.count() / ops;
+    }
+
+    // baselines without vectorization
+    __attribute__((optimize("no-tree-vectorize")))
+    void scalar_difference(const int32_t *src, int32_t *dst, size_t n) {
+        dst[0] = src[0];
+        for (size_t i = 1; i < n; i++) dst[i] = src[i] - src[i - 1];
+    }
+
+    __attribute__((optimize("no-tree-vectorize")))
+    uint64_t scalar_zigzag_sum(const int32_t *src, size_t n) {
+        uint64_t ret = 0;
+        for (size_t i = 0; i < n; i++) ret += kernels::zigzag(src[i]);
+        return ret;
+    }
+
+    __attribute__((optimize("no-tree-vectorize")))
+    void scalar_prefix_sum(int32_t *data, size_t n) {
+        for (size_t i = 1; i < n; i++) data[i] += data[i - 1];
+    }
+
+    template<typename F>
+    double bench_kernel(F kernel) {
+        std::vector<int32_t> a(kernel_len), b(kernel_len);
+        for (size_t i = 0; i < kernel_len; i++) a[i] = static_cast<int32_t>(i % 7) - 3;
+        auto start = bench_clock::now();
+        for (size_t i = 0; i < kernel_rounds; i++) {
+            kernel(a.data(), b.data());
+            // prevent the compiler from merging iterations
+            asm volatile("" : : "r"(a.data()), "r"(b.data()) : "memory");
+        }
+        return ns_since(start, kernel_rounds);
+    }
+
+    // 16-bit stereo pcm, tones with some noise resemble music, white noise does not compress
+    std::vector<sikradio::common::msg_t> make_stream(double tone, double noise) {
+        std::mt19937 rng{2137};
+        std::normal_distribution<double> hiss{0, noise};
+        std::vector<sikradio::common::msg_t> ret(packets, sikradio::common::msg_t(psize));
+        size_t t = 0;
+        for (auto& packet : ret) {
+            for (size_t i = 0; i < psize; i += 2, t++) {
+                double value = tone*(sin(t*0.013) + 0.5*sin(t*0.071) + 0.25*sin(t*0.29)) + hiss(rng);
+                auto sample = static_cast<uint16_t>(static_cast<int16_t>(std::clamp(value, -32768.0, 32767.0)));
+                packet[i] = static_cast<sikradio::common::byte_t>(sample & 0xFF);
+                packet[i + 1] = static_cast<sikradio::common::byte_t>(sample >> 8);
+            }
+        }
+        return ret;
+    }
+
+    void bench_codec(const std::string& name, double tone, double noise) {
+        auto stream = make_stream(tone, noise);
+        sikradio::common::pcm_codec codec{2};
+        std::vector<std::optional<sikradio::common::msg_t>> encoded(packets);
+        size_t compressed_bytes = 0;
+
+        auto start = bench_clock::now();
+        for (size_t r = 0; r < rounds; r++)
+            for (size_t i = 0; i < packets; i++) encoded[i] = codec.encode(stream[i].data(), psize);
+        double encode_ns = ns_since(start, rounds*packets);
+
+        size_t compressed = 0;
+        for (const auto& e : encoded) {
+            compressed_bytes += e.has_value() ? e->size() : psize;
+            if (e.has_value()) compressed++;
+        }
+        start = bench_clock::now();
+        size_t mismatches = 0;
+        for (size_t r = 0; r < rounds; r++)
+            for (size_t i = 0; i < packets; i++)
+                if (encoded[i].has_value() && codec.decode(encoded[i]->data(), encoded[i]->size()) != stream[i])
+                    mismatches++;
+        double decode_ns = ns_since(start, rounds*std::max<size_t>(compressed, 1));
+
+        std::cout << "codec " << name
+                  << " ratio=" << std::fixed << std::setprecision(3)
+                  << static_cast<double>(compressed_bytes) / (packets*psize)
+                  << " compressed=" << compressed << "/" << packets
+                  << " encode ns/packet=" << std::setprecision(1) << encode_ns
+                  << " decode ns/packet=" << decode_ns
+                  << " mismatches=" << mismatches << std::endl;
+    }
+}
+
+int main() {
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "difference scalar ns/channel=" << bench_kernel([](int32_t *a, int32_t *b) {
+        scalar_difference(a, b, kernel_len);
+    }) << std::endl;
+    std::cout << "difference vector ns/channel=" << bench_kernel([](int32_t *a, int32_t *b) {
+        kernels::difference(a, b, kernel_len);
+    }) << std::endl;
+    std::cout << "zigzag sum scalar ns/channel=" << bench_kernel([](int32_t *a, int32_t *b) {
+        b[0] = static_cast<int32_t>(scalar_zigzag_sum(a, kernel_len));
+    }) << std::endl;
+    std::cout << "zigzag sum vector ns/channel=" << bench_kernel([](int32_t *a, int32_t *b) {
+        b[0] = static_cast<int32_t>(kernels::zigzag_sum(a, kernel_len));
+    }) << std::endl;
+    std::cout << "prefix sum scalar ns/channel=" << bench_kernel([](int32_t *a, int32_t *) {
+        scalar_prefix_sum(a, kernel_len);
+    }) << std::endl;
+    std::cout << "prefix sum vector ns/channel=" << bench_kernel([](int32_t *a, int32_t *) {
+        kernels::prefix_sum(a, kernel_len);
+    }) << std::endl;
+
+    bench_codec("tones", 6000, 0);
+    bench_codec("tones+noise", 6000, 30);
+    bench_codec("loud", 14000, 300);
+    bench_codec("noise", 0, 10000);
+    return 0;
+}
@@ -0,0 +1,106 @@
+#include <chrono>
+#include <random>
+#include <vector>
+#include <iostream>
+#include <iomanip>
+
+#include "../src/common/types.hpp"
+#include "../src/common/data_msg.hpp"
+#include "../src/common/fec_msg.hpp"
+#include "../src/sender/fec_encoder.hpp"
+#include "../src/receiver/buffer.hpp"
+
+namespace {
+    using bench_clock = std::chrono::steady_clock;
+
+    const size_t psize = 512;
+    const size_t packets = 1 << 18;
+    const size_t xor_rounds = 1 << 22;
+
+    double ns_since(bench_clock::time_point start, size_t ops) {
+        auto elapsed = std::chrono::duration<double, std::nano>(bench_clock::now() - start);
+        return elapsed.count() / ops;
+    }
+
+    // baseline without vectorization
+    __attribute__((optimize("no-tree-vectorize")))
+    void scalar_xor(sikradio::common::byte_t *dst, const sikradio::common::byte_t *src, size_t len) {
+        for (size_t i = 0; i < len; i++) dst[i] ^= src[i];
+    }
+
+    template<typename F>
+    double bench_xor(F kernel) {
+        sikradio::common::msg_t a(psize, 1), b(psize, 2);
+        auto start = bench_clock::now();
+        for (size_t i = 0; i < xor_rounds; i++) {
+            kernel(a.data(), b.data(), psize);
+            // prevent the compiler from merging iterations
+            asm volatile("" : : "r"(a.data()) : "memory");
+        }
+        return ns_since(start, xor_rounds);
+    }
+
+    // streams packets through encoder and receiver buffer, losing bursts of `burst` packets,
+    // lost packets that are not recovered would have to be retransmitted
+    void bench_decode(size_t group_size, size_t interleave, size_t burst, double burst_probability) {
+        sikradio::sender::fec_encoder encoder{group_size, interleave, psize};
+        sikradio::receiver::buffer buf{4096*psize};
+        std::mt19937_64 rng{2137};
+        std::bernoulli_distribution starts_burst{burst_probability};
+        sikradio::common::msg_t data(psize, 7);
+
+        std::vector<sikradio::common::data_msg> delivered;
+        std::vector<sikradio::common::fec_msg> parities;
+        delivered.reserve(packets);
+        size_t lost = 0;
+        size_t burst_left = 0;
+        for (size_t i = 0; i < packets; i++) {
+            data[i % psize] = static_cast<sikradio::common::byte_t>(i);
+            sikradio::common::data_msg msg{i*psize, 1, data};
+            auto parity = encoder.push(msg, 1);
+            if (parity.has_value()) parities.push_back(parity.value());
+            if (burst_left == 0 && starts_burst(rng)) burst_left = burst;
+            if (burst_left > 0) {
+                burst_left--;
+                lost++;
+                continue;
+            }
+            delivered.push_back(msg);
+        }
+
+        // deliver data and parity in the order they were sent, buffer drops oldest packets when full
+        size_t recovered = 0;
+        size_t gaps = 0;
+        size_t next_parity = 0;
+        auto start = bench_clock::now();
+        for (const auto& msg : delivered) {
+            gaps += buf.write_get_missed(msg).size();
+            while (next_parity < parities.size()
+                    && parities[next_parity].protected_id(group_size - 1) <= msg.get_id()) {
+                recovered += buf.write_parity_get_recovered(parities[next_parity]).size();
+                next_parity++;
+            }
+        }
+        double ns = ns_since(start, delivered.size() + parities.size());
+
+        std::cout << "decode k=" << group_size << " d=" << interleave
+                  << " burst=" << burst << " p=" << std::defaultfloat << burst_probability
+                  << " ns/packet=" << std::fixed << std::setprecision(1) << ns
+                  << " packets/s=" << std::setprecision(0) << (1e9 / ns)
+                  << " lost=" << lost << " recovered=" << recovered
+                  << " gaps=" << gaps << std::endl;
+    }
+}
+
+int main() {
+    std::cout << "xor scalar ns/packet=" << std::fixed << std::setprecision(1)
+              << bench_xor(scalar_xor) << std::endl;
+    std::cout << "xor vector ns/packet=" << std::fixed << std::setprecision(1)
+              << bench_xor(sikradio::common::xor_into) << std::endl;
+
+    bench_decode(8, 1, 1, 0.01);
+    bench_decode(8, 1, 4, 0.002);
+    bench_decode(8, 4, 4, 0.002);
+    bench_decode(4, 8, 8, 0.001);
+    return 0;
+}
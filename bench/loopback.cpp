@@ -0,0 +1,473 @@
+#include <boost/program_options.hpp>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <string>
+#include <vector>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <cstring>
+#include <csignal>
+#include <iostream>
+#include <sstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "../src/common/histogram.hpp"
+#include "../src/common/memory_transport.hpp"
+#include "../src/common/impaired_transport.hpp"
+#include "../src/sender/transmitter.hpp"
+#include "../src/receiver/receiver.hpp"
+
+// Streams synthetic PCM through sender and receiver binaries on loopback and prints results as JSON.
+// Every packet starts with the time it was written to sender's input and its sequence number,
+// so receivers' outputs can be used to measure end-to-end latency and losses.
+// With `memory` backend, transmitter and receiver run in one child process, connected by in-memory
+// transport, so the pipeline is measured without the kernel network stack.
+
+namespace po = boost::program_options;
+
+namespace {
+    using bench_clock = std::chrono::steady_clock;
+
+    const char *bench_mcast_addr = "239.10.11.12";
+    const char *bench_station_name = "bench";
+    const size_t packet_header_size = 2*sizeof(uint64_t);
+    const uint16_t receiver_ports_offset = 16;
+    const double sample_rate = 44100.0;
+    const double tone_frequency = 440.0;
+    const int output_pipe_size = 4096;
+    const char *memory_backend = "memory";
+
+    struct child {
+        pid_t pid{-1};
+        int fd{-1};  // sender's input or receiver's output
+        struct rusage usage{};
+    };
+
+    struct receiver_result {
+        sikradio::common::metrics::histogram latency_us{};
+        uint64_t packets{0};
+        uint64_t bytes{0};
+        uint64_t lost{0};  // sequence numbers skipped in the output
+        uint64_t out_of_order{0};
+    };
+
+    // starts program with fd `child_fd` (0 or 1) connected to a pipe, other end is returned in child
+    child spawn(const std::vector<std::string>& args, int child_fd) {
+        int fds[2];
+        if (pipe2(fds, O_CLOEXEC) < 0) throw std::runtime_error(strerror(errno));
+        int parent_end = (child_fd == STDIN_FILENO) ? fds[1] : fds[0];
+        int child_end = (child_fd == STDIN_FILENO) ? fds[0] : fds[1];
+
+        child ret;
+        ret.pid = fork();
+        if (ret.pid < 0) throw std::runtime_error(strerror(errno));
+        if (ret.pid == 0) {
+            dup2(child_end, child_fd);
+            std::vector<char *> argv;
+            for (const auto& arg : args) argv.push_back(const_cast<char *>(arg.c_str()));
+            argv.push_back(nullptr);
+            execv(argv[0], argv.data());
+            std::cerr << "exec " << args[0] << ": " << strerror(errno) << std::endl;
+            _exit(127);
+        }
+        close(child_end);
+        // small pipe, so that receiver's buffer is not moved into the pipe ahead of playback
+        (void)fcntl(parent_end, F_SETPIPE_SZ, output_pipe_size);
+        ret.fd = parent_end;
+        return ret;
+    }
+
+    // impairment given in spec of the transport, none if spec is empty
+    std::shared_ptr<sikradio::common::impaired_transport> impair(
+            std::shared_ptr<sikradio::common::transport> transport, const std::string& spec) {
+        if (spec.empty()) return nullptr;
+        return std::make_shared<sikradio::common::impaired_transport>(
+            std::move(transport), sikradio::common::parse_impairment(spec));
+    }
+
+    // runs transmitter and receiver connected by in-memory transport in a child process, with the
+    // same options as programs started by the benchmark, returns sender's input and receiver's output,
+    // both ends belong to the same process, which runs until it is killed
+    std::pair<child, child> spawn_in_process(const po::variables_map& vm, uint16_t base_port) {
+        int input_fds[2], output_fds[2];
+        if (pipe2(input_fds, O_CLOEXEC) < 0 || pipe2(output_fds, O_CLOEXEC) < 0)
+            throw std::runtime_error(strerror(errno));
+
+        pid_t pid = fork();
+        if (pid < 0) throw std::runtime_error(strerror(errno));
+        if (pid == 0) {
+            dup2(input_fds[0], STDIN_FILENO);
+            dup2(output_fds[1], STDOUT_FILENO);
+            try {
+                auto network = std::make_shared<sikradio::common::memory_transport>();
+                auto rtime = vm["-R"].as<size_t>();
+                auto ctrl_port = static_cast<uint16_t>(base_port + 1);
+                auto ui_port = static_cast<uint16_t>(base_port + receiver_ports_offset);
+                auto receiver_spec = vm["-x"].as<std::string>();
+                if (!receiver_spec.empty()) receiver_spec += ",seed=1";
+                auto sender_impaired = impair(network, vm["-X"].as<std::string>());
+                auto receiver_impaired = impair(network, receiver_spec);
+                std::shared_ptr<sikradio::common::transport> sender_transport = network;
+                if (sender_impaired) sender_transport = sender_impaired;
+                std::shared_ptr<sikradio::common::transport> receiver_transport = network;
+                if (receiver_impaired) receiver_transport = receiver_impaired;
+                // other options have defaults of the programs, transmitter listens for lookups
+                // from its construction, so receiver can be started right after it
+                sikradio::sender::transmitter transmitter(
+                    vm["-p"].as<size_t>(), 131072, rtime, bench_mcast_addr, base_port, ctrl_port,
+                    bench_station_name, 0, 8, 1, static_cast<uint16_t>(base_port + 2), "127.0.0.1",
+                    sender_transport, {},
+                    std::make_shared<sikradio::sender::fd_input>(), nullptr, 0, 4,
+                    static_cast<uint64_t>(vm["-r"].as<double>()), 20, 20, vm["-m"].as<bool>());
+                // receiver never returns, it is left running until the process is killed
+                auto rcvr = new sikradio::receiver::receiver(
+                    "127.0.0.1", ctrl_port, ui_port, vm["-b"].as<size_t>(), rtime,
+                    std::make_optional<std::string>(bench_station_name), std::nullopt, 0,
+                    static_cast<uint16_t>(ui_port + 1),
+                    receiver_transport,
+                    {}, nullptr, false, vm["-m"].as<bool>());
+                if (sender_impaired) sender_impaired->register_probes(transmitter.get_metrics());
+                if (receiver_impaired) receiver_impaired->register_probes(rcvr->get_metrics());
+                std::thread(&sikradio::receiver::receiver::run, rcvr).detach();
+                transmitter.transmit();
+            } catch (sikradio::common::exceptions::base_exception &e) {
+                std::cerr << "in-process pipeline: " << e.what() << std::endl;
+                _exit(1);
+            }
+            // receiver plays the rest of its buffer
+            while (true) pause();
+        }
+        close(input_fds[0]);
+        close(output_fds[1]);
+        (void)fcntl(output_fds[0], F_SETPIPE_SZ, output_pipe_size);
+        child sender, receiver;
+        sender.pid = receiver.pid = pid;
+        sender.fd = input_fds[1];
+        receiver.fd = output_fds[0];
+        return {sender, receiver};
+    }
+
+    void reap(child& c) {
+        int status;
+        while (wait4(c.pid, &status, 0, &c.usage) < 0 && errno == EINTR) {}
+    }
+
+    double cpu_seconds(const struct rusage& usage) {
+        auto seconds = [](const struct timeval& tv) { return tv.tv_sec + tv.tv_usec / 1e6; };
+        return seconds(usage.ru_utime) + seconds(usage.ru_stime);
+    }
+
+    bool write_all(int fd, const uint8_t *data, size_t len) {
+        while (len > 0) {
+            ssize_t written = write(fd, data, len);
+            if (written < 0 && errno == EINTR) continue;
+            if (written <= 0) return false;
+            data += written;
+            len -= written;
+        }
+        return true;
+    }
+
+    // writes `packets` packets at given bitrate, returns time when writing has finished
+    bench_clock::time_point stream_input(int fd, size_t psize, double bitrate, uint64_t packets) {
+        std::vector<uint8_t> packet(psize);
+        auto interval = std::chrono::duration_cast<bench_clock::duration>(
+            std::chrono::duration<double>(psize / bitrate));
+        auto start = bench_clock::now();
+        uint64_t sample = 0;
+        for (uint64_t seq = 0; seq < packets; seq++) {
+            std::this_thread::sleep_until(start + seq*interval);
+            // 16-bit stereo sine wave after the header
+            for (size_t i = packet_header_size; i + 4 <= psize; i += 4, sample++) {
+                auto value = static_cast<int16_t>(
+                    8192*std::sin(2*M_PI*tone_frequency*sample / sample_rate));
+                memcpy(packet.data() + i, &value, sizeof(value));
+                memcpy(packet.data() + i + 2, &value, sizeof(value));
+            }
+            uint64_t now_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                bench_clock::now().time_since_epoch()).count();
+            memcpy(packet.data(), &now_ns, sizeof(now_ns));
+            memcpy(packet.data() + sizeof(now_ns), &seq, sizeof(seq));
+            if (!write_all(fd, packet.data(), psize)) break;
+        }
+        return bench_clock::now();
+    }
+
+    // reads receiver's output until it exits, at given bitrate like an audio player would,
+    // reading faster would drain receiver's buffer and measure its rebuffering instead
+    void collect_output(int fd, size_t psize, double bitrate, receiver_result& result) {
+        std::vector<uint8_t> buf(4*psize);
+        size_t filled = 0;
+        std::optional<uint64_t> expected_seq;
+        std::optional<bench_clock::time_point> playback_start;
+        while (true) {
+            if (playback_start.has_value()) {
+                std::this_thread::sleep_until(playback_start.value()
+                    + std::chrono::duration_cast<bench_clock::duration>(
+                        std::chrono::duration<double>(result.bytes / bitrate)));
+            }
+            ssize_t len = read(fd, buf.data() + filled, buf.size() - filled);
+            if (len < 0 && errno == EINTR) continue;
+            if (len <= 0) break;
+            auto now_ns = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                bench_clock::now().time_since_epoch()).count());
+            if (!playback_start.has_value()) playback_start = bench_clock::now();
+            result.bytes += len;
+            filled += len;
+            size_t offset = 0;
+            for (; offset + psize <= filled; offset += psize) {
+                uint64_t sent_ns, seq;
+                memcpy(&sent_ns, buf.data() + offset, sizeof(sent_ns));
+                memcpy(&seq, buf.data() + offset + sizeof(sent_ns), sizeof(seq));
+                result.packets++;
+                result.latency_us.record(now_ns > sent_ns ? (now_ns - sent_ns) / 1000 : 0);
+                if (expected_seq.has_value() && seq > expected_seq.value())
+                    result.lost += seq - expected_seq.value();
+                if (expected_seq.has_value() && seq < expected_seq.value())
+                    result.out_of_order++;
+                else
+                    expected_seq = seq + 1;
+            }
+            memmove(buf.data(), buf.data() + offset, filled - offset);
+            filled -= offset;
+        }
+        close(fd);
+    }
+
+    // reads `name value` lines from stats endpoint of sender or receiver
+    std::vector<std::pair<std::string, std::string>> fetch_stats(uint16_t port) {
+        std::vector<std::pair<std::string, std::string>> ret;
+        int sock = socket(AF_INET, SOCK_STREAM, 0);
+        if (sock < 0) return ret;
+        struct sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        std::string text;
+        if (connect(sock, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) == 0) {
+            char buf[4096];
+            ssize_t len;
+            while ((len = read(sock, buf, sizeof(buf))) > 0) text.append(buf, len);
+        }
+        close(sock);
+        std::istringstream lines{text};
+        std::string name, value;
+        while (lines >> name >> value) ret.emplace_back(name, value);
+        return ret;
+    }
+
+    std::string json_stats(const std::vector<std::pair<std::string, std::string>>& stats) {
+        std::ostringstream ret;
+        ret << "{";
+        for (size_t i = 0; i < stats.size(); i++)
+            ret << (i ? ", " : "") << "\"" << stats[i].first << "\": " << stats[i].second;
+        ret << "}";
+        return ret.str();
+    }
+
+    double stat_value(const std::vector<std::pair<std::string, std::string>>& stats, const std::string& name) {
+        for (const auto& [stat_name, value] : stats)
+            if (stat_name == name) return std::stod(value);
+        return 0;
+    }
+
+    std::string json_string(const std::string& text) {
+        std::ostringstream ret;
+        ret << "\"";
+        for (auto c : text) {
+            if (c == '"' || c == '\\') ret << '\\';
+            ret << c;
+        }
+        ret << "\"";
+        return ret.str();
+    }
+
+    std::string json_latency(const sikradio::common::metrics::histogram& h) {
+        std::ostringstream ret;
+        ret << "{\"p50\": " << h.get_percentile(0.5)
+            << ", \"p90\": " << h.get_percentile(0.9)
+            << ", \"p99\": " << h.get_percentile(0.99)
+            << ", \"p999\": " << h.get_percentile(0.999)
+            << ", \"max\": " << h.get_max() << "}";
+        return ret.str();
+    }
+}
+
+int main(int argc, char *argv[]) {
+    po::options_description desc("Allowed options");
+    desc.add_options()
+            (",N", po::value<size_t>()->default_value(2), "RECEIVERS")
+            (",p", po::value<size_t>()->default_value(512), "PSIZE")
+            (",r", po::value<double>()->default_value(176400), "BITRATE in bytes per second")
+            (",t", po::value<double>()->default_value(10), "DURATION in seconds")
+            (",b", po::value<size_t>()->default_value(65536), "BSIZE")
+            (",R", po::value<size_t>()->default_value(250), "RTIME")
+            (",P", po::value<uint16_t>()->default_value(27830), "BASE_PORT")
+            (",w", po::value<size_t>()->default_value(1000), "WARMUP in milliseconds")
+            (",s", po::value<std::string>()->default_value("./sikradio-sender"), "SENDER")
+            (",c", po::value<std::string>()->default_value("./sikradio-receiver"), "RECEIVER")
+            (",x", po::value<std::string>()->default_value(""), "RECEIVER_IMPAIRMENT")
+            (",X", po::value<std::string>()->default_value(""), "SENDER_IMPAIRMENT")
+            (",B", po::value<std::string>()->default_value("udp"), "IO_BACKEND")
+            (",m", po::bool_switch(), "MULTICAST_NACKS");
+
+    po::variables_map vm;
+    try {
+        po::store(po::parse_command_line(argc, argv, desc), vm);
+        po::notify(vm);
+    } catch (po::error &e) {
+        std::cerr << e.what() << std::endl;
+        exit(1);
+    }
+    auto receivers = vm["-N"].as<size_t>();
+    auto psize = vm["-p"].as<size_t>();
+    auto bitrate = vm["-r"].as<double>();
+    auto duration = vm["-t"].as<double>();
+    auto bsize = vm["-b"].as<size_t>();
+    auto base_port = vm["-P"].as<uint16_t>();
+    bool in_process = (vm["-B"].as<std::string>() == memory_backend);
+    if (psize < packet_header_size || bitrate <= 0) {
+        std::cerr << "PSIZE has to hold " << packet_header_size << " bytes of header" << std::endl;
+        exit(1);
+    }
+    if (in_process && receivers != 1) {
+        // receiver plays to the standard output of the process
+        std::cerr << "Backend " << memory_backend << " runs a single receiver" << std::endl;
+        exit(1);
+    }
+    // data, control and stats ports of the sender, receivers use ports after them
+    auto data_port = std::to_string(base_port);
+    auto ctrl_port = std::to_string(base_port + 1);
+    uint16_t sender_stats_port = base_port + 2;
+    signal(SIGPIPE, SIG_IGN);
+
+    std::vector<std::string> sender_args{
+        vm["-s"].as<std::string>(),
+        "-a", bench_mcast_addr, "-P", data_port, "-C", ctrl_port,
+        "-S", std::to_string(sender_stats_port), "-I", "127.0.0.1",
+        "-p", std::to_string(psize), "-R", std::to_string(vm["-R"].as<size_t>()),
+        "-r", std::to_string(static_cast<uint64_t>(bitrate)),
+        "-n", bench_station_name, "-B", vm["-B"].as<std::string>()};
+    if (!vm["-X"].as<std::string>().empty()) {
+        sender_args.emplace_back("-X");
+        sender_args.push_back(vm["-X"].as<std::string>());
+    }
+    if (vm["-m"].as<bool>()) sender_args.emplace_back("-m");
+
+    child sender;
+    std::vector<child> receiver_processes;
+    std::vector<uint16_t> receiver_stats_ports;
+    std::vector<std::unique_ptr<receiver_result>> results;
+    std::vector<std::thread> collectors;
+    if (in_process) {
+        auto [pipeline_input, pipeline_output] = spawn_in_process(vm, base_port);
+        sender = pipeline_input;
+        receiver_processes.push_back(pipeline_output);
+        receiver_stats_ports.push_back(static_cast<uint16_t>(base_port + receiver_ports_offset + 1));
+        results.push_back(std::make_unique<receiver_result>());
+        collectors.emplace_back(
+            collect_output, pipeline_output.fd, psize, bitrate, std::ref(*results.back()));
+    } else {
+        sender = spawn(sender_args, STDIN_FILENO);
+        // sender has to listen for lookups before receivers send them
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    }
+    for (size_t i = 0; i < receivers && !in_process; i++) {
+        auto ui_port = static_cast<uint16_t>(base_port + receiver_ports_offset + 2*i);
+        auto stats_port = static_cast<uint16_t>(ui_port + 1);
+        std::vector<std::string> receiver_args{
+            vm["-c"].as<std::string>(),
+            "-d", "127.0.0.1", "-C", ctrl_port, "-U", std::to_string(ui_port),
+            "-S", std::to_string(stats_port), "-b", std::to_string(bsize),
+            "-R", std::to_string(vm["-R"].as<size_t>()), "-n", bench_station_name,
+            "-B", vm["-B"].as<std::string>()};
+        if (!vm["-x"].as<std::string>().empty()) {
+            // every receiver gets its own losses, like clients of one Wi-Fi network
+            receiver_args.emplace_back("-X");
+            receiver_args.push_back(vm["-x"].as<std::string>() + ",seed=" + std::to_string(i + 1));
+        }
+        if (vm["-m"].as<bool>()) receiver_args.emplace_back("-m");
+        receiver_processes.push_back(spawn(receiver_args, STDOUT_FILENO));
+        receiver_stats_ports.push_back(stats_port);
+        results.push_back(std::make_unique<receiver_result>());
+        collectors.emplace_back(
+            collect_output, receiver_processes.back().fd, psize, bitrate, std::ref(*results.back()));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(vm["-w"].as<size_t>()));
+
+    auto packets = static_cast<uint64_t>(duration*bitrate / psize);
+    auto start = bench_clock::now();
+    auto end = stream_input(sender.fd, psize, bitrate, packets);
+    double wall_s = std::chrono::duration<double>(end - start).count();
+    // let receivers play what they can, buffer is never emptied without new data
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    auto sender_stats = fetch_stats(sender_stats_port);
+    std::vector<std::vector<std::pair<std::string, std::string>>> receiver_stats;
+    for (auto port : receiver_stats_ports) receiver_stats.push_back(fetch_stats(port));
+
+    close(sender.fd);
+    // in-process sender is reaped together with the receiver
+    if (!in_process) reap(sender);
+    for (auto& r : receiver_processes) {
+        kill(r.pid, SIGTERM);
+        reap(r);
+    }
+    for (auto& c : collectors) c.join();
+
+    std::cout << "{\"config\": {\"receivers\": " << receivers << ", \"psize\": " << psize
+              << ", \"bitrate\": " << bitrate << ", \"duration\": " << duration
+              << ", \"bsize\": " << bsize << ", \"rtime\": " << vm["-R"].as<size_t>()
+              << ", \"io_backend\": " << json_string(vm["-B"].as<std::string>())
+              << ", \"receiver_impairment\": " << json_string(vm["-x"].as<std::string>())
+              << ", \"sender_impairment\": " << json_string(vm["-X"].as<std::string>()) << "},\n";
+    // how receivers coped with the network, summed over all of them
+    uint64_t lost = 0;
+    double underruns = 0, nacks = 0, nacked_ids = 0, dropped = 0, repair_p50 = 0, repair_p99 = 0;
+    for (size_t i = 0; i < receivers; i++) {
+        lost += results[i]->lost;
+        underruns += stat_value(receiver_stats[i], "underruns");
+        nacks += stat_value(receiver_stats[i], "rexmit_requests_sent");
+        nacked_ids += stat_value(receiver_stats[i], "rexmit_ids_requested");
+        dropped += stat_value(receiver_stats[i], "impaired_dropped");
+        repair_p50 = std::max(repair_p50, stat_value(receiver_stats[i], "repair_latency_us_p50"));
+        repair_p99 = std::max(repair_p99, stat_value(receiver_stats[i], "repair_latency_us_p99"));
+    }
+    std::cout << " \"recovery\": {\"dropped_by_network\": " << dropped
+              << ", \"lost_at_playback\": " << lost
+              << ", \"underruns\": " << underruns
+              << ", \"nacks\": " << nacks
+              << ", \"nacks_per_s\": " << nacks / wall_s
+              << ", \"nacked_ids\": " << nacked_ids
+              << ", \"repair_latency_us_p50\": " << repair_p50
+              << ", \"repair_latency_us_p99\": " << repair_p99 << "},\n";
+    std::cout << " \"sender\": {\"packets_written\": " << packets
+              << ", \"packets_per_s\": " << packets / wall_s
+              << ", \"bytes_per_s\": " << packets*psize / wall_s
+              << ", \"cpu_s\": " << cpu_seconds(sender.usage)
+              << ", \"stats\": " << json_stats(sender_stats) << "},\n";
+    std::cout << " \"receivers\": [";
+    for (size_t i = 0; i < receivers; i++) {
+        const auto& result = *results[i];
+        std::cout << (i ? ",\n  " : "\n  ")
+                  << "{\"packets\": " << result.packets
+                  << ", \"packets_per_s\": " << result.packets / wall_s
+                  << ", \"bytes_per_s\": " << result.bytes / wall_s
+                  << ", \"lost\": " << result.lost
+                  << ", \"out_of_order\": " << result.out_of_order
+                  << ", \"latency_us\": " << json_latency(result.latency_us)
+                  << ", \"cpu_s\": " << cpu_seconds(receiver_processes[i].usage)
+                  << ", \"stats\": " << json_stats(receiver_stats[i]) << "}";
+    }
+    std::cout << "]}" << std::endl;
+    return 0;
+}
@@ -0,0 +1,251 @@
+#include <new>
+#include <set>
+#include <memory>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+
+#include "../src/common/types.hpp"
+#include "../src/common/data_msg.hpp"
+#include "../src/common/ctrl_msg.hpp"
+#include "../src/common/transport.hpp"
+#include "../src/common/memory_transport.hpp"
+#include "../src/common/uring_transport.hpp"
+#include "../src/common/address_helpers.hpp"
+#include "../src/receiver/buffer.hpp"
+#include "../src/receiver/rexmit_manager.hpp"
+
+// Microbenchmarks of per-packet hot paths, each prints time and heap allocations per operation.
+
+namespace {
+    using bench_clock = std::chrono::steady_clock;
+
+    const size_t psize = 512;
+    const size_t default_bsize = 65536;
+    const size_t huge_bsize = 16*1024*1024;
+    const size_t rexmit_batch = 16;
+    const size_t send_batch_size = 32;
+    // ids in real streams are byte numbers of a long session, so they are long in text messages
+    const sikradio::common::msg_id_t id_base = 1000000000ull*psize;
+
+    // updated only by the benchmarking thread
+    size_t allocations = 0;
+    size_t allocated_bytes = 0;
+
+    template<typename T>
+    void do_not_optimize(const T& value) {
+        asm volatile("" : : "r,m"(value) : "memory");
+    }
+
+    // runs `body(i)` for i in [0, ops) and reports per-operation averages
+    template<typename F>
+    void bench(const std::string& name, size_t ops, F body) {
+        auto start_allocations = allocations;
+        auto start_bytes = allocated_bytes;
+        auto start = bench_clock::now();
+        for (size_t i = 0; i < ops; i++) body(i);
+        auto elapsed = std::chrono::duration<double, std::nano>(bench_clock::now() - start);
+        std::cout << std::left << std::setw(44) << name << std::right << std::fixed
+                  << " ns/op=" << std::setw(9) << std::setprecision(1) << elapsed.count() / ops
+                  << " allocs/op=" << std::setw(6) << std::setprecision(2)
+                  << static_cast<double>(allocations - start_allocations) / ops
+                  << " bytes/op=" << std::setw(8) << std::setprecision(0)
+                  << static_cast<double>(allocated_bytes - start_bytes) / ops << std::endl;
+    }
+
+    sikradio::common::data_msg make_msg(size_t seq) {
+        return sikradio::common::data_msg(id_base + seq*psize, 1, sikradio::common::msg_t(psize, 7));
+    }
+
+    // order in which packets arrive, `seq` of each packet, lost packets are skipped
+    std::vector<size_t> in_order(size_t packets) {
+        std::vector<size_t> ret(packets);
+        for (size_t i = 0; i < packets; i++) ret[i] = i;
+        return ret;
+    }
+
+    std::vector<size_t> reordered(size_t packets) {
+        // every pair of consecutive packets is swapped
+        auto ret = in_order(packets);
+        for (size_t i = 0; i + 1 < packets; i += 2) std::swap(ret[i], ret[i + 1]);
+        return ret;
+    }
+
+    std::vector<size_t> burst_loss(size_t packets) {
+        // 8 consecutive packets out of every 64 are lost
+        std::vector<size_t> ret;
+        for (size_t i = 0; i < packets; i++)
+            if (i % 64 >= 8) ret.push_back(i);
+        return ret;
+    }
+
+    void bench_buffer_write(const std::string& pattern, const std::vector<size_t>& order, size_t bsize) {
+        sikradio::receiver::buffer buf{bsize};
+        std::vector<sikradio::common::data_msg> msgs;
+        msgs.reserve(order.size());
+        for (auto seq : order) msgs.push_back(make_msg(seq));
+        bench("buffer::write_get_missed " + pattern, msgs.size(), [&](size_t i) {
+            auto missed = buf.write_get_missed(msgs[i]);
+            do_not_optimize(missed);
+        });
+    }
+
+    void bench_buffer_read(size_t bsize) {
+        sikradio::receiver::buffer buf{bsize};
+        size_t elements = bsize / psize;
+        for (size_t seq = 0; seq < elements; seq++) (void)buf.write_get_missed(make_msg(seq));
+        bench("buffer::try_read bsize=" + std::to_string(bsize), elements, [&](size_t) {
+            auto msg = buf.try_read();
+            do_not_optimize(msg);
+        });
+    }
+
+    void bench_rexmit_manager(size_t outstanding) {
+        // rtime of 0 makes every outstanding id due on every filter
+        sikradio::receiver::rexmit_manager mng{std::chrono::milliseconds(0)};
+        std::set<sikradio::common::msg_id_t> batch;
+        for (size_t seq = 0; seq < outstanding; seq++) {
+            batch.insert(id_base + seq*psize);
+            if (batch.size() == rexmit_batch || seq + 1 == outstanding) {
+                mng.append_ids(batch);
+                batch.clear();
+            }
+        }
+        std::set<sikradio::common::msg_id_t> nothing_to_forget;
+        bench("rexmit_manager::filter_get_ids ids=" + std::to_string(outstanding), 2000, [&](size_t) {
+            auto ids = mng.filter_get_ids(nothing_to_forget);
+            do_not_optimize(ids);
+        });
+    }
+
+    void bench_rexmit_append() {
+        sikradio::receiver::rexmit_manager mng{std::chrono::seconds(1)};
+        const size_t ops = 20000;
+        std::vector<std::set<sikradio::common::msg_id_t>> batches(ops);
+        for (size_t i = 0; i < ops; i++)
+            for (size_t j = 0; j < rexmit_batch; j++)
+                batches[i].insert(id_base + (i*rexmit_batch + j)*psize);
+        bench("rexmit_manager::append_ids batch=" + std::to_string(rexmit_batch), ops, [&](size_t i) {
+            mng.append_ids(batches[i]);
+        });
+    }
+
+    void bench_ctrl_msg() {
+        std::set<sikradio::common::msg_id_t> ids;
+        for (size_t seq = 0; seq < rexmit_batch; seq++) ids.insert(id_base + 3*seq*psize);
+        auto rexmit = sikradio::common::make_rexmit(ids);
+        auto reply = sikradio::common::make_reply("Nienazwany nadajnik", "239.10.11.12", 25830);
+
+        bench("ctrl_msg::make_rexmit ids=" + std::to_string(rexmit_batch), 20000, [&](size_t) {
+            auto msg = sikradio::common::make_rexmit(ids);
+            do_not_optimize(msg);
+        });
+        bench("ctrl_msg::get_rexmit_ids ids=" + std::to_string(rexmit_batch), 20000, [&](size_t) {
+            auto parsed = rexmit.get_rexmit_ids();
+            do_not_optimize(parsed);
+        });
+        bench("ctrl_msg::make_reply", 100000, [&](size_t) {
+            auto msg = sikradio::common::make_reply("Nienazwany nadajnik", "239.10.11.12", 25830);
+            do_not_optimize(msg);
+        });
+        bench("ctrl_msg::get_reply_data", 20000, [&](size_t) {
+            auto parsed = reply.get_reply_data();
+            do_not_optimize(parsed);
+        });
+    }
+
+    void bench_data_msg() {
+        auto msg = make_msg(1);
+        auto raw = msg.sendable();
+        bench("data_msg::sendable psize=" + std::to_string(psize), 1000000, [&](size_t) {
+            auto sendable = msg.sendable();
+            do_not_optimize(sendable);
+        });
+        bench("data_msg::data_msg(raw) psize=" + std::to_string(psize), 1000000, [&](size_t) {
+            sikradio::common::data_msg parsed{raw};
+            do_not_optimize(parsed);
+        });
+    }
+
+    // one datagram sent and received by the same thread, so the queue never overflows
+    void bench_transport(const std::string& name, sikradio::common::transport& transport, in_port_t port) {
+        auto destination = sikradio::common::make_address("127.0.0.1", port);
+        auto receiver = transport.open_datagram();
+        receiver->set_receive_timeout(1000);
+        receiver->bind(destination);
+        auto sender = transport.open_datagram();
+        sender->connect(destination);
+        auto sendable = make_msg(1).sendable();
+        sikradio::common::msg_t buf(sendable.size());
+        bench("transport send+receive " + name + " psize=" + std::to_string(psize), 200000, [&](size_t) {
+            sender->send(sendable.data(), sendable.size());
+            auto len = receiver->receive(buf.data(), buf.size());
+            do_not_optimize(len);
+        });
+        // reported per datagram
+        std::vector<sikradio::common::msg_t> batch(send_batch_size, sendable);
+        bench("transport send_batch+receive " + name + " batch=" + std::to_string(send_batch_size),
+              200000, [&](size_t i) {
+            if (i % send_batch_size == 0) sender->send_batch(batch);
+            auto len = receiver->receive(buf.data(), buf.size());
+            do_not_optimize(len);
+        });
+    }
+}
+
+// counting replacements of global allocation functions, malloc and free are called out of line,
+// otherwise compiler reports inlined allocator calls as mismatched
+__attribute__((noinline)) void *counted_malloc(size_t size) {
+    allocations++;
+    allocated_bytes += size;
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+__attribute__((noinline)) void counted_free(void *ptr) {
+    std::free(ptr);
+}
+
+void *operator new(size_t size) {
+    if (void *ptr = counted_malloc(size)) return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept {
+    counted_free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+    counted_free(ptr);
+}
+
+int main() {
+    const size_t packets = 200000;
+    bench_buffer_write("in-order", in_order(packets), default_bsize);
+    bench_buffer_write("reordered", reordered(packets), default_bsize);
+    bench_buffer_write("burst-loss", burst_loss(packets), default_bsize);
+    bench_buffer_write("in-order huge", in_order(packets), huge_bsize);
+    bench_buffer_write("burst-loss huge", burst_loss(packets), huge_bsize);
+    bench_buffer_read(default_bsize);
+    bench_buffer_read(huge_bsize);
+
+    bench_rexmit_append();
+    bench_rexmit_manager(rexmit_batch);
+    bench_rexmit_manager(1024);
+
+    bench_ctrl_msg();
+    bench_data_msg();
+
+    bench_transport("udp", *sikradio::common::default_transport(), 45840);
+    try {
+        sikradio::common::uring_transport uring;
+        bench_transport("uring", uring, 45841);
+    } catch (sikradio::common::exceptions::socket_exception &e) {
+        std::cout << "io_uring is not available: " << e.what() << std::endl;
+    }
+    auto memory = std::make_shared<sikradio::common::memory_transport>();
+    bench_transport("memory", *memory, 45842);
+    return 0;
+}
@@ -7,6 +7,7 @@
 #include <utility>
 #include <cstring>
 #include <string>
+#include <sstream>
 #include <netinet/in.h>
 
 #include "exceptions.hpp"
@@ -17,6 +18,8 @@ namespace sikradio::common {
         const std::string lookup_msg_key = "ZERO_SEVEN_COME_IN";
         const std::string reply_msg_key = "BOREWICZ_HERE ";
         const std::string rexmit_msg_key = "LOUDER_PLEASE ";
+        const std::string catch_up_msg_key = "CATCH_UP_PLEASE ";
+        const std::string catch_up_reply_msg_key = "CATCH_UP_HERE ";
     }
 
     using ctrl_msg_exception = exceptions::ctrl_msg_exception;
@@ -43,6 +46,14 @@ namespace sikradio::common {
             return (msg_data.find(rexmit_msg_key) == 0);
         }
 
+        bool is_catch_up() const {
+            return (msg_data.find(catch_up_msg_key) == 0);
+        }
+
+        bool is_catch_up_reply() const {
+            return (msg_data.find(catch_up_reply_msg_key) == 0);
+        }
+
         std::vector<sikradio::common::msg_id_t> get_rexmit_ids() const {
             if (!is_rexmit()) 
                 throw ctrl_msg_exception("Trying to read rexmit ids from non-rexmit message");
@@ -85,6 +96,30 @@ namespace sikradio::common {
             return std::make_tuple(name, addr, port);
         }
 
+        // number of bytes of recent audio requested by the receiver
+        uint64_t get_catch_up_bytes() const {
+            if (!is_catch_up())
+                throw ctrl_msg_exception("Trying to read catch up size from non-catch-up message");
+            std::istringstream ss(msg_data.substr(catch_up_msg_key.length()));
+            uint64_t bytes;
+            if (!(ss >> bytes)) throw ctrl_msg_exception("Invalid catch up message");
+            return bytes;
+        }
+
+        // session id, first byte numbers of the first packet of the burst and of the newest packet sent
+        std::tuple<sikradio::common::msg_id_t, sikradio::common::msg_id_t, sikradio::common::msg_id_t>
+        get_catch_up_reply_data() const {
+            if (!is_catch_up_reply())
+                throw ctrl_msg_exception("Trying to read catch up data from non-catch-up reply message");
+            std::istringstream ss(msg_data.substr(catch_up_reply_msg_key.length()));
+            sikradio::common::msg_id_t session_id;
+            sikradio::common::msg_id_t first;
+            sikradio::common::msg_id_t head;
+            if (!(ss >> session_id >> first >> head) || first > head)
+                throw ctrl_msg_exception("Invalid catch up reply message");
+            return std::make_tuple(session_id, first, head);
+        }
+
         std::string sendable() const {
             return msg_data;
         }
@@ -117,6 +152,19 @@ namespace sikradio::common {
         }
         return ctrl_msg(rexmit_msg_key + ss.str() + "\n");
     }
+
+    ctrl_msg make_catch_up(uint64_t bytes) {
+        return ctrl_msg(catch_up_msg_key + std::to_string(bytes) + "\n");
+    }
+
+    ctrl_msg make_catch_up_reply(
+            sikradio::common::msg_id_t session_id,
+            sikradio::common::msg_id_t first,
+            sikradio::common::msg_id_t head) {
+        std::ostringstream ss;
+        ss << catch_up_reply_msg_key << session_id << " " << first << " " << head << "\n";
+        return ctrl_msg(ss.str());
+    }
 }
 
 #endif //SIKRADIO_COMMON_CTRL_MSG_HPP
@@ -11,14 +11,12 @@
 #include <string>
 #include <tuple>
 #include <optional>
+#include <memory>
 
 #include "exceptions.hpp"
+#include "transport.hpp"
 #include "../common/ctrl_msg.hpp"
 
-#ifndef TTL_VALUE
-#define TTL_VALUE 64
-#endif
-
 #ifndef UDP_DATAGRAM_DATA_LEN_MAX
 #define UDP_DATAGRAM_DATA_LEN_MAX 65535
 #endif
@@ -31,12 +29,7 @@ namespace sikradio::common {
         std::mutex read_mut{};
         std::mutex write_mut{};
         sikradio::common::byte_t buffer[UDP_DATAGRAM_DATA_LEN_MAX];
-        int sock = -1;
-
-        void close_and_throw() {
-            close(sock);
-            throw socket_exception(strerror(errno));
-        }
+        std::unique_ptr<sikradio::common::datagram_socket> sock;
 
     public:
         ctrl_socket() = delete;
@@ -47,102 +40,60 @@ namespace sikradio::common {
                 in_port_t local_port, 
                 int socket_timeout_in_ms=500,
                 bool enable_broadcast=false, 
-                bool bind_local=true) {
-            sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
-            if (sock < 0) throw socket_exception(strerror(errno));
+                bool bind_local=true,
+                std::shared_ptr<sikradio::common::transport> transport=default_transport()) : 
+                sock{transport->open_datagram()} {
             // reuse address if necessary
-            int enable = 1;
-            int err = setsockopt(
-                sock, 
-                SOL_SOCKET, 
-                SO_REUSEADDR, 
-                &enable, 
-                sizeof(enable));
-            if (err < 0) close_and_throw();
+            sock->enable_reuse_address();
             // set timeout to prevent deadlocks
-            struct timeval tv{
-                    .tv_sec = 0,
-                    .tv_usec = 1000*socket_timeout_in_ms
-            };
-            err = setsockopt(
-                sock, 
-                SOL_SOCKET, 
-                SO_RCVTIMEO, 
-                &tv, 
-                sizeof(tv));
-            if (err < 0) close_and_throw();
+            sock->set_receive_timeout(socket_timeout_in_ms);
             if (enable_broadcast) {
-                // enable broadcast
-                int broadcast = 1;
-                err = setsockopt(
-                    sock, 
-                    SOL_SOCKET, 
-                    SO_BROADCAST, 
-                    &broadcast, 
-                    sizeof(broadcast));
-                if (err < 0) close_and_throw();
-                // set TTL value
-                int ttl = TTL_VALUE;
-                err = setsockopt(
-                    sock,
-                    IPPROTO_IP,
-                    IP_MULTICAST_TTL,
-                    &ttl,
-                    sizeof(ttl));
-                if (err < 0) close_and_throw();
+                sock->enable_broadcast();
+                sock->set_multicast_ttl(TTL_VALUE);
             }
             if (bind_local) {
                 // bind socket to local port
-                struct sockaddr_in local_addr;
+                struct sockaddr_in local_addr{};
                 local_addr.sin_family = AF_INET;
                 local_addr.sin_port = htons(local_port);
                 local_addr.sin_addr.s_addr = htonl(INADDR_ANY);
-                err = bind(sock, (struct sockaddr *) &local_addr, sizeof(local_addr));
-                if (err < 0) close_and_throw();
+                sock->bind(local_addr);
             }
         }
 
+        // datagrams sent to the group on the local port are received too
+        void join_group(struct in_addr group) {
+            sock->join_group(group);
+        }
+
         std::optional<std::tuple<sikradio::common::ctrl_msg, struct sockaddr_in>> 
         try_read() {
-            std::scoped_lock{read_mut};
+            std::scoped_lock lock{read_mut};
             struct sockaddr_in sender_address{};
-            auto rcva_len = (socklen_t) sizeof(sender_address);
-            memset(buffer, 0, UDP_DATAGRAM_DATA_LEN_MAX);
-            ssize_t len = recvfrom(
-                sock, 
-                (void *) buffer, 
-                sizeof(buffer), 
-                0, 
-                (struct sockaddr *) &sender_address,
-                &rcva_len);
-            if (len < 0) {
-                if (errno == EAGAIN || errno == EWOULDBLOCK) {  
-                    // timeout reached, this is not really an error
-                    errno = 0;
-                    return std::nullopt;
-                } else {
-                    throw socket_exception(strerror(errno));
-                }
-            }
-            sikradio::common::ctrl_msg msg(std::string(buffer, buffer+len));
+            auto len = sock->receive(buffer, sizeof(buffer), &sender_address);
+            // timeout reached, this is not really an error
+            if (!len.has_value()) return std::nullopt;
+            sikradio::common::ctrl_msg msg(std::string(buffer, buffer+len.value()));
             return std::make_optional(std::make_tuple(msg, sender_address));
         }
 
         void send_to(
                 const struct sockaddr_in& destination, 
                 sikradio::common::ctrl_msg msg) {
-            std::scoped_lock{write_mut};
-            size_t data_len = msg.sendable().size();
-            ssize_t snd_len = sendto(
-                sock, 
-                msg.sendable().data(), 
-                data_len, 
-                0,
-                reinterpret_cast<const sockaddr *>(&destination),
-                (socklen_t) sizeof(destination));
-            if (snd_len < 0) throw socket_exception(strerror(errno));
-            if (snd_len != static_cast<ssize_t>(data_len)) 
-                throw socket_exception("Failed to send entire response");
+            std::scoped_lock lock{write_mut};
+            auto data = msg.sendable();
+            sock->send_to(
+                destination, 
+                reinterpret_cast<const sikradio::common::byte_t *>(data.data()), 
+                data.size());
+        }
+
+        // retransmissions requested by few receivers are sent to them directly, from the control port
+        void send_data_to(
+                const struct sockaddr_in& destination, 
+                const sikradio::common::msg_t& data) {
+            std::scoped_lock lock{write_mut};
+            sock->send_to(destination, data.data(), data.size());
         }
 
         void force_send_to(
@@ -157,10 +108,6 @@ namespace sikradio::common {
                 }
             }
         }
-
-        ~ctrl_socket() {
-            if (sock >= 0) close(sock);
-        }
     };
 }
 
@@ -41,6 +41,30 @@ namespace sikradio::common::exceptions {
         explicit data_msg_exception(std::string msg_str) : 
             base_exception(std::move(msg_str)) {}
     };
+
+    class impairment_exception : public base_exception {
+    public:
+        explicit impairment_exception(std::string msg_str) : 
+            base_exception(std::move(msg_str)) {}
+    };
+
+    class realtime_exception : public base_exception {
+    public:
+        explicit realtime_exception(std::string msg_str) : 
+            base_exception(std::move(msg_str)) {}
+    };
+
+    class input_exception : public base_exception {
+    public:
+        explicit input_exception(std::string msg_str) : 
+            base_exception(std::move(msg_str)) {}
+    };
+
+    class archive_exception : public base_exception {
+    public:
+        explicit archive_exception(std::string msg_str) : 
+            base_exception(std::move(msg_str)) {}
+    };
 }
 
 #endif
@@ -0,0 +1,139 @@
+#ifndef SIKRADIO_COMMON_FEC_MSG_HPP
+#define SIKRADIO_COMMON_FEC_MSG_HPP
+
+#include <cstring>
+#include <cstdint>
+#include <netinet/in.h>
+
+#include "exceptions.hpp"
+#include "types.hpp"
+#include "data_msg.hpp"
+
+#if defined(__SSE2__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace sikradio::common {
+    // xors src into dst, using the widest vector registers available at compile time
+    void xor_into(byte_t *dst, const byte_t *src, size_t len) {
+        size_t i = 0;
+#if defined(__AVX2__)
+        for (; i + sizeof(__m256i) <= len; i += sizeof(__m256i)) {
+            __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(dst + i));
+            __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_xor_si256(a, b));
+        }
+#endif
+#if defined(__SSE2__)
+        for (; i + sizeof(__m128i) <= len; i += sizeof(__m128i)) {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(dst + i));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_xor_si128(a, b));
+        }
+#endif
+        for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+            uint64_t a, b;
+            memcpy(&a, dst + i, sizeof(a));
+            memcpy(&b, src + i, sizeof(b));
+            a ^= b;
+            memcpy(dst + i, &a, sizeof(a));
+        }
+        for (; i < len; i++) dst[i] ^= src[i];
+    }
+
+    // parity of `count` data messages, starting with the one with `first_id`,
+    // protected messages are `stride` messages apart (1 for consecutive messages)
+    class fec_msg {
+    private:
+        msg_id_t session_id;
+        msg_id_t first_id;
+        uint16_t count;
+        uint16_t stride;
+        msg_t parity;
+
+        static const size_t header_size = 2*sizeof(msg_id_t) + 2*sizeof(uint16_t);
+
+    public:
+        fec_msg() = delete;
+        fec_msg(const fec_msg& other) = default;
+
+        fec_msg(msg_id_t session_id, msg_id_t first_id, uint16_t count, msg_t parity) :
+            fec_msg(session_id, first_id, count, 1, std::move(parity)) {}
+
+        fec_msg(
+                msg_id_t session_id, 
+                msg_id_t first_id, 
+                uint16_t count, 
+                uint16_t stride, 
+                msg_t parity) :
+            session_id{session_id},
+            first_id{first_id},
+            count{count},
+            stride{stride},
+            parity{std::move(parity)} {}
+
+        explicit fec_msg(const msg_t &raw_msg) {
+            if (raw_msg.size() < header_size)
+                throw data_msg_exception("Parity message is too short");
+            memcpy(&session_id, raw_msg.data(), sizeof(msg_id_t));
+            session_id = ntohll(session_id);
+            memcpy(&first_id, raw_msg.data() + sizeof(msg_id_t), sizeof(msg_id_t));
+            first_id = ntohll(first_id);
+            memcpy(&count, raw_msg.data() + 2*sizeof(msg_id_t), sizeof(uint16_t));
+            count = ntohs(count);
+            memcpy(&stride, raw_msg.data() + 2*sizeof(msg_id_t) + sizeof(uint16_t), sizeof(uint16_t));
+            stride = ntohs(stride);
+            if (stride == 0)
+                throw data_msg_exception("Parity message has invalid stride");
+            parity.assign(raw_msg.begin() + header_size, raw_msg.end());
+        }
+
+        msg_id_t get_session_id() const {
+            return session_id;
+        }
+
+        msg_id_t get_first_id() const {
+            return first_id;
+        }
+
+        uint16_t get_count() const {
+            return count;
+        }
+
+        uint16_t get_stride() const {
+            return stride;
+        }
+
+        const msg_t& get_parity() const {
+            return parity;
+        }
+
+        // id of i-th message protected by this parity, given the size of data messages
+        msg_id_t protected_id(size_t i) const {
+            return first_id + i*stride*parity.size();
+        }
+
+        bool protects(msg_id_t id) const {
+            if (id < first_id || parity.empty()) return false;
+            auto distance = (id - first_id) / parity.size();
+            if ((id - first_id) % parity.size() != 0 || distance % stride != 0) return false;
+            return (distance / stride < count);
+        }
+
+        msg_t sendable() const {
+            auto net_session_id = htonll(session_id);
+            auto net_first_id = htonll(first_id);
+            auto net_count = htons(count);
+            auto net_stride = htons(stride);
+            msg_t ret(header_size + parity.size());
+            memcpy(ret.data(), &net_session_id, sizeof(msg_id_t));
+            memcpy(ret.data() + sizeof(msg_id_t), &net_first_id, sizeof(msg_id_t));
+            memcpy(ret.data() + 2*sizeof(msg_id_t), &net_count, sizeof(uint16_t));
+            memcpy(ret.data() + 2*sizeof(msg_id_t) + sizeof(uint16_t), &net_stride, sizeof(uint16_t));
+            memcpy(ret.data() + header_size, parity.data(), parity.size());
+            return ret;
+        }
+    };
+}
+
+#endif //SIKRADIO_COMMON_FEC_MSG_HPP
@@ -0,0 +1,86 @@
+#ifndef SIKRADIO_COMMON_HISTOGRAM_HPP
+#define SIKRADIO_COMMON_HISTOGRAM_HPP
+
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+namespace sikradio::common::metrics {
+    namespace {
+        // each power of two range is split into 2^histogram_sub_bucket_bits buckets,
+        // so recorded values are exact below 16 and within 1/16 of the real value above it
+        const unsigned histogram_sub_bucket_bits = 4;
+        const uint64_t histogram_sub_buckets = uint64_t{1} << histogram_sub_bucket_bits;
+        const size_t histogram_buckets = (64 - histogram_sub_bucket_bits + 1)*histogram_sub_buckets;
+    }
+
+    // log-bucketed histogram of non-negative integer values (e.g. latencies in microseconds),
+    // recording is a single relaxed atomic increment, so it can be done from the hot path
+    class histogram {
+    private:
+        std::atomic<uint64_t> buckets[histogram_buckets]{};
+        std::atomic<uint64_t> total{0};
+        std::atomic<uint64_t> max_value{0};
+
+        static size_t bucket_of(uint64_t value) {
+            if (value < histogram_sub_buckets) return value;
+            unsigned msb = 63 - __builtin_clzll(value);
+            unsigned shift = msb - histogram_sub_bucket_bits;
+            return (shift + 1)*histogram_sub_buckets
+                + ((value >> shift) & (histogram_sub_buckets - 1));
+        }
+
+        // highest value that is recorded in given bucket
+        static uint64_t highest_value_of(size_t bucket) {
+            if (bucket < histogram_sub_buckets) return bucket;
+            unsigned shift = bucket / histogram_sub_buckets - 1;
+            uint64_t mantissa = histogram_sub_buckets + bucket % histogram_sub_buckets;
+            return ((mantissa + 1) << shift) - 1;
+        }
+
+    public:
+        histogram() = default;
+        histogram(const histogram& other) = delete;
+        histogram(histogram&& other) = delete;
+
+        void record(uint64_t value) {
+            buckets[bucket_of(value)].fetch_add(1, std::memory_order_relaxed);
+            total.fetch_add(1, std::memory_order_relaxed);
+            auto prev_max = max_value.load(std::memory_order_relaxed);
+            while (value > prev_max
+                && !max_value.compare_exchange_weak(prev_max, value, std::memory_order_relaxed)) {}
+        }
+
+        uint64_t get_count() const {
+            return total.load(std::memory_order_relaxed);
+        }
+
+        uint64_t get_max() const {
+            return max_value.load(std::memory_order_relaxed);
+        }
+
+        // value below or equal to which are `quantile` of recorded values, 0 if nothing was recorded
+        uint64_t get_percentile(double quantile) const {
+            // buckets are read once, so that concurrent recording does not skew the result
+            std::vector<uint64_t> counts(histogram_buckets);
+            uint64_t count = 0;
+            for (size_t i = 0; i < histogram_buckets; i++) {
+                counts[i] = buckets[i].load(std::memory_order_relaxed);
+                count += counts[i];
+            }
+            if (count == 0) return 0;
+            auto rank = static_cast<uint64_t>(std::ceil(std::clamp(quantile, 0.0, 1.0)*count));
+            rank = std::clamp<uint64_t>(rank, 1, count);
+            uint64_t seen = 0;
+            for (size_t i = 0; i < histogram_buckets; i++) {
+                seen += counts[i];
+                if (seen >= rank) return std::min(highest_value_of(i), get_max());
+            }
+            return get_max();
+        }
+    };
+}
+
+#endif //SIKRADIO_COMMON_HISTOGRAM_HPP
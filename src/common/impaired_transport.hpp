@@ -0,0 +1,331 @@
+#ifndef SIKRADIO_COMMON_IMPAIRED_TRANSPORT_HPP
+#define SIKRADIO_COMMON_IMPAIRED_TRANSPORT_HPP
+
+#include <queue>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <sstream>
+#include <optional>
+#include <algorithm>
+#include <netinet/in.h>
+
+#include "exceptions.hpp"
+#include "types.hpp"
+#include "transport.hpp"
+#include "metrics.hpp"
+
+#ifndef UDP_DATAGRAM_DATA_LEN_MAX
+#define UDP_DATAGRAM_DATA_LEN_MAX 65535
+#endif
+
+namespace sikradio::common {
+    namespace {
+        // delayed datagrams are checked at least this often while waiting for new ones
+        const int impairment_poll_ms = 1;
+        const uint64_t impairment_seed_step = 0x9e3779b97f4a7c15ull;
+    }
+
+    // network conditions applied to received datagrams, probabilities are per datagram
+    struct impairment {
+        double loss{0.0};  // loss probability (in good state of the burst model)
+        double burst_enter{0.0};  // Gilbert-Elliott model: probability of going from good to bad state
+        double burst_exit{1.0};  // probability of going from bad to good state
+        double burst_loss{1.0};  // loss probability in bad state
+        double duplicate{0.0};
+        double reorder{0.0};  // probability that datagram is held back by reorder_delay_ms
+        double reorder_delay_ms{10.0};
+        double delay_ms{0.0};
+        double jitter_ms{0.0};  // extra delay drawn uniformly from [0, jitter_ms]
+        uint64_t seed{1};
+
+        bool delays() const {
+            return (delay_ms > 0 || jitter_ms > 0 || reorder > 0);
+        }
+    };
+
+    // parses comma separated `key=value` list, e.g. "loss=0.01,burst=0.02:0.3,delay=5,jitter=2",
+    // keys: loss, burst (enter:exit), burst_loss, dup, reorder, reorder_delay, delay, jitter, seed
+    inline impairment parse_impairment(const std::string& spec) {
+        impairment ret{};
+        std::istringstream items{spec};
+        std::string item;
+        auto fail = [&spec]() {
+            throw exceptions::impairment_exception("Invalid impairment: " + spec);
+        };
+        auto number = [&fail](const std::string& text) {
+            size_t parsed = 0;
+            double value = 0;
+            try {
+                value = std::stod(text, &parsed);
+            } catch (std::exception &e) {
+                fail();
+            }
+            if (parsed != text.size() || value < 0) fail();
+            return value;
+        };
+        auto probability = [&number, &fail](const std::string& text) {
+            auto value = number(text);
+            if (value > 1) fail();
+            return value;
+        };
+        while (std::getline(items, item, ',')) {
+            if (item.empty()) continue;
+            auto eq = item.find('=');
+            if (eq == std::string::npos) fail();
+            auto key = item.substr(0, eq);
+            auto value = item.substr(eq + 1);
+            if (key == "loss") {
+                ret.loss = probability(value);
+            } else if (key == "burst") {
+                auto colon = value.find(':');
+                if (colon == std::string::npos) fail();
+                ret.burst_enter = probability(value.substr(0, colon));
+                ret.burst_exit = probability(value.substr(colon + 1));
+            } else if (key == "burst_loss") {
+                ret.burst_loss = probability(value);
+            } else if (key == "dup") {
+                ret.duplicate = probability(value);
+            } else if (key == "reorder") {
+                ret.reorder = probability(value);
+            } else if (key == "reorder_delay") {
+                ret.reorder_delay_ms = number(value);
+            } else if (key == "delay") {
+                ret.delay_ms = number(value);
+            } else if (key == "jitter") {
+                ret.jitter_ms = number(value);
+            } else if (key == "seed") {
+                ret.seed = static_cast<uint64_t>(number(value));
+            } else {
+                fail();
+            }
+        }
+        return ret;
+    }
+
+    // Gilbert-Elliott two-state loss model, with burst_enter = 0 it is a Bernoulli model
+    class loss_model {
+    private:
+        double loss;
+        double burst_enter;
+        double burst_exit;
+        double burst_loss;
+        bool bad_state{false};
+        std::uniform_real_distribution<double> uniform{0.0, 1.0};
+
+    public:
+        explicit loss_model(const impairment& cfg) :
+                loss{cfg.loss},
+                burst_enter{cfg.burst_enter},
+                burst_exit{cfg.burst_exit},
+                burst_loss{cfg.burst_loss} {}
+
+        template<typename Rng>
+        bool lose(Rng& rng) {
+            if (bad_state) {
+                if (uniform(rng) < burst_exit) bad_state = false;
+            } else {
+                if (uniform(rng) < burst_enter) bad_state = true;
+            }
+            return (uniform(rng) < (bad_state ? burst_loss : loss));
+        }
+    };
+
+    // what happened to datagrams received through the transport
+    struct impairment_counters {
+        std::atomic<uint64_t> received{0};
+        std::atomic<uint64_t> dropped{0};
+        std::atomic<uint64_t> duplicated{0};
+        std::atomic<uint64_t> reordered{0};
+    };
+
+    // socket that impairs datagrams after receiving them from the wrapped socket,
+    // sending is not affected
+    class impaired_socket : public datagram_socket {
+    private:
+        using impairment_clock = std::chrono::steady_clock;
+
+        struct held_datagram {
+            impairment_clock::time_point due;
+            uint64_t seq;  // keeps order of datagrams with the same due time
+            msg_t data;
+            struct sockaddr_in from;
+        };
+
+        struct later_first {
+            bool operator()(const held_datagram& lhs, const held_datagram& rhs) const {
+                if (lhs.due != rhs.due) return lhs.due > rhs.due;
+                return lhs.seq > rhs.seq;
+            }
+        };
+
+        std::unique_ptr<datagram_socket> inner;
+        impairment cfg;
+        std::shared_ptr<impairment_counters> counters;
+        std::mt19937_64 rng;
+        loss_model losses;
+        std::uniform_real_distribution<double> uniform{0.0, 1.0};
+        std::priority_queue<held_datagram, std::vector<held_datagram>, later_first> held{};
+        uint64_t next_seq{0};
+        int timeout_in_ms{0};
+        msg_t buffer;
+
+        impairment_clock::duration ms(double value) {
+            return std::chrono::duration_cast<impairment_clock::duration>(
+                std::chrono::duration<double, std::milli>(value));
+        }
+
+        void hold(impairment_clock::time_point received, const byte_t *data, size_t len,
+                  const struct sockaddr_in& from) {
+            auto due = received + ms(cfg.delay_ms + cfg.jitter_ms*uniform(rng));
+            if (cfg.reorder > 0 && uniform(rng) < cfg.reorder) {
+                due += ms(cfg.reorder_delay_ms);
+                counters->reordered.fetch_add(1, std::memory_order_relaxed);
+            }
+            held.push(held_datagram{due, next_seq++, msg_t(data, data + len), from});
+        }
+
+        size_t release(byte_t *buf, size_t len, struct sockaddr_in *from) {
+            const auto& datagram = held.top();
+            auto rcv_len = std::min(len, datagram.data.size());
+            memcpy(buf, datagram.data.data(), rcv_len);
+            if (from != nullptr) *from = datagram.from;
+            held.pop();
+            return rcv_len;
+        }
+
+    public:
+        impaired_socket(const impaired_socket& other) = delete;
+        impaired_socket(impaired_socket&& other) = delete;
+
+        impaired_socket(
+                std::unique_ptr<datagram_socket> inner,
+                const impairment& cfg,
+                std::shared_ptr<impairment_counters> counters,
+                uint64_t seed) :
+            inner{std::move(inner)},
+            cfg{cfg},
+            counters{std::move(counters)},
+            rng{seed},
+            losses{cfg},
+            buffer(UDP_DATAGRAM_DATA_LEN_MAX) {}
+
+        void enable_reuse_address() override {
+            inner->enable_reuse_address();
+        }
+
+        void enable_broadcast() override {
+            inner->enable_broadcast();
+        }
+
+        void set_multicast_ttl(int ttl) override {
+            inner->set_multicast_ttl(ttl);
+        }
+
+        void set_multicast_interface(struct in_addr interface_address) override {
+            inner->set_multicast_interface(interface_address);
+        }
+
+        void join_group(struct in_addr group) override {
+            inner->join_group(group);
+        }
+
+        void set_receive_timeout(int timeout_in_ms) override {
+            this->timeout_in_ms = timeout_in_ms;
+            // delayed datagrams have to be released while waiting for new ones
+            bool poll = cfg.delays() && (timeout_in_ms == 0 || timeout_in_ms > impairment_poll_ms);
+            inner->set_receive_timeout(poll ? impairment_poll_ms : timeout_in_ms);
+        }
+
+        void set_busy_poll(int busy_poll_in_us) override {
+            inner->set_busy_poll(busy_poll_in_us);
+        }
+
+        void bind(const struct sockaddr_in& local_address) override {
+            inner->bind(local_address);
+        }
+
+        void connect(const struct sockaddr_in& remote_address) override {
+            inner->connect(remote_address);
+        }
+
+        void send(const byte_t *data, size_t len) override {
+            inner->send(data, len);
+        }
+
+        void send_to(const struct sockaddr_in& destination, const byte_t *data, size_t len) override {
+            inner->send_to(destination, data, len);
+        }
+
+        // impairments are applied on receive, so sending keeps batching of the inner backend
+        void send_batch(const std::vector<msg_t>& datagrams) override {
+            inner->send_batch(datagrams);
+        }
+
+        std::optional<size_t> receive(byte_t *buf, size_t len, struct sockaddr_in *from) override {
+            auto deadline = impairment_clock::now() + std::chrono::milliseconds(timeout_in_ms);
+            while (true) {
+                if (!held.empty() && held.top().due <= impairment_clock::now())
+                    return release(buf, len, from);
+                struct sockaddr_in sender_address{};
+                auto rcv_len = inner->receive(buffer.data(), buffer.size(), &sender_address);
+                auto now = impairment_clock::now();
+                if (rcv_len.has_value()) {
+                    counters->received.fetch_add(1, std::memory_order_relaxed);
+                    if (losses.lose(rng)) {
+                        counters->dropped.fetch_add(1, std::memory_order_relaxed);
+                    } else {
+                        int copies = 1;
+                        if (cfg.duplicate > 0 && uniform(rng) < cfg.duplicate) {
+                            counters->duplicated.fetch_add(1, std::memory_order_relaxed);
+                            copies = 2;
+                        }
+                        for (int i = 0; i < copies; i++)
+                            hold(now, buffer.data(), rcv_len.value(), sender_address);
+                        continue;
+                    }
+                }
+                if (timeout_in_ms > 0 && now >= deadline) return std::nullopt;
+            }
+        }
+    };
+
+    // transport decorator emulating lossy network on the receiving side of its sockets,
+    // each socket draws from its own random generator, derived from the seed deterministically
+    class impaired_transport : public transport {
+    private:
+        std::shared_ptr<transport> inner;
+        impairment cfg;
+        std::shared_ptr<impairment_counters> counters{std::make_shared<impairment_counters>()};
+        std::atomic<uint64_t> opened_sockets{0};
+
+    public:
+        impaired_transport(std::shared_ptr<transport> inner, const impairment& cfg) :
+            inner{std::move(inner)},
+            cfg{cfg} {}
+
+        std::unique_ptr<datagram_socket> open_datagram() override {
+            auto seed = cfg.seed + impairment_seed_step*opened_sockets.fetch_add(1);
+            return std::make_unique<impaired_socket>(inner->open_datagram(), cfg, counters, seed);
+        }
+
+        const impairment_counters& get_counters() const {
+            return *counters;
+        }
+
+        // exposes counters in stats of the program that uses the transport
+        void register_probes(metrics::registry& registry) {
+            auto c = counters;
+            registry.register_probe("impaired_received", [c]() { return c->received.load(); });
+            registry.register_probe("impaired_dropped", [c]() { return c->dropped.load(); });
+            registry.register_probe("impaired_duplicated", [c]() { return c->duplicated.load(); });
+            registry.register_probe("impaired_reordered", [c]() { return c->reordered.load(); });
+        }
+    };
+}
+
+#endif //SIKRADIO_COMMON_IMPAIRED_TRANSPORT_HPP
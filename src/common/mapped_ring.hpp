@@ -0,0 +1,82 @@
+#ifndef SIKRADIO_COMMON_MAPPED_RING_HPP
+#define SIKRADIO_COMMON_MAPPED_RING_HPP
+
+#include <string>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "exceptions.hpp"
+#include "types.hpp"
+
+namespace sikradio::common {
+    // file of fixed size slots mapped to memory, the file is preallocated on disk, so writing a slot
+    // never allocates (neither memory nor disk blocks), contents live in page cache and are written
+    // back by the kernel, slot indexes wrap around
+    class mapped_ring {
+    private:
+        byte_t *data{nullptr};
+        size_t slot_size;
+        size_t slot_count;
+
+        [[noreturn]] static void fail(const std::string& path, int err) {
+            throw exceptions::archive_exception(path + ": " + strerror(err));
+        }
+
+    public:
+        mapped_ring(const mapped_ring& other) = delete;
+        mapped_ring(mapped_ring&& other) = delete;
+
+        mapped_ring(const std::string& path, size_t slot_size, size_t slot_count) :
+                slot_size{slot_size},
+                slot_count{slot_count} {
+            if (slot_size == 0 || slot_count == 0)
+                throw exceptions::archive_exception(path + ": ring has to have non-empty slots");
+            auto size = static_cast<off_t>(slot_size*slot_count);
+            int fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+            if (fd < 0) fail(path, errno);
+            // file is resized to exactly the ring, and blocks are allocated upfront, so that
+            // a full disk is reported here instead of with SIGBUS on write to the mapping
+            int err = (ftruncate(fd, size) < 0) ? errno : posix_fallocate(fd, 0, size);
+            if (err != 0) {
+                close(fd);
+                fail(path, err);
+            }
+            void *mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            err = errno;
+            // mapping stays valid after the descriptor is closed
+            close(fd);
+            if (mapping == MAP_FAILED) fail(path, err);
+            data = static_cast<byte_t *>(mapping);
+        }
+
+        byte_t *slot(size_t index) {
+            return data + (index % slot_count)*slot_size;
+        }
+
+        const byte_t *slot(size_t index) const {
+            return data + (index % slot_count)*slot_size;
+        }
+
+        size_t get_slot_size() const {
+            return slot_size;
+        }
+
+        size_t get_slot_count() const {
+            return slot_count;
+        }
+
+        // slots are contiguous, so the ring can be used as a single array of bytes
+        size_t get_size() const {
+            return slot_size*slot_count;
+        }
+
+        ~mapped_ring() {
+            if (data != nullptr) munmap(data, slot_size*slot_count);
+        }
+    };
+}
+
+#endif //SIKRADIO_COMMON_MAPPED_RING_HPP
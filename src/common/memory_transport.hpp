@@ -0,0 +1,245 @@
+#ifndef SIKRADIO_COMMON_MEMORY_TRANSPORT_HPP
+#define SIKRADIO_COMMON_MEMORY_TRANSPORT_HPP
+
+#include <set>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <cstring>
+#include <optional>
+#include <algorithm>
+#include <netinet/in.h>
+
+#include "exceptions.hpp"
+#include "types.hpp"
+#include "mpmc_ring.hpp"
+#include "transport.hpp"
+
+namespace sikradio::common {
+    namespace {
+        const size_t memory_socket_queue_size = 4096;
+        const in_port_t memory_ephemeral_port_min = 49152;
+        // receivers spin for a while before sleeping between polls of the queue
+        const int memory_receive_spins = 256;
+        const auto memory_receive_sleep = std::chrono::microseconds(50);
+    }
+
+    struct memory_datagram {
+        msg_t data{};
+        struct sockaddr_in from{};
+    };
+
+    // incoming datagrams of a single memory socket
+    struct memory_endpoint {
+        mpmc_ring<memory_datagram> queue{memory_socket_queue_size};
+        std::atomic<uint64_t> dropped{0};  // datagrams that did not fit in the queue
+    };
+
+    // in-process network, datagrams are moved between sockets through lock-free queues,
+    // so that whole sender-receiver pipeline can run in one process at memory speed,
+    // all sockets share the loopback address and ports are assigned as in the kernel
+    class memory_transport : public transport, public std::enable_shared_from_this<memory_transport> {
+    private:
+        struct route {
+            std::shared_ptr<memory_endpoint> endpoint;
+            struct in_addr address;  // INADDR_ANY or address that the socket was bound to
+            in_port_t port;  // host byte order
+            std::set<in_addr_t> groups;
+            bool reuse_address;
+        };
+        using route_table = std::vector<route>;
+
+        // routes are changed rarely (bind, join, close) and read on every send without locking
+        std::mutex mut{};
+        std::shared_ptr<const route_table> routes{std::make_shared<route_table>()};
+        in_port_t next_ephemeral_port{memory_ephemeral_port_min};
+
+        static bool is_multicast(struct in_addr address) {
+            return IN_MULTICAST(ntohl(address.s_addr));
+        }
+
+        static bool is_broadcast(struct in_addr address) {
+            auto host_address = ntohl(address.s_addr);
+            return (host_address == INADDR_BROADCAST || (host_address & 0xff) == 0xff);
+        }
+
+        static bool accepts(const route& r, const struct sockaddr_in& destination) {
+            if (r.port != ntohs(destination.sin_port)) return false;
+            bool any_address = (r.address.s_addr == htonl(INADDR_ANY));
+            bool same_address = (r.address.s_addr == destination.sin_addr.s_addr);
+            if (is_multicast(destination.sin_addr))
+                return (r.groups.count(destination.sin_addr.s_addr) > 0 && (any_address || same_address));
+            return (any_address || same_address || is_broadcast(destination.sin_addr));
+        }
+
+    public:
+        std::unique_ptr<datagram_socket> open_datagram() override;
+
+        // sends datagram to every socket that accepts destination, as a copy for each of them
+        void deliver(const struct sockaddr_in& from, const struct sockaddr_in& destination,
+                     const byte_t *data, size_t len) {
+            auto table = std::atomic_load(&routes);
+            for (const auto& r : *table) {
+                if (!accepts(r, destination)) continue;
+                memory_datagram datagram{msg_t(data, data + len), from};
+                if (!r.endpoint->queue.try_push(datagram))
+                    r.endpoint->dropped.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        // registers endpoint under given address, port 0 is replaced with an ephemeral port
+        in_port_t bind(std::shared_ptr<memory_endpoint> endpoint, struct in_addr address, in_port_t port,
+                       const std::set<in_addr_t>& groups, bool reuse_address) {
+            std::scoped_lock lock{mut};
+            auto table = std::make_shared<route_table>(*routes);
+            if (port == 0) {
+                // ports of bound sockets are not reused until wrap around
+                do {
+                    port = next_ephemeral_port++;
+                    if (next_ephemeral_port == 0) next_ephemeral_port = memory_ephemeral_port_min;
+                } while (std::any_of(table->begin(), table->end(), [port](const route& r) {
+                    return r.port == port;
+                }));
+            }
+            for (const auto& r : *table) {
+                bool same_address = (r.address.s_addr == address.s_addr);
+                if (r.port == port && same_address && !(r.reuse_address && reuse_address))
+                    throw exceptions::socket_exception("Address already in use");
+            }
+            table->push_back(route{std::move(endpoint), address, port, groups, reuse_address});
+            std::atomic_store(&routes, std::shared_ptr<const route_table>(std::move(table)));
+            return port;
+        }
+
+        void add_group(const std::shared_ptr<memory_endpoint>& endpoint, struct in_addr group) {
+            std::scoped_lock lock{mut};
+            auto table = std::make_shared<route_table>(*routes);
+            for (auto& r : *table)
+                if (r.endpoint == endpoint) r.groups.insert(group.s_addr);
+            std::atomic_store(&routes, std::shared_ptr<const route_table>(std::move(table)));
+        }
+
+        void unbind(const std::shared_ptr<memory_endpoint>& endpoint) {
+            std::scoped_lock lock{mut};
+            auto table = std::make_shared<route_table>(*routes);
+            table->erase(
+                std::remove_if(table->begin(), table->end(), [&endpoint](const route& r) {
+                    return r.endpoint == endpoint;
+                }),
+                table->end());
+            std::atomic_store(&routes, std::shared_ptr<const route_table>(std::move(table)));
+        }
+    };
+
+    class memory_socket : public datagram_socket {
+    private:
+        std::shared_ptr<memory_transport> network;
+        std::shared_ptr<memory_endpoint> endpoint{std::make_shared<memory_endpoint>()};
+        std::optional<struct sockaddr_in> local_address{std::nullopt};
+        std::optional<struct sockaddr_in> remote_address{std::nullopt};
+        std::set<in_addr_t> groups{};
+        bool reuse_address{false};
+        int timeout_in_ms{0};
+
+        const struct sockaddr_in& bound_address() {
+            if (!local_address.has_value()) {
+                // like the kernel, unbound socket gets an ephemeral port on first send
+                struct sockaddr_in any{};
+                any.sin_family = AF_INET;
+                any.sin_addr.s_addr = htonl(INADDR_ANY);
+                bind(any);
+            }
+            return local_address.value();
+        }
+
+    public:
+        memory_socket(const memory_socket& other) = delete;
+        memory_socket(memory_socket&& other) = delete;
+
+        explicit memory_socket(std::shared_ptr<memory_transport> network) : network{std::move(network)} {}
+
+        void enable_reuse_address() override {
+            reuse_address = true;
+        }
+
+        void enable_broadcast() override {}
+
+        void set_multicast_ttl(int) override {}
+
+        void set_multicast_interface(struct in_addr) override {}
+
+        void join_group(struct in_addr group) override {
+            groups.insert(group.s_addr);
+            if (local_address.has_value()) network->add_group(endpoint, group);
+        }
+
+        void set_receive_timeout(int timeout_in_ms) override {
+            this->timeout_in_ms = timeout_in_ms;
+        }
+
+        void bind(const struct sockaddr_in& address) override {
+            if (local_address.has_value())
+                throw exceptions::socket_exception("Socket is already bound");
+            auto port = network->bind(endpoint, address.sin_addr, ntohs(address.sin_port), groups, reuse_address);
+            struct sockaddr_in bound{};
+            bound.sin_family = AF_INET;
+            bound.sin_port = htons(port);
+            bound.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            local_address = bound;
+        }
+
+        void connect(const struct sockaddr_in& address) override {
+            remote_address = address;
+        }
+
+        void send(const byte_t *data, size_t len) override {
+            if (!remote_address.has_value())
+                throw exceptions::socket_exception("Destination address required");
+            send_to(remote_address.value(), data, len);
+        }
+
+        void send_to(const struct sockaddr_in& destination, const byte_t *data, size_t len) override {
+            network->deliver(bound_address(), destination, data, len);
+        }
+
+        std::optional<size_t> receive(byte_t *buf, size_t len, struct sockaddr_in *from) override {
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_in_ms);
+            int spins = 0;
+            while (true) {
+                auto datagram = endpoint->queue.try_pop();
+                if (datagram.has_value()) {
+                    // like udp, datagram longer than the buffer is truncated
+                    auto rcv_len = std::min(len, datagram.value().data.size());
+                    memcpy(buf, datagram.value().data.data(), rcv_len);
+                    if (from != nullptr) *from = datagram.value().from;
+                    return rcv_len;
+                }
+                if (spins < memory_receive_spins) {
+                    spins++;
+                    std::this_thread::yield();
+                    continue;
+                }
+                if (timeout_in_ms > 0 && std::chrono::steady_clock::now() >= deadline) return std::nullopt;
+                std::this_thread::sleep_for(memory_receive_sleep);
+            }
+        }
+
+        // datagrams that were lost because receiver did not read them in time
+        uint64_t get_dropped() const {
+            return endpoint->dropped.load(std::memory_order_relaxed);
+        }
+
+        ~memory_socket() override {
+            if (local_address.has_value()) network->unbind(endpoint);
+        }
+    };
+
+    inline std::unique_ptr<datagram_socket> memory_transport::open_datagram() {
+        return std::make_unique<memory_socket>(shared_from_this());
+    }
+}
+
+#endif //SIKRADIO_COMMON_MEMORY_TRANSPORT_HPP
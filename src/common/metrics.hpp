@@ -0,0 +1,150 @@
+#ifndef SIKRADIO_COMMON_METRICS_HPP
+#define SIKRADIO_COMMON_METRICS_HPP
+
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <sstream>
+#include <cstdint>
+#include <utility>
+#include <functional>
+
+#include "histogram.hpp"
+
+namespace sikradio::common::metrics {
+    namespace {
+        const size_t cache_line_size = 64;
+        // number of per-thread slots in each counter, threads share slots when there are more of them
+        const size_t counter_slots = 16;
+        // percentiles of every histogram reported by the registry, with their name suffixes
+        const std::pair<const char*, double> reported_percentiles[] = {
+            {"_p50", 0.5}, {"_p90", 0.9}, {"_p99", 0.99}, {"_p999", 0.999}
+        };
+
+        size_t thread_slot() {
+            static std::atomic<size_t> next_slot{0};
+            thread_local size_t slot = next_slot.fetch_add(1, std::memory_order_relaxed) % counter_slots;
+            return slot;
+        }
+    }
+
+    // monotonic counter, each thread increments its own cache line and reads aggregate all of them
+    class counter {
+    private:
+        struct alignas(cache_line_size) slot {
+            std::atomic<uint64_t> value{0};
+        };
+        slot slots[counter_slots];
+
+    public:
+        counter() = default;
+        counter(const counter& other) = delete;
+        counter(counter&& other) = delete;
+
+        void add(uint64_t n = 1) {
+            slots[thread_slot()].value.fetch_add(n, std::memory_order_relaxed);
+        }
+
+        uint64_t get() const {
+            uint64_t sum = 0;
+            for (const auto& s : slots)
+                sum += s.value.load(std::memory_order_relaxed);
+            return sum;
+        }
+    };
+
+    // value that is set (rather than accumulated) by a single writer
+    class gauge {
+    private:
+        alignas(cache_line_size) std::atomic<int64_t> value{0};
+
+    public:
+        gauge() = default;
+        gauge(const gauge& other) = delete;
+        gauge(gauge&& other) = delete;
+
+        void set(int64_t v) {
+            value.store(v, std::memory_order_relaxed);
+        }
+
+        void add(int64_t n) {
+            value.fetch_add(n, std::memory_order_relaxed);
+        }
+
+        int64_t get() const {
+            return value.load(std::memory_order_relaxed);
+        }
+    };
+
+    // named metrics, registration and reads are locked, updates of returned metrics are not
+    class registry {
+    private:
+        std::mutex mut{};
+        std::map<std::string, std::unique_ptr<counter>> counters{};
+        std::map<std::string, std::unique_ptr<gauge>> gauges{};
+        std::map<std::string, std::unique_ptr<histogram>> histograms{};
+        // values computed only when metrics are read, e.g. queue sizes
+        std::map<std::string, std::function<double()>> probes{};
+
+    public:
+        registry() = default;
+        registry(const registry& other) = delete;
+        registry(registry&& other) = delete;
+
+        counter& get_counter(const std::string& name) {
+            std::scoped_lock lock{mut};
+            auto& ret = counters[name];
+            if (!ret) ret = std::make_unique<counter>();
+            return *ret;
+        }
+
+        gauge& get_gauge(const std::string& name) {
+            std::scoped_lock lock{mut};
+            auto& ret = gauges[name];
+            if (!ret) ret = std::make_unique<gauge>();
+            return *ret;
+        }
+
+        histogram& get_histogram(const std::string& name) {
+            std::scoped_lock lock{mut};
+            auto& ret = histograms[name];
+            if (!ret) ret = std::make_unique<histogram>();
+            return *ret;
+        }
+
+        void register_probe(const std::string& name, std::function<double()> probe) {
+            std::scoped_lock lock{mut};
+            probes[name] = std::move(probe);
+        }
+
+        // one `name value` line per metric, sorted by name,
+        // histograms are reported as their count, maximum and percentiles
+        std::string render() {
+            std::scoped_lock lock{mut};
+            std::map<std::string, std::string> lines;
+            for (const auto& [name, c] : counters)
+                lines[name] = std::to_string(c->get());
+            for (const auto& [name, g] : gauges)
+                lines[name] = std::to_string(g->get());
+            for (const auto& [name, h] : histograms) {
+                lines[name + "_count"] = std::to_string(h->get_count());
+                lines[name + "_max"] = std::to_string(h->get_max());
+                for (const auto& [suffix, quantile] : reported_percentiles)
+                    lines[name + suffix] = std::to_string(h->get_percentile(quantile));
+            }
+            for (const auto& [name, probe] : probes) {
+                std::ostringstream value;
+                value << probe();
+                lines[name] = value.str();
+            }
+            std::ostringstream ret;
+            for (const auto& [name, value] : lines)
+                ret << name << " " << value << "\n";
+            return ret.str();
+        }
+    };
+}
+
+#endif //SIKRADIO_COMMON_METRICS_HPP
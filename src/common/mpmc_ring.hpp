@@ -0,0 +1,95 @@
+#ifndef SIKRADIO_COMMON_MPMC_RING_HPP
+#define SIKRADIO_COMMON_MPMC_RING_HPP
+
+#include <atomic>
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <utility>
+#include <optional>
+
+namespace sikradio::common {
+    // bounded lock-free multi-producer multi-consumer queue (Dmitry Vyukov's design),
+    // each cell has a sequence number telling producers and consumers whose turn it is
+    template<typename T>
+    class mpmc_ring {
+    private:
+        struct cell {
+            std::atomic<size_t> sequence;
+            T value;
+        };
+
+        static const size_t cache_line_size = 64;
+
+        std::unique_ptr<cell[]> cells;
+        size_t mask;
+        alignas(cache_line_size) std::atomic<size_t> enqueue_pos{0};
+        alignas(cache_line_size) std::atomic<size_t> dequeue_pos{0};
+
+        static size_t round_up_to_power_of_two(size_t n) {
+            size_t ret = 2;
+            while (ret < n) ret <<= 1;
+            return ret;
+        }
+
+    public:
+        mpmc_ring() = delete;
+        mpmc_ring(const mpmc_ring& other) = delete;
+        mpmc_ring(mpmc_ring&& other) = delete;
+
+        // capacity is rounded up to a power of two
+        explicit mpmc_ring(size_t capacity) :
+                cells{new cell[round_up_to_power_of_two(capacity)]},
+                mask{round_up_to_power_of_two(capacity) - 1} {
+            for (size_t i = 0; i <= mask; i++)
+                cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+
+        // returns false if the queue is full, value is not moved from in that case
+        bool try_push(T& value) {
+            auto pos = enqueue_pos.load(std::memory_order_relaxed);
+            while (true) {
+                cell& c = cells[pos & mask];
+                auto seq = c.sequence.load(std::memory_order_acquire);
+                auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+                if (diff == 0) {
+                    if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        c.value = std::move(value);
+                        c.sequence.store(pos + 1, std::memory_order_release);
+                        return true;
+                    }
+                } else if (diff < 0) {
+                    return false;
+                } else {
+                    pos = enqueue_pos.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        std::optional<T> try_pop() {
+            auto pos = dequeue_pos.load(std::memory_order_relaxed);
+            while (true) {
+                cell& c = cells[pos & mask];
+                auto seq = c.sequence.load(std::memory_order_acquire);
+                auto diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+                if (diff == 0) {
+                    if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        std::optional<T> ret{std::move(c.value)};
+                        c.sequence.store(pos + mask + 1, std::memory_order_release);
+                        return ret;
+                    }
+                } else if (diff < 0) {
+                    return std::nullopt;
+                } else {
+                    pos = dequeue_pos.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        size_t capacity() const {
+            return mask + 1;
+        }
+    };
+}
+
+#endif //SIKRADIO_COMMON_MPMC_RING_HPP
@@ -0,0 +1,387 @@
+#ifndef SIKRADIO_COMMON_PCM_CODEC_HPP
+#define SIKRADIO_COMMON_PCM_CODEC_HPP
+
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <algorithm>
+#include <endian.h>
+
+#include "exceptions.hpp"
+#include "types.hpp"
+#include "data_msg.hpp"
+
+#if defined(__SSE2__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace sikradio::common {
+    namespace {
+        // set in first_byte_num of data messages that carry compressed audio
+        const msg_id_t compressed_id_flag = 1ull << 63;
+        const uint8_t pcm_codec_version = 1;
+        const size_t pcm_max_channels = 8;
+        const unsigned pcm_max_order = 3;
+        // quotients from this one on are written as escape followed by the raw value
+        const unsigned rice_escape = 32;
+        // zigzag residual of order 3 predictor of 16-bit samples fits in 20 bits
+        const unsigned rice_raw_bits = 20;
+        // version, channels, raw length (2 bytes)
+        const size_t pcm_header_size = 4;
+    }
+
+    // vectorized kernels of the codec, with scalar loops for the remainders
+    namespace pcm_kernels {
+        // dst[i] = src[i] - src[i - 1], dst[0] = src[0]
+        inline void difference(const int32_t *src, int32_t *dst, size_t n) {
+            if (n == 0) return;
+            dst[0] = src[0];
+            size_t i = 1;
+#if defined(__AVX2__)
+            for (; i + 8 <= n; i += 8) {
+                __m256i cur = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+                __m256i prev = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i - 1));
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_sub_epi32(cur, prev));
+            }
+#endif
+#if defined(__SSE2__)
+            for (; i + 4 <= n; i += 4) {
+                __m128i cur = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+                __m128i prev = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i - 1));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_sub_epi32(cur, prev));
+            }
+#endif
+            for (; i < n; i++) dst[i] = src[i] - src[i - 1];
+        }
+
+        inline uint32_t zigzag(int32_t value) {
+            return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+        }
+
+        inline int32_t unzigzag(uint32_t value) {
+            return static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1);
+        }
+
+        // sum of zigzag encoded values, which approximates cost of coding them
+        inline uint64_t zigzag_sum(const int32_t *src, size_t n) {
+            uint64_t ret = 0;
+            size_t i = 0;
+            // 32-bit lanes are flushed before they could overflow (values have at most 20 bits)
+            const size_t flush_every = 1024;
+#if defined(__AVX2__)
+            while (i + 8 <= n) {
+                __m256i acc = _mm256_setzero_si256();
+                for (size_t j = 0; j < flush_every && i + 8 <= n; j++, i += 8) {
+                    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+                    acc = _mm256_add_epi32(acc, _mm256_xor_si256(_mm256_slli_epi32(v, 1), _mm256_srai_epi32(v, 31)));
+                }
+                uint32_t lanes[8];
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(lanes), acc);
+                for (auto lane : lanes) ret += lane;
+            }
+#endif
+#if defined(__SSE2__)
+            while (i + 4 <= n) {
+                __m128i acc = _mm_setzero_si128();
+                for (size_t j = 0; j < flush_every && i + 4 <= n; j++, i += 4) {
+                    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+                    acc = _mm_add_epi32(acc, _mm_xor_si128(_mm_slli_epi32(v, 1), _mm_srai_epi32(v, 31)));
+                }
+                uint32_t lanes[4];
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes), acc);
+                for (auto lane : lanes) ret += lane;
+            }
+#endif
+            for (; i < n; i++) ret += zigzag(src[i]);
+            return ret;
+        }
+
+        // inclusive prefix sum in place, undoes difference
+        inline void prefix_sum(int32_t *data, size_t n) {
+            size_t i = 0;
+            int32_t carry = 0;
+#if defined(__SSE2__)
+            __m128i carry_v = _mm_setzero_si128();
+            for (; i + 4 <= n; i += 4) {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+                v = _mm_add_epi32(v, _mm_slli_si128(v, 4));
+                v = _mm_add_epi32(v, _mm_slli_si128(v, 8));
+                v = _mm_add_epi32(v, carry_v);
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(data + i), v);
+                carry_v = _mm_shuffle_epi32(v, _MM_SHUFFLE(3, 3, 3, 3));
+            }
+            if (i > 0) carry = data[i - 1];
+#endif
+            for (; i < n; i++) {
+                carry += data[i];
+                data[i] = carry;
+            }
+        }
+    }
+
+    // bits are written most significant first into a buffer of fixed capacity,
+    // bits that do not fit are counted, but dropped
+    class bit_writer {
+    private:
+        byte_t *out;
+        size_t capacity;
+        size_t position{0};  // in bytes
+        uint64_t acc{0};
+        unsigned bits{0};
+
+    public:
+        bit_writer(byte_t *out, size_t capacity) : out{out}, capacity{capacity} {}
+
+        // n <= 56
+        void put(uint64_t value, unsigned n) {
+            if (n == 0) return;
+            acc = (acc << n) | (value & (UINT64_MAX >> (64 - n)));
+            bits += n;
+            while (bits >= 8) {
+                bits -= 8;
+                if (position < capacity) out[position] = static_cast<byte_t>(acc >> bits);
+                position++;
+            }
+        }
+
+        void put_ones(unsigned n) {
+            for (; n > 32; n -= 32) put(0xFFFFFFFFu, 32);
+            put(0xFFFFFFFFu, n);
+        }
+
+        void flush() {
+            if (bits > 0) put(0, 8 - bits);
+        }
+
+        // bytes written so far, including the ones that did not fit
+        size_t size() const {
+            return position;
+        }
+    };
+
+    // bits are read most significant first from a 64-bit buffer, which is refilled with whole bytes,
+    // so consecutive reads do not wait for a load from memory
+    class bit_reader {
+    private:
+        const uint8_t *data;
+        size_t len;
+        uint64_t buffer{0};  // next bits, most significant first
+        unsigned available{0};  // valid bits in the buffer
+        size_t next_byte{0};  // first byte not loaded into the buffer
+
+        [[noreturn]] __attribute__((noinline, cold)) static void truncated() {
+            throw data_msg_exception("Compressed audio is truncated");
+        }
+
+    public:
+        bit_reader(const byte_t *data, size_t len) : data{reinterpret_cast<const uint8_t *>(data)}, len{len} {}
+
+        // next 57 bits at least, padded with zeros after the end of data
+        uint64_t peek() {
+            if (available > 56) return buffer;
+            if (next_byte + sizeof(uint64_t) <= len) {
+                uint64_t word;
+                memcpy(&word, data + next_byte, sizeof(word));
+                buffer |= be64toh(word) >> available;
+                auto bytes = (63 - available) / 8;
+                next_byte += bytes;
+                available += 8*bytes;
+            } else {
+                for (; available <= 56; available += 8, next_byte++)
+                    buffer |= static_cast<uint64_t>((next_byte < len) ? data[next_byte] : 0) << (56 - available);
+            }
+            return buffer;
+        }
+
+        // bits have to be peeked before
+        void skip(unsigned n) {
+            buffer <<= n;
+            available -= n;
+        }
+
+        uint32_t get(unsigned n) {
+            if (n == 0) return 0;
+            auto ret = static_cast<uint32_t>(peek() >> (64 - n));
+            skip(n);
+            return ret;
+        }
+
+        // throws if more bits were read than there are
+        void check() const {
+            if (8*next_byte - available > 8*len) truncated();
+        }
+
+        // position of the first byte after read bits
+        size_t byte_position() const {
+            return (8*next_byte - available + 7) / 8;
+        }
+    };
+
+    // lossless codec of interleaved 16-bit little endian pcm: each channel is predicted with
+    // a fixed polynomial predictor of order 0-3 (chosen per packet, like in FLAC) and residuals
+    // are Rice coded, every packet is coded independently, buffers are reused between packets
+    class pcm_codec {
+    private:
+        size_t channels;
+        std::vector<int32_t> samples{};
+        std::vector<int32_t> residuals[pcm_max_order + 1]{};
+
+        static int32_t sample_at(const byte_t *data, size_t index) {
+            auto low = static_cast<uint8_t>(data[2*index]);
+            auto high = static_cast<uint8_t>(data[2*index + 1]);
+            return static_cast<int16_t>(static_cast<uint16_t>(low | (high << 8)));
+        }
+
+        static unsigned rice_parameter(uint64_t sum, size_t count) {
+            unsigned k = 0;
+            while (k < rice_raw_bits && (static_cast<uint64_t>(count) << (k + 1)) <= sum) k++;
+            return k;
+        }
+
+        static void put_residual(bit_writer& writer, uint32_t value, unsigned k) {
+            auto quotient = value >> k;
+            if (quotient >= rice_escape) {
+                writer.put_ones(rice_escape);
+                writer.put(value, rice_raw_bits);
+                return;
+            }
+            // unary quotient, stop bit and remainder in one write
+            auto ones = (1ull << quotient) - 1;
+            writer.put((ones << (k + 1)) | (value & ((1u << k) - 1)), quotient + 1 + k);
+        }
+
+        static uint32_t get_residual(bit_reader& reader, unsigned k) {
+            auto window = reader.peek();
+            unsigned quotient = (~window == 0) ? 64 : __builtin_clzll(~window);
+            // window holds all bits of the code, as quotient + 1 + k <= 53 and escape is 52 bits
+            if (quotient >= rice_escape) {
+                reader.skip(rice_escape + rice_raw_bits);
+                return static_cast<uint32_t>((window << rice_escape) >> (64 - rice_raw_bits));
+            }
+            auto remainder = (k == 0) ? 0 : static_cast<uint32_t>((window << (quotient + 1)) >> (64 - k));
+            reader.skip(quotient + 1 + k);
+            return (quotient << k) | remainder;
+        }
+
+    public:
+        explicit pcm_codec(size_t channels = 2) : channels{std::clamp<size_t>(channels, 1, pcm_max_channels)} {}
+
+        // returns nothing if compressed audio would not be smaller than raw
+        std::optional<msg_t> encode(const byte_t *data, size_t len) {
+            if (len > UINT16_MAX) return std::nullopt;
+            size_t frames = len / (2*channels);
+            size_t stream_at = pcm_header_size + channels;
+            if (len <= stream_at) return std::nullopt;
+            // compressed audio has to be smaller than raw, so it never needs more space
+            msg_t out(len);
+            out[0] = static_cast<byte_t>(pcm_codec_version);
+            out[1] = static_cast<byte_t>(channels);
+            out[2] = static_cast<byte_t>(len >> 8);
+            out[3] = static_cast<byte_t>(len & 0xFF);
+            samples.resize(frames);
+            for (auto& r : residuals) r.resize(frames);
+
+            bit_writer writer{out.data() + stream_at, len - stream_at};
+            for (size_t c = 0; c < channels; c++) {
+                for (size_t i = 0; i < frames; i++) samples[i] = sample_at(data, i*channels + c);
+                // residuals of order k are k-th differences, valid from index k
+                std::copy(samples.begin(), samples.end(), residuals[0].begin());
+                for (unsigned k = 1; k <= pcm_max_order; k++)
+                    pcm_kernels::difference(residuals[k - 1].data(), residuals[k].data(), frames);
+                unsigned order = 0;
+                uint64_t best = UINT64_MAX;
+                for (unsigned k = 0; k <= pcm_max_order && k <= frames; k++) {
+                    auto cost = pcm_kernels::zigzag_sum(residuals[k].data() + k, frames - k);
+                    if (cost < best) {
+                        best = cost;
+                        order = k;
+                    }
+                }
+                auto count = frames - std::min<size_t>(order, frames);
+                auto k = rice_parameter(best, std::max<size_t>(count, 1));
+                out[pcm_header_size + c] = static_cast<byte_t>((order << 5) | k);
+                // warm-up samples
+                for (size_t i = 0; i < order && i < frames; i++)
+                    writer.put(static_cast<uint16_t>(samples[i]), 16);
+                for (size_t i = order; i < frames; i++)
+                    put_residual(writer, pcm_kernels::zigzag(residuals[order][i]), k);
+                if (writer.size() >= len - stream_at) return std::nullopt;
+            }
+            writer.flush();
+            // bytes of incomplete frame are copied as they are
+            size_t tail = len - frames*2*channels;
+            size_t size = stream_at + writer.size() + tail;
+            if (size >= len) return std::nullopt;
+            std::copy(data + frames*2*channels, data + len, out.begin() + stream_at + writer.size());
+            out.resize(size);
+            return out;
+        }
+
+        // throws data_msg_exception if data is not valid compressed audio
+        msg_t decode(const byte_t *data, size_t len) {
+            if (len < pcm_header_size || static_cast<uint8_t>(data[0]) != pcm_codec_version)
+                throw data_msg_exception("Unsupported compressed audio");
+            size_t stream_channels = static_cast<uint8_t>(data[1]);
+            size_t raw_len = (static_cast<uint8_t>(data[2]) << 8) | static_cast<uint8_t>(data[3]);
+            if (stream_channels == 0 || stream_channels > pcm_max_channels || len < pcm_header_size + stream_channels)
+                throw data_msg_exception("Unsupported compressed audio");
+            size_t frames = raw_len / (2*stream_channels);
+            const byte_t *params = data + pcm_header_size;
+            bit_reader reader{params + stream_channels, len - pcm_header_size - stream_channels};
+            msg_t out(raw_len);
+            samples.resize(frames);
+
+            for (size_t c = 0; c < stream_channels; c++) {
+                auto param = static_cast<uint8_t>(params[c]);
+                unsigned order = param >> 5;
+                unsigned k = param & 0x1F;
+                if (order > pcm_max_order || k > rice_raw_bits || order > frames)
+                    throw data_msg_exception("Invalid compressed audio parameters");
+                int32_t warm_up[pcm_max_order];
+                for (unsigned i = 0; i < order; i++)
+                    warm_up[i] = static_cast<int16_t>(static_cast<uint16_t>(reader.get(16)));
+                for (size_t i = order; i < frames; i++)
+                    samples[i] = pcm_kernels::unzigzag(get_residual(reader, k));
+                reader.check();
+                // j-th difference at index j is computed from warm-up samples, then differences
+                // are integrated from the highest one down to samples
+                int32_t seeds[pcm_max_order];
+                std::copy(warm_up, warm_up + order, seeds);
+                for (unsigned level = 1; level < order; level++)
+                    for (unsigned i = order - 1; i >= level; i--) seeds[i] -= seeds[i - 1];
+                for (unsigned j = order; j-- > 0;) {
+                    samples[j] = seeds[j];
+                    pcm_kernels::prefix_sum(samples.data() + j, frames - j);
+                }
+                for (size_t i = 0; i < frames; i++) {
+                    auto value = static_cast<uint16_t>(samples[i]);
+                    out[2*(i*stream_channels + c)] = static_cast<byte_t>(value & 0xFF);
+                    out[2*(i*stream_channels + c) + 1] = static_cast<byte_t>(value >> 8);
+                }
+            }
+            size_t tail = raw_len - frames*2*stream_channels;
+            size_t tail_at = pcm_header_size + stream_channels + reader.byte_position();
+            if (tail_at + tail != len) throw data_msg_exception("Invalid compressed audio length");
+            std::copy(data + tail_at, data + len, out.begin() + frames*2*stream_channels);
+            return out;
+        }
+
+        // message as sent, with compressed audio if it is smaller than raw
+        msg_t sendable(const data_msg& msg) {
+            auto compressed = encode(msg.get_data().data(), msg.get_data().size());
+            if (!compressed.has_value()) return msg.sendable();
+            data_msg flagged{msg.get_id() | compressed_id_flag, msg.get_session_id(), std::move(compressed.value())};
+            return flagged.sendable();
+        }
+
+        // message with raw audio, messages that were sent raw are returned as they are
+        data_msg decode(data_msg msg) {
+            if (!(msg.get_id() & compressed_id_flag)) return msg;
+            const auto& data = msg.get_data();
+            return data_msg(msg.get_id() & ~compressed_id_flag, msg.get_session_id(), decode(data.data(), data.size()));
+        }
+    };
+}
+
+#endif //SIKRADIO_COMMON_PCM_CODEC_HPP
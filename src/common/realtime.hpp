@@ -0,0 +1,138 @@
+#ifndef SIKRADIO_COMMON_REALTIME_HPP
+#define SIKRADIO_COMMON_REALTIME_HPP
+
+#include <map>
+#include <set>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include <iostream>
+#include <optional>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#include "exceptions.hpp"
+
+namespace sikradio::common {
+    namespace {
+        // stack touched by every role thread, so that its hot loop does not page fault on deeper calls
+        const size_t realtime_stack_prefault_size = 64*1024;
+    }
+
+    // low latency settings of the threads that handle audio packets (roles), by default nothing is changed
+    struct realtime_config {
+        std::map<std::string, int> cores{};  // role name -> cpu that the role thread is pinned to
+        std::optional<int> fifo_priority{std::nullopt};  // SCHED_FIFO priority of all role threads
+        bool lock_memory{false};
+        int busy_poll_in_us{0};  // SO_BUSY_POLL of receiver data sockets
+
+        bool enabled() const {
+            return (!cores.empty() || fifo_priority.has_value() || lock_memory || busy_poll_in_us > 0);
+        }
+    };
+
+    // parses comma separated list of `role=cpu` pairs and options, e.g.
+    // "data_receiver=2,data_streamer=3,fifo=80,mlock,busy_poll=50",
+    // options: fifo (1-99), mlock, busy_poll (microseconds), roles have to be one of the given ones
+    inline realtime_config parse_realtime(const std::string& spec, const std::set<std::string>& roles) {
+        realtime_config ret{};
+        std::istringstream items{spec};
+        std::string item;
+        auto fail = [&spec]() {
+            throw exceptions::realtime_exception("Invalid realtime mode: " + spec);
+        };
+        auto number = [&fail](const std::string& text, int min, int max) {
+            size_t parsed = 0;
+            int value = 0;
+            try {
+                value = std::stoi(text, &parsed);
+            } catch (std::exception &e) {
+                fail();
+            }
+            if (parsed != text.size() || value < min || value > max) fail();
+            return value;
+        };
+        while (std::getline(items, item, ',')) {
+            if (item.empty()) continue;
+            if (item == "mlock") {
+                ret.lock_memory = true;
+                continue;
+            }
+            auto eq = item.find('=');
+            if (eq == std::string::npos) fail();
+            auto key = item.substr(0, eq);
+            auto value = item.substr(eq + 1);
+            if (key == "fifo") {
+                ret.fifo_priority = number(value, 1, 99);
+            } else if (key == "busy_poll") {
+                ret.busy_poll_in_us = number(value, 0, INT32_MAX);
+            } else if (roles.count(key) > 0) {
+                ret.cores[key] = number(value, 0, CPU_SETSIZE - 1);
+            } else {
+                fail();
+            }
+        }
+        return ret;
+    }
+
+    inline void pin_current_thread(int cpu) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(cpu, &cpus);
+        int err = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        if (err != 0)
+            throw exceptions::realtime_exception("Cannot pin thread to cpu " + std::to_string(cpu) + ": " + strerror(err));
+    }
+
+    inline void set_current_thread_fifo(int priority) {
+        struct sched_param param{};
+        param.sched_priority = priority;
+        int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (err != 0)
+            throw exceptions::realtime_exception("Cannot set SCHED_FIFO priority: " + std::string(strerror(err)));
+    }
+
+    // locks current and future mappings in memory, mappings are populated when they are locked,
+    // so buffers allocated at startup and thread stacks are prefaulted
+    inline void lock_all_memory() {
+        if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+            throw exceptions::realtime_exception("Cannot lock memory: " + std::string(strerror(errno)));
+    }
+
+    inline void prefault_stack() {
+        volatile unsigned char stack[realtime_stack_prefault_size];
+        for (size_t i = 0; i < sizeof(stack); i += 4096) stack[i] = 0;
+    }
+
+    // realtime settings are a best effort, program keeps running (without latency guarantees)
+    // if it lacks privileges, so failures are only reported
+    inline void enter_role(const realtime_config& cfg, const std::string& role) {
+        if (!cfg.enabled()) return;
+        auto core = cfg.cores.find(role);
+        try {
+            if (core != cfg.cores.end()) pin_current_thread(core->second);
+        } catch (exceptions::realtime_exception &e) {
+            std::cerr << role << ": " << e.what() << std::endl;
+        }
+        try {
+            if (cfg.fifo_priority.has_value()) set_current_thread_fifo(cfg.fifo_priority.value());
+        } catch (exceptions::realtime_exception &e) {
+            std::cerr << role << ": " << e.what() << std::endl;
+        }
+        prefault_stack();
+    }
+
+    // has to be called before role threads are started
+    inline void lock_memory(const realtime_config& cfg) {
+        if (!cfg.lock_memory) return;
+        try {
+            lock_all_memory();
+        } catch (exceptions::realtime_exception &e) {
+            std::cerr << e.what() << std::endl;
+        }
+    }
+}
+
+#endif //SIKRADIO_COMMON_REALTIME_HPP
@@ -0,0 +1,107 @@
+#ifndef SIKRADIO_COMMON_STATS_SERVER_HPP
+#define SIKRADIO_COMMON_STATS_SERVER_HPP
+
+#include <string>
+#include <cstring>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "exceptions.hpp"
+#include "metrics.hpp"
+
+namespace sikradio::common {
+    namespace {
+        const int stats_listen_backlog = 5;
+        // slow stats clients must not block the stats thread for long
+        const int stats_send_timeout_in_ms = 500;
+    }
+
+    // local tcp endpoint, every connection receives current metrics as text and is closed
+    class stats_server {
+    private:
+        sikradio::common::metrics::registry& registry;
+        int sock{-1};
+
+        void close_and_throw() {
+            close(sock);
+            sock = -1;
+            throw exceptions::socket_exception(strerror(errno));
+        }
+
+        static void send_all(int client, const std::string& data) {
+            size_t sent = 0;
+            while (sent < data.size()) {
+                ssize_t len = send(client, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+                if (len <= 0) return;  // client went away, nothing to report
+                sent += len;
+            }
+        }
+
+    public:
+        stats_server() = delete;
+        stats_server(const stats_server& other) = delete;
+        stats_server(stats_server&& other) = delete;
+
+        stats_server(in_port_t port, sikradio::common::metrics::registry& registry) :
+                registry{registry} {
+            sock = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (sock < 0) throw exceptions::socket_exception(strerror(errno));
+            int reuse = 1;
+            int err = setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+            if (err < 0) close_and_throw();
+            // stats are only available locally
+            struct sockaddr_in local_addr{};
+            local_addr.sin_family = AF_INET;
+            local_addr.sin_port = htons(port);
+            local_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            err = bind(sock, reinterpret_cast<struct sockaddr*>(&local_addr), sizeof(local_addr));
+            if (err < 0) close_and_throw();
+            err = listen(sock, stats_listen_backlog);
+            if (err < 0) close_and_throw();
+        }
+
+        // returns true if a client is waiting, so that serve_one will not block
+        bool wait_for_client(int timeout_in_ms) {
+            struct pollfd pfd{};
+            pfd.fd = sock;
+            pfd.events = POLLIN;
+            int ready = poll(&pfd, 1, timeout_in_ms);
+            return (ready > 0 && (pfd.revents & POLLIN));
+        }
+
+        // blocks until a client connects, then sends it the metrics
+        void serve_one() {
+            int client = accept4(sock, NULL, 0, SOCK_CLOEXEC);
+            if (client < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) return;
+                throw exceptions::socket_exception(strerror(errno));
+            }
+            struct timeval tv{
+                .tv_sec = 0,
+                .tv_usec = 1000*stats_send_timeout_in_ms
+            };
+            (void)setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+            send_all(client, registry.render());
+            close(client);
+        }
+
+        void run() {
+            while (true) {
+                try {
+                    serve_one();
+                } catch (exceptions::socket_exception &e) {
+                    // keep serving other clients
+                }
+            }
+        }
+
+        ~stats_server() {
+            if (sock >= 0) close(sock);
+        }
+    };
+}
+
+#endif //SIKRADIO_COMMON_STATS_SERVER_HPP
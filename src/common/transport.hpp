@@ -0,0 +1,208 @@
+#ifndef SIKRADIO_COMMON_TRANSPORT_HPP
+#define SIKRADIO_COMMON_TRANSPORT_HPP
+
+#include <memory>
+#include <cstring>
+#include <optional>
+#include <vector>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "exceptions.hpp"
+#include "types.hpp"
+
+#ifndef TTL_VALUE
+#define TTL_VALUE 64
+#endif
+
+namespace sikradio::common {
+    // datagram socket of a transport, methods throw socket_exception on failure
+    class datagram_socket {
+    public:
+        virtual ~datagram_socket() = default;
+
+        virtual void enable_reuse_address() = 0;
+        virtual void enable_broadcast() = 0;
+        virtual void set_multicast_ttl(int ttl) = 0;
+        virtual void set_multicast_interface(struct in_addr interface_address) = 0;
+        virtual void join_group(struct in_addr group) = 0;
+        // receive returns nothing after timeout, 0 waits indefinitely
+        virtual void set_receive_timeout(int timeout_in_ms) = 0;
+        virtual void bind(const struct sockaddr_in& local_address) = 0;
+        virtual void connect(const struct sockaddr_in& remote_address) = 0;
+        // datagrams are sent whole, partial send is an error
+        virtual void send(const byte_t *data, size_t len) = 0;
+        virtual void send_to(const struct sockaddr_in& destination, const byte_t *data, size_t len) = 0;
+        // returns length of received datagram, or nothing if timeout was reached
+        virtual std::optional<size_t> receive(byte_t *buf, size_t len, struct sockaddr_in *from = nullptr) = 0;
+
+        // sends datagrams in order to the connected address, backends can do it with fewer system calls
+        virtual void send_batch(const std::vector<msg_t>& datagrams) {
+            for (const auto& datagram : datagrams) send(datagram.data(), datagram.size());
+        }
+
+        // receive polls the device queue for up to given time before sleeping, if backend supports it
+        virtual void set_busy_poll(int) {}
+    };
+
+    // factory of datagram sockets, sockets of one transport can communicate with each other
+    class transport {
+    public:
+        virtual ~transport() = default;
+
+        virtual std::unique_ptr<datagram_socket> open_datagram() = 0;
+    };
+
+    // kernel udp socket
+    class udp_socket : public datagram_socket {
+    private:
+        int sock{-1};
+
+        [[noreturn]] static void throw_errno() {
+            throw exceptions::socket_exception(strerror(errno));
+        }
+
+        void set_int_option(int level, int option, int value) {
+            int err = setsockopt(sock, level, option, &value, sizeof(value));
+            if (err < 0) throw_errno();
+        }
+
+    public:
+        udp_socket(const udp_socket& other) = delete;
+        udp_socket(udp_socket&& other) = delete;
+
+        udp_socket() {
+            sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+            if (sock < 0) throw_errno();
+        }
+
+        void enable_reuse_address() override {
+            set_int_option(SOL_SOCKET, SO_REUSEADDR, 1);
+        }
+
+        void enable_broadcast() override {
+            set_int_option(SOL_SOCKET, SO_BROADCAST, 1);
+        }
+
+        void set_multicast_ttl(int ttl) override {
+            set_int_option(IPPROTO_IP, IP_MULTICAST_TTL, ttl);
+        }
+
+        void set_multicast_interface(struct in_addr interface_address) override {
+            int err = setsockopt(sock, IPPROTO_IP, IP_MULTICAST_IF, &interface_address, sizeof(interface_address));
+            if (err < 0) throw_errno();
+        }
+
+        void join_group(struct in_addr group) override {
+            struct ip_mreq req{};
+            req.imr_multiaddr = group;
+            req.imr_interface.s_addr = htonl(INADDR_ANY);
+            int err = setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &req, sizeof(req));
+            if (err < 0) throw_errno();
+        }
+
+        void set_receive_timeout(int timeout_in_ms) override {
+            struct timeval tv{
+                .tv_sec = timeout_in_ms / 1000,
+                .tv_usec = 1000*(timeout_in_ms % 1000)
+            };
+            int err = setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+            if (err < 0) throw_errno();
+        }
+
+        void bind(const struct sockaddr_in& local_address) override {
+            int err = ::bind(sock, reinterpret_cast<const struct sockaddr *>(&local_address), sizeof(local_address));
+            if (err < 0) throw_errno();
+        }
+
+        void connect(const struct sockaddr_in& remote_address) override {
+            int err = ::connect(sock, reinterpret_cast<const struct sockaddr *>(&remote_address), sizeof(remote_address));
+            if (err < 0) throw_errno();
+        }
+
+        void send(const byte_t *data, size_t len) override {
+            ssize_t sent_len = ::send(sock, data, len, 0);
+            if (sent_len < 0) throw_errno();
+            if (sent_len != static_cast<ssize_t>(len))
+                throw exceptions::socket_exception("Failed to send entire datagram");
+        }
+
+        void send_to(const struct sockaddr_in& destination, const byte_t *data, size_t len) override {
+            ssize_t sent_len = sendto(
+                sock, data, len, 0,
+                reinterpret_cast<const struct sockaddr *>(&destination),
+                sizeof(destination));
+            if (sent_len < 0) throw_errno();
+            if (sent_len != static_cast<ssize_t>(len))
+                throw exceptions::socket_exception("Failed to send entire datagram");
+        }
+
+        std::optional<size_t> receive(byte_t *buf, size_t len, struct sockaddr_in *from) override {
+            struct sockaddr_in sender_address{};
+            auto address_len = static_cast<socklen_t>(sizeof(sender_address));
+            ssize_t rcv_len = recvfrom(
+                sock, buf, len, 0,
+                reinterpret_cast<struct sockaddr *>(&sender_address),
+                &address_len);
+            if (rcv_len < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    // timeout reached, this is not really an error
+                    errno = 0;
+                    return std::nullopt;
+                }
+                throw_errno();
+            }
+            if (from != nullptr) *from = sender_address;
+            return static_cast<size_t>(rcv_len);
+        }
+
+        void send_batch(const std::vector<msg_t>& datagrams) override {
+            std::vector<struct iovec> iovs(datagrams.size());
+            std::vector<struct mmsghdr> msgs(datagrams.size());
+            for (size_t i = 0; i < datagrams.size(); i++) {
+                iovs[i].iov_base = const_cast<byte_t *>(datagrams[i].data());
+                iovs[i].iov_len = datagrams[i].size();
+                msgs[i].msg_hdr.msg_iov = &iovs[i];
+                msgs[i].msg_hdr.msg_iovlen = 1;
+            }
+            size_t sent = 0;
+            while (sent < msgs.size()) {
+                int ret = sendmmsg(sock, msgs.data() + sent, static_cast<unsigned>(msgs.size() - sent), 0);
+                if (ret < 0) throw_errno();
+                for (size_t i = sent; i < sent + ret; i++)
+                    if (msgs[i].msg_len != datagrams[i].size())
+                        throw exceptions::socket_exception("Failed to send entire datagram");
+                sent += ret;
+            }
+        }
+
+        void set_busy_poll(int busy_poll_in_us) override {
+            set_int_option(SOL_SOCKET, SO_BUSY_POLL, busy_poll_in_us);
+        }
+
+        int native_handle() const {
+            return sock;
+        }
+
+        ~udp_socket() override {
+            if (sock >= 0) close(sock);
+        }
+    };
+
+    class udp_transport : public transport {
+    public:
+        std::unique_ptr<datagram_socket> open_datagram() override {
+            return std::make_unique<udp_socket>();
+        }
+    };
+
+    // transport used when none is specified
+    inline std::shared_ptr<transport> default_transport() {
+        static auto kernel_udp = std::make_shared<udp_transport>();
+        return kernel_udp;
+    }
+}
+
+#endif //SIKRADIO_COMMON_TRANSPORT_HPP
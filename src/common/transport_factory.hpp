@@ -0,0 +1,27 @@
+#ifndef SIKRADIO_COMMON_TRANSPORT_FACTORY_HPP
+#define SIKRADIO_COMMON_TRANSPORT_FACTORY_HPP
+
+#include <memory>
+#include <string>
+#include <iostream>
+
+#include "exceptions.hpp"
+#include "transport.hpp"
+#include "uring_transport.hpp"
+
+namespace sikradio::common {
+    // returns transport of the backend with given name ("udp" or "uring"),
+    // if io_uring is not available on this system kernel udp sockets are used instead
+    inline std::shared_ptr<transport> make_transport(const std::string& backend) {
+        if (backend == "udp") return default_transport();
+        if (backend != "uring") throw exceptions::socket_exception("Unknown i/o backend: " + backend);
+        try {
+            return std::make_shared<uring_transport>();
+        } catch (exceptions::socket_exception &e) {
+            std::cerr << "io_uring backend is not available (" << e.what() << "), using udp" << std::endl;
+            return default_transport();
+        }
+    }
+}
+
+#endif //SIKRADIO_COMMON_TRANSPORT_FACTORY_HPP
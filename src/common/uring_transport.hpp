@@ -0,0 +1,511 @@
+#ifndef SIKRADIO_COMMON_URING_TRANSPORT_HPP
+#define SIKRADIO_COMMON_URING_TRANSPORT_HPP
+
+#include <memory>
+#include <vector>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <optional>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <netinet/in.h>
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+
+#include "exceptions.hpp"
+#include "types.hpp"
+#include "transport.hpp"
+
+#ifndef UDP_DATAGRAM_DATA_LEN_MAX
+#define UDP_DATAGRAM_DATA_LEN_MAX 65535
+#endif
+
+namespace sikradio::common {
+    namespace {
+        const unsigned uring_send_entries = 64;
+        // datagrams received but not yet read are held in provided buffers, when all of them are used
+        // kernel keeps new datagrams in the socket's receive queue
+        const unsigned uring_recv_buffers = 64;
+        const unsigned uring_recv_buffer_group = 0;
+        const uint64_t uring_recv_tag = 1;
+    }
+
+    // minimal io_uring instance, used with raw system calls (the program does not depend on liburing),
+    // it is not thread safe
+    class uring {
+    private:
+        int fd{-1};
+        struct io_uring_params params{};
+        void *sq_ring{MAP_FAILED};
+        size_t sq_ring_len{0};
+        void *cq_ring{MAP_FAILED};
+        size_t cq_ring_len{0};
+        struct io_uring_sqe *sqes{static_cast<struct io_uring_sqe *>(MAP_FAILED)};
+        unsigned *sq_head{nullptr};
+        unsigned *sq_tail{nullptr};
+        unsigned *sq_mask{nullptr};
+        unsigned *sq_array{nullptr};
+        unsigned *cq_head{nullptr};
+        unsigned *cq_tail{nullptr};
+        unsigned *cq_mask{nullptr};
+        struct io_uring_cqe *cqes{nullptr};
+        unsigned sqe_tail{0};  // prepared, but not yet submitted entries end here
+
+        [[noreturn]] static void throw_errno(const std::string& context) {
+            throw exceptions::socket_exception(context + ": " + strerror(errno));
+        }
+
+        template<typename T>
+        T *at(void *ring, unsigned offset) {
+            return reinterpret_cast<T *>(static_cast<char *>(ring) + offset);
+        }
+
+        void release() {
+            if (sqes != MAP_FAILED) munmap(sqes, params.sq_entries*sizeof(struct io_uring_sqe));
+            if (cq_ring != MAP_FAILED && cq_ring != sq_ring) munmap(cq_ring, cq_ring_len);
+            if (sq_ring != MAP_FAILED) munmap(sq_ring, sq_ring_len);
+            if (fd >= 0) close(fd);
+        }
+
+    public:
+        uring(const uring& other) = delete;
+        uring(uring&& other) = delete;
+
+        uring(unsigned entries, unsigned cq_entries, unsigned flags = 0) {
+            params.flags = IORING_SETUP_CQSIZE | flags;
+            params.cq_entries = cq_entries;
+            fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+            if (fd < 0) throw_errno("io_uring_setup");
+            if (!(params.features & IORING_FEAT_EXT_ARG)) {
+                release();
+                throw exceptions::socket_exception("io_uring does not support waiting with timeout");
+            }
+            sq_ring_len = params.sq_off.array + params.sq_entries*sizeof(unsigned);
+            cq_ring_len = params.cq_off.cqes + params.cq_entries*sizeof(struct io_uring_cqe);
+            bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP);
+            if (single_mmap) sq_ring_len = cq_ring_len = std::max(sq_ring_len, cq_ring_len);
+            sq_ring = mmap(nullptr, sq_ring_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                           fd, IORING_OFF_SQ_RING);
+            if (sq_ring == MAP_FAILED) {
+                release();
+                throw_errno("io_uring mmap");
+            }
+            cq_ring = single_mmap ? sq_ring : mmap(nullptr, cq_ring_len, PROT_READ | PROT_WRITE,
+                                                   MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+            void *sqes_mem = mmap(nullptr, params.sq_entries*sizeof(struct io_uring_sqe),
+                                  PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+            sqes = static_cast<struct io_uring_sqe *>(sqes_mem);
+            if (cq_ring == MAP_FAILED || sqes_mem == MAP_FAILED) {
+                release();
+                throw_errno("io_uring mmap");
+            }
+            sq_head = at<unsigned>(sq_ring, params.sq_off.head);
+            sq_tail = at<unsigned>(sq_ring, params.sq_off.tail);
+            sq_mask = at<unsigned>(sq_ring, params.sq_off.ring_mask);
+            sq_array = at<unsigned>(sq_ring, params.sq_off.array);
+            cq_head = at<unsigned>(cq_ring, params.cq_off.head);
+            cq_tail = at<unsigned>(cq_ring, params.cq_off.tail);
+            cq_mask = at<unsigned>(cq_ring, params.cq_off.ring_mask);
+            cqes = at<struct io_uring_cqe>(cq_ring, params.cq_off.cqes);
+            sqe_tail = *sq_tail;
+        }
+
+        int get_fd() const {
+            return fd;
+        }
+
+        unsigned get_sq_entries() const {
+            return params.sq_entries;
+        }
+
+        // returns cleared entry to be filled and submitted, or nullptr if submission queue is full
+        struct io_uring_sqe *get_sqe() {
+            auto head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+            if (sqe_tail - head >= params.sq_entries) return nullptr;
+            auto index = sqe_tail & *sq_mask;
+            auto sqe = &sqes[index];
+            memset(sqe, 0, sizeof(*sqe));
+            sq_array[index] = index;
+            sqe_tail++;
+            return sqe;
+        }
+
+        // submits prepared entries and waits for `wait_nr` completions (or timeout, if it is given),
+        // completions may be already available when waiting is interrupted
+        void submit_and_wait(unsigned wait_nr, std::optional<std::chrono::milliseconds> timeout = std::nullopt) {
+            unsigned to_submit = sqe_tail - *sq_tail;
+            __atomic_store_n(sq_tail, sqe_tail, __ATOMIC_RELEASE);
+            unsigned flags = (wait_nr > 0) ? IORING_ENTER_GETEVENTS : 0;
+            struct __kernel_timespec ts{};
+            struct io_uring_getevents_arg arg{};
+            void *argp = nullptr;
+            size_t argsz = 0;
+            if (timeout.has_value()) {
+                ts.tv_sec = timeout.value().count() / 1000;
+                ts.tv_nsec = (timeout.value().count() % 1000)*1000000;
+                arg.ts = reinterpret_cast<uint64_t>(&ts);
+                argp = &arg;
+                argsz = sizeof(arg);
+                flags |= IORING_ENTER_EXT_ARG;
+            }
+            long ret = syscall(__NR_io_uring_enter, fd, to_submit, wait_nr, flags, argp, argsz);
+            if (ret >= 0) return;
+            // timeout reached, interrupted or completions have to be reaped first, this is not really an error
+            if (errno == ETIME || errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+                errno = 0;
+                return;
+            }
+            throw_errno("io_uring_enter");
+        }
+
+        // returns oldest completion that was not marked as seen, or nullptr if there is none
+        struct io_uring_cqe *peek_cqe() {
+            auto head = *cq_head;
+            if (head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) return nullptr;
+            return &cqes[head & *cq_mask];
+        }
+
+        void cqe_seen() {
+            __atomic_store_n(cq_head, *cq_head + 1, __ATOMIC_RELEASE);
+        }
+
+        ~uring() {
+            release();
+        }
+    };
+
+    // ring of buffers that kernel picks from when receiving (provided buffer ring),
+    // buffers are given back after their content is read
+    class uring_buffer_ring {
+    private:
+        uring& ring;
+        struct io_uring_buf_ring *buf_ring{static_cast<struct io_uring_buf_ring *>(MAP_FAILED)};
+        size_t buf_ring_len;
+        byte_t *buffers{static_cast<byte_t *>(MAP_FAILED)};
+        unsigned count;
+        size_t buffer_size;
+        uint16_t tail{0};
+        bool registered{false};
+
+        void release() {
+            if (registered) {
+                struct io_uring_buf_reg reg{};
+                reg.bgid = uring_recv_buffer_group;
+                (void)syscall(__NR_io_uring_register, ring.get_fd(), IORING_UNREGISTER_PBUF_RING, &reg, 1);
+            }
+            if (buffers != MAP_FAILED) munmap(buffers, count*buffer_size);
+            if (buf_ring != MAP_FAILED) munmap(buf_ring, buf_ring_len);
+        }
+
+    public:
+        uring_buffer_ring(const uring_buffer_ring& other) = delete;
+        uring_buffer_ring(uring_buffer_ring&& other) = delete;
+
+        // count has to be a power of two, buffers' memory is allocated lazily by the kernel
+        uring_buffer_ring(uring& ring, unsigned count, size_t buffer_size) :
+                ring{ring},
+                buf_ring_len{count*sizeof(struct io_uring_buf)},
+                count{count},
+                buffer_size{buffer_size} {
+            void *ring_mem = mmap(nullptr, buf_ring_len, PROT_READ | PROT_WRITE,
+                                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            void *buffers_mem = mmap(nullptr, count*buffer_size, PROT_READ | PROT_WRITE,
+                                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            buf_ring = static_cast<struct io_uring_buf_ring *>(ring_mem);
+            buffers = static_cast<byte_t *>(buffers_mem);
+            if (ring_mem == MAP_FAILED || buffers_mem == MAP_FAILED) {
+                release();
+                throw exceptions::socket_exception(std::string("io_uring buffers: ") + strerror(errno));
+            }
+            struct io_uring_buf_reg reg{};
+            reg.ring_addr = reinterpret_cast<uint64_t>(buf_ring);
+            reg.ring_entries = count;
+            reg.bgid = uring_recv_buffer_group;
+            if (syscall(__NR_io_uring_register, ring.get_fd(), IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+                auto err = std::string("io_uring provided buffers: ") + strerror(errno);
+                release();
+                throw exceptions::socket_exception(err);
+            }
+            registered = true;
+            for (unsigned id = 0; id < count; id++) give_back(static_cast<uint16_t>(id));
+        }
+
+        byte_t *get(uint16_t id) {
+            return buffers + id*buffer_size;
+        }
+
+        size_t get_buffer_size() const {
+            return buffer_size;
+        }
+
+        void give_back(uint16_t id) {
+            // entries start at the beginning of the ring, `bufs` member of the kernel header
+            // is misplaced when compiled as C++ (its empty struct prefix takes space)
+            auto& buf = reinterpret_cast<struct io_uring_buf *>(buf_ring)[tail & (count - 1)];
+            buf.addr = reinterpret_cast<uint64_t>(get(id));
+            buf.len = static_cast<uint32_t>(buffer_size);
+            buf.bid = id;
+            tail++;
+            __atomic_store_n(&buf_ring->tail, tail, __ATOMIC_RELEASE);
+        }
+
+        ~uring_buffer_ring() {
+            release();
+        }
+    };
+
+    // kernel udp socket driven through io_uring: datagrams are received by a single multishot
+    // request into provided buffers and batches of datagrams are sent with one system call,
+    // receiving and sending use separate rings, so they can be done from different threads,
+    // but receive has to be always called from the same thread
+    class uring_socket : public datagram_socket {
+    private:
+        struct receiver_state {
+            std::unique_ptr<uring> ring;
+            // destroyed before the ring, unregistering buffers needs it
+            std::unique_ptr<uring_buffer_ring> buffers;
+            struct msghdr hdr{};
+            bool armed{false};
+
+            receiver_state() {
+                try {
+                    // completions are posted only when the ring is entered, so one system call
+                    // reaps all datagrams received in the meantime (Linux 6.1+)
+                    ring = std::make_unique<uring>(4, 2*uring_recv_buffers,
+                        IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN);
+                } catch (exceptions::socket_exception &e) {
+                    ring = std::make_unique<uring>(4, 2*uring_recv_buffers);
+                }
+                buffers = std::make_unique<uring_buffer_ring>(*ring, uring_recv_buffers,
+                    sizeof(struct io_uring_recvmsg_out) + sizeof(struct sockaddr_in) + UDP_DATAGRAM_DATA_LEN_MAX);
+            }
+        };
+
+        udp_socket sock{};
+        std::unique_ptr<receiver_state> receiving{nullptr};
+        std::unique_ptr<uring> sending{nullptr};
+        std::vector<size_t> batch_lengths{};
+        int timeout_in_ms{0};
+
+        void arm(receiver_state& state) {
+            auto sqe = state.ring->get_sqe();
+            if (sqe == nullptr) return;
+            state.hdr.msg_namelen = sizeof(struct sockaddr_in);
+            sqe->opcode = IORING_OP_RECVMSG;
+            sqe->fd = sock.native_handle();
+            sqe->addr = reinterpret_cast<uint64_t>(&state.hdr);
+            sqe->len = 1;
+            sqe->ioprio = IORING_RECV_MULTISHOT;
+            sqe->flags = IOSQE_BUFFER_SELECT;
+            sqe->buf_group = uring_recv_buffer_group;
+            sqe->user_data = uring_recv_tag;
+            state.armed = true;
+        }
+
+        // consumes one completion, returns length of datagram copied to buf if it carried one
+        std::optional<size_t> consume(receiver_state& state, struct io_uring_cqe *cqe,
+                                      byte_t *buf, size_t len, struct sockaddr_in *from) {
+            int res = cqe->res;
+            auto flags = cqe->flags;
+            state.ring->cqe_seen();
+            if (!(flags & IORING_CQE_F_MORE)) state.armed = false;
+            if (res < 0) {
+                // out of buffers, request is armed again after they are given back
+                if (res == -ENOBUFS) return std::nullopt;
+                errno = -res;
+                throw exceptions::socket_exception(strerror(errno));
+            }
+            if (!(flags & IORING_CQE_F_BUFFER)) return std::nullopt;
+            auto id = static_cast<uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT);
+            auto base = state.buffers->get(id);
+            auto out = reinterpret_cast<struct io_uring_recvmsg_out *>(base);
+            auto name = base + sizeof(struct io_uring_recvmsg_out);
+            auto payload = name + state.hdr.msg_namelen + state.hdr.msg_controllen;
+            size_t available = static_cast<size_t>(res) - (payload - base);
+            auto rcv_len = std::min<size_t>({len, out->payloadlen, available});
+            memcpy(buf, payload, rcv_len);
+            if (from != nullptr) memcpy(from, name, std::min<size_t>(out->namelen, sizeof(*from)));
+            state.buffers->give_back(id);
+            return rcv_len;
+        }
+
+        uring& send_ring() {
+            if (!sending) sending = std::make_unique<uring>(uring_send_entries, 2*uring_send_entries);
+            return *sending;
+        }
+
+        // waits for completions of `count` submitted sends, throws after all of them are reaped
+        void reap_sends(uring& ring, const size_t *lengths, size_t count) {
+            int error = 0;
+            bool partial = false;
+            for (size_t reaped = 0; reaped < count;) {
+                auto cqe = ring.peek_cqe();
+                if (cqe == nullptr) {
+                    ring.submit_and_wait(1);
+                    continue;
+                }
+                int res = cqe->res;
+                auto index = static_cast<size_t>(cqe->user_data);
+                ring.cqe_seen();
+                reaped++;
+                if (res < 0 && error == 0) error = -res;
+                if (res >= 0 && index < count && static_cast<size_t>(res) != lengths[index])
+                    partial = true;
+            }
+            if (error != 0) throw exceptions::socket_exception(strerror(error));
+            if (partial) throw exceptions::socket_exception("Failed to send entire datagram");
+        }
+
+        void prepare_send(struct io_uring_sqe *sqe, const byte_t *data, size_t len, uint64_t index) {
+            sqe->opcode = IORING_OP_SEND;
+            sqe->fd = sock.native_handle();
+            sqe->addr = reinterpret_cast<uint64_t>(data);
+            sqe->len = static_cast<uint32_t>(len);
+            sqe->user_data = index;
+        }
+
+    public:
+        uring_socket(const uring_socket& other) = delete;
+        uring_socket(uring_socket&& other) = delete;
+
+        uring_socket() = default;
+
+        void enable_reuse_address() override {
+            sock.enable_reuse_address();
+        }
+
+        void enable_broadcast() override {
+            sock.enable_broadcast();
+        }
+
+        void set_multicast_ttl(int ttl) override {
+            sock.set_multicast_ttl(ttl);
+        }
+
+        void set_multicast_interface(struct in_addr interface_address) override {
+            sock.set_multicast_interface(interface_address);
+        }
+
+        void join_group(struct in_addr group) override {
+            sock.join_group(group);
+        }
+
+        void set_receive_timeout(int timeout_in_ms) override {
+            // waiting is done by io_uring, socket itself is never blocked on
+            this->timeout_in_ms = timeout_in_ms;
+        }
+
+        void set_busy_poll(int busy_poll_in_us) override {
+            sock.set_busy_poll(busy_poll_in_us);
+        }
+
+        void bind(const struct sockaddr_in& local_address) override {
+            sock.bind(local_address);
+        }
+
+        void connect(const struct sockaddr_in& remote_address) override {
+            sock.connect(remote_address);
+        }
+
+        void send(const byte_t *data, size_t len) override {
+            auto& ring = send_ring();
+            prepare_send(ring.get_sqe(), data, len, 0);
+            ring.submit_and_wait(1);
+            reap_sends(ring, &len, 1);
+        }
+
+        void send_to(const struct sockaddr_in& destination, const byte_t *data, size_t len) override {
+            auto& ring = send_ring();
+            struct iovec iov{const_cast<byte_t *>(data), len};
+            struct msghdr hdr{};
+            hdr.msg_name = const_cast<struct sockaddr_in *>(&destination);
+            hdr.msg_namelen = sizeof(destination);
+            hdr.msg_iov = &iov;
+            hdr.msg_iovlen = 1;
+            auto sqe = ring.get_sqe();
+            sqe->opcode = IORING_OP_SENDMSG;
+            sqe->fd = sock.native_handle();
+            sqe->addr = reinterpret_cast<uint64_t>(&hdr);
+            sqe->len = 1;
+            sqe->user_data = 0;
+            ring.submit_and_wait(1);
+            reap_sends(ring, &len, 1);
+        }
+
+        void send_batch(const std::vector<msg_t>& datagrams) override {
+            // linked sends are executed in order, if one fails the rest of its chain is cancelled
+            auto& ring = send_ring();
+            for (size_t first = 0; first < datagrams.size(); first += ring.get_sq_entries()) {
+                auto last = std::min<size_t>(first + ring.get_sq_entries(), datagrams.size());
+                batch_lengths.clear();
+                for (size_t i = first; i < last; i++) {
+                    auto sqe = ring.get_sqe();
+                    prepare_send(sqe, datagrams[i].data(), datagrams[i].size(), i - first);
+                    if (i + 1 < last) sqe->flags |= IOSQE_IO_LINK;
+                    batch_lengths.push_back(datagrams[i].size());
+                }
+                ring.submit_and_wait(static_cast<unsigned>(batch_lengths.size()));
+                reap_sends(ring, batch_lengths.data(), batch_lengths.size());
+            }
+        }
+
+        std::optional<size_t> receive(byte_t *buf, size_t len, struct sockaddr_in *from) override {
+            if (!receiving) receiving = std::make_unique<receiver_state>();
+            auto& state = *receiving;
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_in_ms);
+            while (true) {
+                auto cqe = state.ring->peek_cqe();
+                if (cqe != nullptr) {
+                    auto rcv_len = consume(state, cqe, buf, len, from);
+                    if (rcv_len.has_value()) return rcv_len;
+                    continue;
+                }
+                if (!state.armed) arm(state);
+                std::optional<std::chrono::milliseconds> wait{std::nullopt};
+                if (timeout_in_ms > 0) {
+                    auto left = std::chrono::ceil<std::chrono::milliseconds>(
+                        deadline - std::chrono::steady_clock::now());
+                    if (left.count() <= 0) return std::nullopt;
+                    wait = left;
+                }
+                state.ring->submit_and_wait(1, wait);
+            }
+        }
+    };
+
+    class uring_transport : public transport {
+    public:
+        // throws socket_exception if kernel does not support features used by the backend
+        // (provided buffer rings since Linux 5.19, multishot recvmsg since 6.0)
+        uring_transport() {
+            uring probe{4, 8};
+            uring_buffer_ring buffers{probe, 1, sizeof(struct io_uring_recvmsg_out) + sizeof(struct sockaddr_in)};
+            udp_socket sock{};
+            struct msghdr hdr{};
+            hdr.msg_namelen = sizeof(struct sockaddr_in);
+            auto sqe = probe.get_sqe();
+            sqe->opcode = IORING_OP_RECVMSG;
+            sqe->fd = sock.native_handle();
+            sqe->addr = reinterpret_cast<uint64_t>(&hdr);
+            sqe->len = 1;
+            sqe->ioprio = IORING_RECV_MULTISHOT;
+            sqe->flags = IOSQE_BUFFER_SELECT;
+            sqe->buf_group = uring_recv_buffer_group;
+            // unsupported request fails immediately, supported one waits for a datagram
+            probe.submit_and_wait(0);
+            auto cqe = probe.peek_cqe();
+            if (cqe != nullptr && cqe->res < 0)
+                throw exceptions::socket_exception(std::string("io_uring multishot receive: ") + strerror(-cqe->res));
+        }
+
+        std::unique_ptr<datagram_socket> open_datagram() override {
+            return std::make_unique<uring_socket>();
+        }
+    };
+}
+
+#endif //SIKRADIO_COMMON_URING_TRANSPORT_HPP
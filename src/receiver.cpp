@@ -3,11 +3,22 @@
 #include <cstdint>
 #include <optional>
 #include <csignal>
+#include <memory>
+#include <chrono>
 
 #include "receiver/receiver.hpp"
+#include "common/transport.hpp"
+#include "common/impaired_transport.hpp"
+#include "common/transport_factory.hpp"
+#include "common/realtime.hpp"
 
 namespace po = boost::program_options;
 
+namespace {
+    // how far back playback jumps on each rewind command
+    const auto timeshift_rewind_step = std::chrono::seconds(10);
+}
+
 int main(int argc, char *argv[]) {
     po::options_description desc("Allowed options");
     desc.add_options()
@@ -16,7 +27,17 @@ int main(int argc, char *argv[]) {
             (",U", po::value<uint16_t>()->default_value(15830), "UI_PORT")
             (",b", po::value<size_t>()->default_value(65536), "BSIZE")
             (",R", po::value<size_t>()->default_value(250), "RTIME")
-            (",n", po::value<std::string>()->default_value(""), "PREFERRED_STATION");
+            (",n", po::value<std::string>()->default_value(""), "PREFERRED_STATION")
+            (",A", po::value<double>(), "ADAPTIVE_UNDERRUN_PROBABILITY")
+            (",F", po::value<uint16_t>()->default_value(0), "FEC_PORT")
+            (",S", po::value<uint16_t>()->default_value(0), "STATS_PORT")
+            (",X", po::value<std::string>()->default_value(""), "IMPAIRMENT")
+            (",B", po::value<std::string>()->default_value("udp"), "IO_BACKEND")
+            (",T", po::value<std::string>()->default_value(""), "REALTIME")
+            (",W", po::value<std::string>()->default_value(""), "TIMESHIFT_FILE")
+            (",w", po::value<size_t>()->default_value(64), "TIMESHIFT_SIZE_MB")
+            (",q", po::bool_switch(), "FAST_START")
+            (",m", po::bool_switch(), "MULTICAST_NACKS");
     
     po::variables_map vm;
     try {
@@ -29,16 +50,43 @@ int main(int argc, char *argv[]) {
     std::string ps_input = vm["-n"].as<std::string>();
     std::optional<std::string> preferred_station = ps_input.empty() ? 
         std::nullopt : std::make_optional(ps_input);
+    std::optional<double> underrun_probability = vm.count("-A") ? 
+        std::make_optional(vm["-A"].as<double>()) : std::nullopt;
 
     try {
+        // received datagrams are impaired to emulate a lossy network
+        std::shared_ptr<sikradio::common::transport> transport = 
+            sikradio::common::make_transport(vm["-B"].as<std::string>());
+        std::shared_ptr<sikradio::common::impaired_transport> impaired{nullptr};
+        if (!vm["-X"].as<std::string>().empty()) {
+            impaired = std::make_shared<sikradio::common::impaired_transport>(
+                transport, sikradio::common::parse_impairment(vm["-X"].as<std::string>()));
+            transport = impaired;
+        }
+        // played audio is recorded, so that it can be paused and rewound from the ui
+        std::shared_ptr<sikradio::receiver::timeshift> timeshift{nullptr};
+        if (!vm["-W"].as<std::string>().empty())
+            timeshift = std::make_shared<sikradio::receiver::timeshift>(
+                vm["-W"].as<std::string>(),
+                vm["-w"].as<size_t>()*1024*1024,
+                timeshift_rewind_step);
         sikradio::receiver::receiver rcvr(
             vm["-d"].as<std::string>(),
             vm["-C"].as<uint16_t>(),
             vm["-U"].as<uint16_t>(),
             vm["-b"].as<size_t>(),
             vm["-R"].as<size_t>(),
-            preferred_station
+            preferred_station,
+            underrun_probability,
+            vm["-F"].as<uint16_t>(),
+            vm["-S"].as<uint16_t>(),
+            transport,
+            sikradio::common::parse_realtime(vm["-T"].as<std::string>(), sikradio::receiver::realtime_roles),
+            timeshift,
+            vm["-q"].as<bool>(),
+            vm["-m"].as<bool>()
         );
+        if (impaired) impaired->register_probes(rcvr.get_metrics());
         rcvr.run();
     } catch (sikradio::common::exceptions::base_exception &e) {
         std::cerr << e.what() << std::endl;
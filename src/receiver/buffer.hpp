@@ -2,23 +2,34 @@
 #define SIKRADIO_RECEIVER_BUFFER_HPP
 
 #include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
 #include <deque>
 #include <set>
+#include <map>
+#include <vector>
 #include <utility>
 #include <optional>
 
 #include "../common/data_msg.hpp"
+#include "../common/fec_msg.hpp"
 #include "../common/types.hpp"
+#include "../common/histogram.hpp"
 #include "exceptions.hpp"
+#include "jitter_estimator.hpp"
 
 namespace sikradio::receiver {
     using buffer_access_exception = exceptions::buffer_access_exception;
     enum class buffer_state {NO_SESSION, WAITING, READABLE};
+    using arrival_time = std::chrono::steady_clock::time_point;
 
     class buffer {
     private:
         // buffer parameters
         std::mutex mut{};
+        // notified when buffer becomes readable
+        std::condition_variable readable{};
         size_t max_size;
         size_t max_elements;
         // session and buffer state
@@ -26,62 +37,243 @@ namespace sikradio::receiver {
         sikradio::common::msg_id_t max_msg_id{};
         sikradio::common::msg_id_t byte_zero{};
         size_t package_size;  // deduced from first package in session
+        // first id of the next session, if it should start before the first received message
+        std::optional<sikradio::common::msg_id_t> session_start{std::nullopt};
+        bool started_early{false};  // session started before the first received message
+        bool read_failed{false};  // next message was not there when it had to be read, until reset
         // buffer contents
         std::deque<std::optional<sikradio::common::msg_t>> msg_vals{};
         std::deque<sikradio::common::msg_id_t> msg_ids{};
+        std::deque<arrival_time> msg_arrivals{};  // when message was received or recovered
+        // first retransmission request of each missed message, for measuring repair latency
+        std::map<sikradio::common::msg_id_t, arrival_time> rexmit_requests{};
+        sikradio::common::metrics::histogram* repair_latency_us;
+        // parity messages waiting for the rest of their group, by first protected id
+        std::map<sikradio::common::msg_id_t, sikradio::common::fec_msg> parities{};
+        sikradio::common::msg_id_t max_parity_span{0};  // distance between first and last protected id
+        // adaptive playout threshold, disabled when empty
+        std::optional<sikradio::receiver::jitter_estimator> estimator{std::nullopt};
+        // statistics, readable without taking the buffer lock
+        std::atomic<uint64_t> duplicate_count{0};
+        std::atomic<uint64_t> late_count{0};
+        std::atomic<size_t> fill{0};
 
-        void save_new_message(const sikradio::common::data_msg &msg) {
+        void pop_front() {
+            msg_ids.pop_front();
+            msg_vals.pop_front();
+            msg_arrivals.pop_front();
+        }
+
+        void save_new_message(const sikradio::common::data_msg &msg, arrival_time arrival) {
             if (msg_ids.empty()) {
                 msg_vals.emplace_back(std::make_optional(msg.get_data()));
                 msg_ids.emplace_back(msg.get_id());
+                msg_arrivals.emplace_back(arrival);
                 return;
             }
             // pop excessive elements and reserve empty space for missed messages
             for (auto missed_id = msg_ids.back() + package_size; 
                     missed_id < msg.get_id(); 
                     missed_id += package_size) {
-                if (msg_ids.size() == max_elements) {
-                    msg_ids.pop_front();
-                    msg_vals.pop_front();
-                }
+                if (msg_ids.size() == max_elements) pop_front();
                 msg_vals.emplace_back(std::nullopt);
                 msg_ids.emplace_back(missed_id);
+                msg_arrivals.emplace_back();
             }
             // pop excessive element and save the message
-            if (msg_ids.size() == max_elements) {
-                msg_ids.pop_front();
-                msg_vals.pop_front();
-            }
+            if (msg_ids.size() == max_elements) pop_front();
             msg_vals.emplace_back(std::make_optional(msg.get_data()));
             msg_ids.emplace_back(msg.get_id());
+            msg_arrivals.emplace_back(arrival);
         }
 
-        void save_missed_message(const sikradio::common::data_msg &msg) {
+        void save_missed_message(const sikradio::common::data_msg &msg, arrival_time arrival) {
             // assuming message already has allocated space in the buffer
             size_t msg_pos = (msg.get_id()-msg_ids.front()) / package_size;
+            if (msg_vals[msg_pos].has_value()) {
+                duplicate_count.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            if (estimator.has_value())
+                estimator.value().register_repair(msg.get_id(), arrival);
+            auto request = rexmit_requests.find(msg.get_id());
+            if (request != rexmit_requests.end()) {
+                if (repair_latency_us != nullptr)
+                    repair_latency_us->record(static_cast<uint64_t>(
+                        std::chrono::duration_cast<std::chrono::microseconds>(arrival - request->second).count()));
+                rexmit_requests.erase(request);
+            }
             msg_vals[msg_pos] = std::make_optional(msg.get_data());
+            msg_arrivals[msg_pos] = arrival;
+        }
+
+        void drop_old_rexmit_requests() {
+            while (!rexmit_requests.empty()
+                    && (msg_ids.empty() || rexmit_requests.begin()->first < msg_ids.front())) {
+                // message was read or dropped before it was repaired
+                rexmit_requests.erase(rexmit_requests.begin());
+            }
+        }
+
+        // reserves places for missing messages from first_id to the front of the buffer, as long as
+        // there is space, returns their ids
+        std::set<sikradio::common::msg_id_t> prepend_missing(sikradio::common::msg_id_t first_id) {
+            std::set<sikradio::common::msg_id_t> prepended;
+            if (msg_ids.empty() || first_id > msg_ids.front() || (msg_ids.front() - first_id) % package_size != 0)
+                return prepended;
+            started_early = true;
+            while (msg_ids.front() > first_id && msg_ids.size() < max_elements) {
+                msg_ids.push_front(msg_ids.front() - package_size);
+                msg_vals.emplace_front(std::nullopt);
+                msg_arrivals.emplace_front();
+                prepended.insert(msg_ids.front());
+            }
+            byte_zero = msg_ids.front();
+            return prepended;
+        }
+
+        // playback starts from a received message, after threshold is reached, if the session started
+        // early, places up to the threshold are filled by the burst much faster than by live stream,
+        // so playback waits for all of them, to not drain the buffer faster than it is filled
+        bool is_playable() const {
+            auto threshold = playout_threshold();
+            if (!msg_vals.front().has_value() || msg_ids.back() < byte_zero + threshold*package_size)
+                return false;
+            if (!started_early) return true;
+            for (size_t i = 0; i < std::min(threshold, msg_vals.size()); i++)
+                if (!msg_vals[i].has_value()) return false;
+            return true;
+        }
+
+        std::optional<size_t> position_of(sikradio::common::msg_id_t id) const {
+            if (msg_ids.empty() || id < msg_ids.front() || id > msg_ids.back()) 
+                return std::nullopt;
+            return (id - msg_ids.front()) / package_size;
+        }
+
+        // first ids of parity groups protecting given message, interleaved groups may overlap
+        std::vector<sikradio::common::msg_id_t> parity_groups_of(sikradio::common::msg_id_t id) const {
+            std::vector<sikradio::common::msg_id_t> groups;
+            auto lowest_first_id = (id > max_parity_span) ? id - max_parity_span : 0;
+            for (auto it = parities.lower_bound(lowest_first_id); 
+                    it != parities.end() && it->first <= id; 
+                    it++) {
+                if (it->second.protects(id)) groups.push_back(it->first);
+            }
+            return groups;
+        }
+
+        void drop_old_parities() {
+            while (!parities.empty()) {
+                const auto& parity = parities.begin()->second;
+                if (!msg_ids.empty() && parity.get_first_id() >= msg_ids.front()) break;
+                // part of the group was already read, it can not be used anymore
+                parities.erase(parities.begin());
+            }
+        }
+
+        // reconstructs message protected by parity if it is the only one missing in its group
+        std::optional<sikradio::common::msg_id_t> try_recover(sikradio::common::msg_id_t first_id) {
+            auto it = parities.find(first_id);
+            if (it == parities.end()) return std::nullopt;
+            const auto& parity = it->second;
+            if (parity.get_parity().size() != package_size || parity.get_count() == 0
+                    || !position_of(parity.protected_id(parity.get_count() - 1)).has_value()) {
+                // rest of the group was not received yet
+                return std::nullopt;
+            }
+            std::optional<size_t> missing_pos{std::nullopt};
+            size_t missing = 0;
+            for (size_t i = 0; i < parity.get_count(); i++) {
+                size_t pos = position_of(parity.protected_id(i)).value();
+                if (msg_vals[pos].has_value()) continue;
+                missing++;
+                missing_pos = pos;
+            }
+            if (missing > 1) return std::nullopt;  // retransmission may still complete the group
+            if (missing == 0) {
+                parities.erase(it);
+                return std::nullopt;
+            }
+            sikradio::common::msg_t data = parity.get_parity();
+            for (size_t i = 0; i < parity.get_count(); i++) {
+                size_t pos = position_of(parity.protected_id(i)).value();
+                if (pos == missing_pos.value()) continue;
+                sikradio::common::xor_into(data.data(), msg_vals[pos].value().data(), package_size);
+            }
+            auto recovered_id = msg_ids[missing_pos.value()];
+            msg_vals[missing_pos.value()] = std::make_optional(std::move(data));
+            msg_arrivals[missing_pos.value()] = std::chrono::steady_clock::now();
+            rexmit_requests.erase(recovered_id);
+            if (estimator.has_value())
+                estimator.value().register_repair(recovered_id);
+            parities.erase(it);
+            return recovered_id;
+        }
+
+        // tries to recover messages of given groups, repeated while recoveries complete other groups
+        std::set<sikradio::common::msg_id_t> recover_groups(std::set<sikradio::common::msg_id_t> groups) {
+            std::set<sikradio::common::msg_id_t> recovered_ids;
+            while (!groups.empty()) {
+                auto first_id = *groups.begin();
+                groups.erase(groups.begin());
+                auto recovered = try_recover(first_id);
+                if (!recovered.has_value()) continue;
+                recovered_ids.insert(recovered.value());
+                for (auto group : parity_groups_of(recovered.value())) groups.insert(group);
+            }
+            return recovered_ids;
+        }
+
+        size_t playout_threshold() const {
+            size_t legacy_threshold = max_elements*3/4;
+            if (!estimator.has_value()) return legacy_threshold;
+            // until estimate is available, fall back to the fixed threshold
+            return estimator.value().target_elements(max_elements).value_or(legacy_threshold);
         }
 
-        std::optional<sikradio::common::msg_t> optional_read() {
+        // playback starts when threshold is reached, it can happen when message is received or recovered
+        void update_readable() {
+            if (state != buffer_state::WAITING || !is_playable()) return;
+            state = buffer_state::READABLE;
+            readable.notify_all();
+        }
+
+        std::optional<std::pair<sikradio::common::msg_t, arrival_time>> optional_read() {
             if (state != buffer_state::READABLE)
                 return std::nullopt;
-            if (msg_vals.size() == 0 || !msg_vals.front().has_value())
+            if (msg_vals.size() == 0 || !msg_vals.front().has_value()) {
+                read_failed = true;
                 throw buffer_access_exception("Buffer is not readable during active session!");
-            auto ret = msg_vals.front();
-            msg_vals.pop_front();
-            msg_ids.pop_front();
-            return ret;
+            }
+            auto ret = std::make_pair(std::move(msg_vals.front().value()), msg_arrivals.front());
+            pop_front();
+            fill.store(msg_ids.size(), std::memory_order_relaxed);
+            return std::make_optional(std::move(ret));
         }
 
     public:
         buffer() = delete;
         buffer(const buffer& other) = delete;
         buffer(buffer&& other) = delete;
-        explicit buffer(size_t max_size) : max_size{max_size} {}
+        explicit buffer(size_t max_size) : max_size{max_size}, repair_latency_us{nullptr} {}
 
+        buffer(
+                size_t max_size, 
+                std::optional<double> target_underrun_probability,
+                sikradio::common::metrics::histogram* repair_latency_us = nullptr) : 
+                max_size{max_size},
+                repair_latency_us{repair_latency_us} {
+            if (target_underrun_probability.has_value())
+                estimator.emplace(target_underrun_probability.value());
+        }
+
+        // arrival is the time when message was read from the socket
         std::set<sikradio::common::msg_id_t>
-        write_get_missed(const sikradio::common::data_msg &msg) {
-            std::scoped_lock{mut};
+        write_get_missed(
+                const sikradio::common::data_msg &msg, 
+                arrival_time arrival = std::chrono::steady_clock::now()) {
+            std::scoped_lock lock{mut};
             // update session and state if necessary
             if (state == buffer_state::NO_SESSION) {
                 byte_zero = msg.get_id();
@@ -90,49 +282,172 @@ namespace sikradio::receiver {
                 max_elements = max_size / package_size;
                 state = buffer_state::WAITING;
             }
-            if (msg.get_id() >= byte_zero + max_elements*package_size*3/4) {
-                state = buffer_state::READABLE;
-            }
             // save message to buffer
             if (msg.get_id() % package_size != 0) 
                 throw buffer_access_exception("Id=" + std::to_string(msg.get_id()) + "must be divisible by package size=" + std::to_string(package_size));
             if (msg_ids.empty() || msg.get_id() > msg_ids.back()) {
-                save_new_message(msg);
+                save_new_message(msg, arrival);
+                drop_old_rexmit_requests();
             } else if (msg_ids.front() <= msg.get_id() && msg.get_id() <= msg_ids.back()) {
-                save_missed_message(msg);
+                save_missed_message(msg, arrival);
             } else {
                 // received message is so old that it will be ignored
+                late_count.fetch_add(1, std::memory_order_relaxed);
             }
             // extract ids that were missed between last saved message and this one
             std::set<sikradio::common::msg_id_t> missed_ids;
             for (auto id = std::max(max_msg_id + package_size, msg_ids.front()); 
                     id < std::min(msg.get_id(), msg_ids.back()); 
                     id += package_size) {
-                if (!msg_vals[id].has_value()) {
+                if (!msg_vals[(id - msg_ids.front()) / package_size].has_value()) {
                     missed_ids.emplace(id);
                 }
             }
-            max_msg_id = msg.get_id();
+            // missed messages may be recovered from already received parity
+            if (!parities.empty()) {
+                drop_old_parities();
+                std::set<sikradio::common::msg_id_t> groups;
+                for (auto id : missed_ids) {
+                    for (auto group : parity_groups_of(id)) groups.insert(group);
+                }
+                for (auto group : parity_groups_of(msg.get_id())) groups.insert(group);
+                for (auto id : recover_groups(std::move(groups))) missed_ids.erase(id);
+            }
+            if (estimator.has_value()) {
+                for (auto id : missed_ids)
+                    estimator.value().register_missed(id, arrival);
+                estimator.value().register_arrival(msg.get_id(), package_size, missed_ids.size(), arrival);
+            }
+            max_msg_id = std::max(max_msg_id, msg.get_id());
+            // places of messages older than the first one are missing until catch up burst fills them
+            if (session_start.has_value()) {
+                missed_ids.merge(prepend_missing(session_start.value()));
+                session_start.reset();
+            }
+            update_readable();
+            fill.store(msg_ids.size(), std::memory_order_relaxed);
             return missed_ids;
         }
 
+        // stores parity message, returns ids of messages that were reconstructed with it
+        std::set<sikradio::common::msg_id_t>
+        write_parity_get_recovered(const sikradio::common::fec_msg &msg) {
+            std::scoped_lock lock{mut};
+            if (state == buffer_state::NO_SESSION || msg_ids.empty()) return {};
+            if (msg.get_first_id() < msg_ids.front() || msg.get_first_id() % package_size != 0)
+                return {};
+
+            if (msg.get_count() == 0 || msg.get_stride() == 0 || msg.get_parity().size() != package_size) 
+                return {};
+
+            parities.insert_or_assign(msg.get_first_id(), msg);
+            max_parity_span = std::max(max_parity_span, msg.protected_id(msg.get_count() - 1) - msg.get_first_id());
+            auto recovered_ids = recover_groups({msg.get_first_id()});
+            if (!recovered_ids.empty()) update_readable();
+            return recovered_ids;
+        }
+
         std::optional<sikradio::common::msg_t> try_read() {
-            std::scoped_lock{mut};
+            auto ret = try_read_timed();
+            if (!ret.has_value()) return std::nullopt;
+            return std::make_optional(std::move(ret.value().first));
+        }
+
+        // returns message together with the time when it was received or recovered
+        std::optional<std::pair<sikradio::common::msg_t, arrival_time>> try_read_timed() {
+            std::scoped_lock lock{mut};
             return optional_read();
         }
 
+        // waits until buffer becomes readable, at most for timeout, returns false if it did not,
+        // buffer that failed to be read is not readable until it is reset for a new session
+        bool wait_readable(std::chrono::milliseconds timeout) {
+            std::unique_lock lock{mut};
+            return readable.wait_for(lock, timeout, [this]() {
+                return state == buffer_state::READABLE && !read_failed;
+            });
+        }
+
+        // marks missed messages as requested, repair latency is measured from the first request
+        void register_rexmit_request(
+                const std::set<sikradio::common::msg_id_t>& ids,
+                arrival_time now = std::chrono::steady_clock::now()) {
+            std::scoped_lock lock{mut};
+            if (state == buffer_state::NO_SESSION) return;
+            for (auto id : ids) {
+                auto pos = position_of(id);
+                if (pos.has_value() && !msg_vals[pos.value()].has_value())
+                    rexmit_requests.emplace(id, now);
+            }
+        }
+
+        // makes the session start at given id instead of the first received message, so that messages
+        // older than the live stream (sent in a catch up burst) fit in the buffer, it has effect only
+        // before playback starts, returns ids that became missing
+        std::set<sikradio::common::msg_id_t> start_session_at(sikradio::common::msg_id_t first_id) {
+            std::scoped_lock lock{mut};
+            if (state == buffer_state::NO_SESSION) {
+                session_start = first_id;
+                return {};
+            }
+            if (state != buffer_state::WAITING) return {};
+            auto prepended = prepend_missing(first_id);
+            fill.store(msg_ids.size(), std::memory_order_relaxed);
+            return prepended;
+        }
+
         bool has_space_for(const sikradio::common::msg_id_t id) {
-            std::scoped_lock{mut};
+            std::scoped_lock lock{mut};
             bool is_in_session = (state != buffer_state::NO_SESSION);
-            bool has_space = (msg_ids.front() <= id && id <= msg_ids.back());
-            return (is_in_session && has_space);
+            return (is_in_session && position_of(id).has_value());
+        }
+
+        // true if message belongs to the buffer but was not received (nor recovered) yet
+        bool is_missing(const sikradio::common::msg_id_t id) {
+            std::scoped_lock lock{mut};
+            if (state == buffer_state::NO_SESSION) return false;
+            auto pos = position_of(id);
+            return (pos.has_value() && !msg_vals[pos.value()].has_value());
+        }
+
+        // size of audio in messages of current session, nothing before its first message is written
+        std::optional<size_t> get_package_size() {
+            std::scoped_lock lock{mut};
+            if (state == buffer_state::NO_SESSION) return std::nullopt;
+            return package_size;
+        }
+
+        // messages that were received again after being received or recovered
+        uint64_t get_duplicate_count() const {
+            return duplicate_count.load(std::memory_order_relaxed);
+        }
+
+        // messages that arrived after their place in the buffer was already read or dropped
+        uint64_t get_late_count() const {
+            return late_count.load(std::memory_order_relaxed);
+        }
+
+        // number of places in the buffer, including ones reserved for missed messages
+        size_t get_fill() const {
+            return fill.load(std::memory_order_relaxed);
         }
 
         void reset() {
-            std::scoped_lock{mut};
+            std::scoped_lock lock{mut};
             state = buffer_state::NO_SESSION;
+            session_start.reset();
+            started_early = false;
+            read_failed = false;
             msg_ids.clear();
             msg_vals.clear();
+            msg_arrivals.clear();
+            rexmit_requests.clear();
+            parities.clear();
+            max_parity_span = 0;
+            fill.store(0, std::memory_order_relaxed);
+            // statistics are kept, they describe the link rather than the session
+            if (estimator.has_value())
+                estimator.value().reset_stream();
         }
     };
 }
@@ -0,0 +1,49 @@
+#ifndef SIKRADIO_RECEIVER_CHANGE_NOTIFIER_HPP
+#define SIKRADIO_RECEIVER_CHANGE_NOTIFIER_HPP
+
+#include <cstring>
+#include <cstdint>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "../common/exceptions.hpp"
+
+namespace sikradio::receiver {
+    // eventfd that can be waited on together with sockets, notifications are coalesced
+    class change_notifier {
+    private:
+        int fd{-1};
+
+    public:
+        change_notifier(const change_notifier& other) = delete;
+        change_notifier(change_notifier&& other) = delete;
+
+        change_notifier() {
+            fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (fd < 0) throw sikradio::common::exceptions::socket_exception(strerror(errno));
+        }
+
+        void notify() {
+            uint64_t one = 1;
+            // counter overflow means reader was already notified, so result is ignored
+            (void)write(fd, &one, sizeof(one));
+        }
+
+        // returns true if there was a notification since last call
+        bool consume() {
+            uint64_t count = 0;
+            ssize_t len = read(fd, &count, sizeof(count));
+            return (len == sizeof(count) && count > 0);
+        }
+
+        int get_fd() const {
+            return fd;
+        }
+
+        ~change_notifier() {
+            if (fd >= 0) close(fd);
+        }
+    };
+}
+
+#endif
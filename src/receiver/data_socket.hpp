@@ -10,8 +10,11 @@
 #include <mutex>
 #include <string>
 #include <optional>
+#include <memory>
+#include <iostream>
 
 #include "../common/exceptions.hpp"
+#include "../common/transport.hpp"
 #include "../common/address_helpers.hpp"
 #include "../common/data_msg.hpp"
 #include "structures.hpp"
@@ -26,69 +29,75 @@ namespace sikradio::receiver {
     class data_socket {
     private:
         std::mutex mut{};
+        std::shared_ptr<sikradio::common::transport> transport;
         sikradio::receiver::structures::station connected_station;
         sikradio::common::byte_t buffer[UDP_DATAGRAM_DATA_LEN_MAX];
         int timeout_in_ms;
-        int sock = -1;
-
-        void close_and_throw() {
-            close(sock);
-            throw socket_exception(strerror(errno));
-        }
+        int busy_poll_in_us;
+        // replaced on reconnect while reads may be in progress, so it is accessed atomically
+        std::shared_ptr<sikradio::common::datagram_socket> sock{nullptr};
 
     public:
-        data_socket() : timeout_in_ms{5000} {};
+        data_socket() : transport{sikradio::common::default_transport()}, timeout_in_ms{5000}, busy_poll_in_us{0} {};
         data_socket(const data_socket& other) = delete;
         data_socket(data_socket&& other) = delete;
-        explicit data_socket(int socket_timeout_in_ms) : 
-            timeout_in_ms{socket_timeout_in_ms} {}
+        explicit data_socket(
+                int socket_timeout_in_ms, 
+                std::shared_ptr<sikradio::common::transport> transport=sikradio::common::default_transport(),
+                int busy_poll_in_us=0) : 
+            transport{std::move(transport)},
+            timeout_in_ms{socket_timeout_in_ms},
+            busy_poll_in_us{busy_poll_in_us} {}
 
         void connect(const sikradio::receiver::structures::station new_station) {
-            std::scoped_lock{mut};
+            std::scoped_lock lock{mut};
             if (new_station == connected_station) return;
-            // if socket was opened, reconnect
-            if (sock >= 0) close(sock);
-            sock = socket(AF_INET, SOCK_DGRAM, 0);
-            if (sock < 0) throw socket_exception(strerror(errno));
+            // if socket was opened, it is closed when replaced
+            std::shared_ptr<sikradio::common::datagram_socket> new_sock{transport->open_datagram()};
             // subscribe to multicast address
             struct sockaddr_in new_addr = sikradio::common::make_address(
                 new_station.data_address, 
                 new_station.data_port);
-            struct ip_mreq req;
-            req.imr_multiaddr = new_addr.sin_addr;
-            int err = setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, (void*)&req, sizeof(req));
-            if (err < 0) close_and_throw();
-            // set timeout to 1 second to prevent deadlocks (possible with optional returns)
-            struct timeval tv{ .tv_sec = 0, .tv_usec = 1000*timeout_in_ms};
-            err = setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
-            if (err < 0) close_and_throw();
+            new_sock->join_group(new_addr.sin_addr);
+            // allow multiple receivers on the same machine
+            new_sock->enable_reuse_address();
+            // set timeout to prevent deadlocks (possible with optional returns)
+            new_sock->set_receive_timeout(timeout_in_ms);
+            if (busy_poll_in_us > 0) {
+                try {
+                    new_sock->set_busy_poll(busy_poll_in_us);
+                } catch (socket_exception &e) {
+                    // raising busy poll time above the system default requires CAP_NET_ADMIN
+                    std::cerr << "Busy polling disabled: " << e.what() << std::endl;
+                    busy_poll_in_us = 0;
+                }
+            }
             // bind socket to new address
-            err = bind(sock, (struct sockaddr*)&new_addr, sizeof(new_addr));
-            if (err < 0) close_and_throw();
+            new_sock->bind(new_addr);
+            std::atomic_store(&sock, new_sock);
             connected_station = new_station;
         }
 
         std::optional<sikradio::common::data_msg> try_read() {
-            if (sock == -1) return std::nullopt;
+            auto raw_msg = try_read_raw();
+            if (!raw_msg.has_value()) return std::nullopt;
+            return std::make_optional(sikradio::common::data_msg(raw_msg.value()));
+        }
 
-            memset(buffer, 0, UDP_DATAGRAM_DATA_LEN_MAX);
-            ssize_t len = read(sock, &buffer, sizeof(buffer));
-            if (len < 0) {
-                if (errno == EAGAIN || errno == EWOULDBLOCK) {  
-                    // timeout reached, this is not really an error
-                    errno = 0;
-                    return std::nullopt;
-                } else {
-                    throw socket_exception(strerror(errno));
-                }
-            }
+        std::optional<sikradio::common::msg_t> try_read_raw() {
+            auto current_sock = std::atomic_load(&sock);
+            if (!current_sock) return std::nullopt;
+
+            auto len = current_sock->receive(buffer, sizeof(buffer));
+            // timeout reached, this is not really an error
+            if (!len.has_value()) return std::nullopt;
             sikradio::common::msg_t raw_msg;
-            raw_msg.assign(buffer, buffer+len);
-            return std::make_optional(sikradio::common::data_msg(raw_msg));
+            raw_msg.assign(buffer, buffer+len.value());
+            return std::make_optional(raw_msg);
         }
 
-        ~data_socket() {
-            if (sock >= 0) close(sock);
+        bool is_connected() const {
+            return (std::atomic_load(&sock) != nullptr);
         }
     };
 }
@@ -0,0 +1,150 @@
+#ifndef SIKRADIO_RECEIVER_JITTER_ESTIMATOR_HPP
+#define SIKRADIO_RECEIVER_JITTER_ESTIMATOR_HPP
+
+#include <map>
+#include <cmath>
+#include <chrono>
+#include <optional>
+#include <algorithm>
+
+#include "../common/types.hpp"
+
+namespace sikradio::receiver {
+    namespace {
+        // number of in-order arrivals required before the estimate is trusted
+        const size_t estimator_warmup_samples = 32;
+        // smoothing factors, jitter uses the same gain as RFC 3550
+        const double interval_gain = 1.0 / 64;
+        const double jitter_gain = 1.0 / 16;
+        const double loss_gain = 1.0 / 256;
+        const double repair_gain = 1.0 / 8;
+        // ratio of standard deviation to mean absolute deviation for normal distribution
+        const double mad_to_stddev = 1.2533;
+        // always keep a few packets in the buffer to absorb scheduling noise
+        const size_t min_playout_elements = 2;
+        // upper bound for repairs that are tracked at the same time
+        const size_t max_pending_repairs = 4096;
+
+        // upper tail quantile of standard normal distribution (Abramowitz-Stegun 26.2.23)
+        double normal_quantile(double tail_probability) {
+            double p = std::clamp(tail_probability, 1e-12, 0.5);
+            double t = std::sqrt(-2.0 * std::log(p));
+            double num = 2.515517 + 0.802853*t + 0.010328*t*t;
+            double den = 1.0 + 1.432788*t + 0.189269*t*t + 0.001308*t*t*t;
+            return t - num / den;
+        }
+    }
+
+    class jitter_estimator {
+    private:
+        using clock = std::chrono::steady_clock;
+
+        double underrun_probability;
+        double z_score;
+        // statistics, all durations in microseconds
+        double interval_us{0};
+        double jitter_us{0};
+        double loss_rate{0};
+        double repair_us{0};
+        double repair_dev_us{0};
+        size_t samples{0};
+        bool has_repair_sample{false};
+        // stream state, forgotten when session changes
+        std::optional<clock::time_point> last_arrival{std::nullopt};
+        sikradio::common::msg_id_t last_id{0};
+        std::map<sikradio::common::msg_id_t, clock::time_point> pending_repairs{};
+
+        static double to_us(clock::duration d) {
+            return std::chrono::duration<double, std::micro>(d).count();
+        }
+
+    public:
+        jitter_estimator() = delete;
+
+        explicit jitter_estimator(double target_underrun_probability) :
+            underrun_probability{target_underrun_probability},
+            z_score{normal_quantile(target_underrun_probability)} {}
+
+        void register_arrival(
+                sikradio::common::msg_id_t id,
+                size_t package_size,
+                size_t missed_packages,
+                clock::time_point now = clock::now()) {
+            for (size_t i = 0; i < missed_packages; i++)
+                loss_rate += loss_gain * (1.0 - loss_rate);
+            loss_rate -= loss_gain * loss_rate;
+
+            if (last_arrival.has_value() && id > last_id && package_size > 0) {
+                double packages = static_cast<double>((id - last_id) / package_size);
+                double delta_us = to_us(now - last_arrival.value());
+                double sample_us = delta_us / packages;
+                if (samples == 0) interval_us = sample_us;
+                else interval_us += interval_gain * (sample_us - interval_us);
+                // deviation of actual arrival from the one expected from mean rate
+                double deviation_us = std::abs(delta_us - packages * interval_us);
+                jitter_us += jitter_gain * (deviation_us - jitter_us);
+                samples++;
+            }
+            if (!last_arrival.has_value() || id > last_id) {
+                last_arrival = now;
+                last_id = id;
+            }
+        }
+
+        void register_missed(
+                sikradio::common::msg_id_t id,
+                clock::time_point now = clock::now()) {
+            if (pending_repairs.size() >= max_pending_repairs)
+                pending_repairs.erase(pending_repairs.begin());
+            pending_repairs.emplace(id, now);
+        }
+
+        void register_repair(
+                sikradio::common::msg_id_t id,
+                clock::time_point now = clock::now()) {
+            auto it = pending_repairs.find(id);
+            if (it == pending_repairs.end()) return;
+
+            double sample_us = to_us(now - it->second);
+            pending_repairs.erase(it);
+            if (!has_repair_sample) {
+                repair_us = sample_us;
+                repair_dev_us = sample_us / 2;
+                has_repair_sample = true;
+                return;
+            }
+            repair_dev_us += repair_gain * (std::abs(sample_us - repair_us) - repair_dev_us);
+            repair_us += repair_gain * (sample_us - repair_us);
+        }
+
+        void reset_stream() {
+            last_arrival = std::nullopt;
+            last_id = 0;
+            pending_repairs.clear();
+        }
+
+        // number of buffered packages needed to meet target underrun probability,
+        // std::nullopt until enough data was observed to make the estimate
+        std::optional<size_t> target_elements(size_t max_elements) const {
+            if (samples < estimator_warmup_samples || interval_us <= 0)
+                return std::nullopt;
+
+            double required_us = z_score * mad_to_stddev * jitter_us;
+            if (loss_rate > underrun_probability && has_repair_sample) {
+                // lost packages have to be repaired before they are played
+                required_us += repair_us + z_score * mad_to_stddev * repair_dev_us;
+            }
+            auto elements = min_playout_elements
+                + static_cast<size_t>(std::ceil(required_us / interval_us));
+            size_t upper_bound = (max_elements > 1) ? max_elements - 1 : 1;
+            return std::clamp(elements, std::min(min_playout_elements, upper_bound), upper_bound);
+        }
+
+        double get_interval_us() const { return interval_us; }
+        double get_jitter_us() const { return jitter_us; }
+        double get_loss_rate() const { return loss_rate; }
+        double get_repair_us() const { return repair_us; }
+    };
+}
+
+#endif
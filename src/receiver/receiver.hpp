@@ -10,39 +10,105 @@
 #include <csignal>
 #include <iostream>
 #include <algorithm>
+#include <memory>
+#include <climits>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+#include <set>
+#include <string>
 
 #include "../common/ctrl_socket.hpp"
 #include "../common/ctrl_msg.hpp"
 #include "../common/address_helpers.hpp"
+#include "../common/fec_msg.hpp"
+#include "../common/metrics.hpp"
+#include "../common/stats_server.hpp"
+#include "../common/transport.hpp"
+#include "../common/realtime.hpp"
+#include "../common/pcm_codec.hpp"
 #include "buffer.hpp"
 #include "data_socket.hpp"
 #include "station_set.hpp"
 #include "rexmit_manager.hpp"
 #include "state_manager.hpp"
 #include "ui_manager.hpp"
+#include "change_notifier.hpp"
+#include "timeshift.hpp"
 
 namespace sikradio::receiver {
     namespace {
         // parameters for tuning performance for computers with lower multithreading capabilities
         const auto reset_check_freq = std::chrono::milliseconds(20);
+        // upper bound for data streamer sleep, it is woken up when buffer becomes readable
+        const auto readable_wait = std::chrono::milliseconds(100);
         const auto rexmit_check_freq = std::chrono::milliseconds(10);
         const auto lookup_freq = std::chrono::seconds(5);
+        // upper bound for ui handler sleep, in case of clock changes
+        const std::chrono::milliseconds::rep ui_max_wait_in_ms = 5000;
         // timeout applies to all receiver sockets
         const int socket_timeout_in_ms = 500; // has to be smaller than 1000 (1s)  TODO: Split in setsockopt
+        // shifted playback catches up with live stream by playing at most this many times faster
+        const size_t timeshift_catch_up_speed = 2;
     }
 
+    // threads that can be pinned to a cpu in realtime mode
+    const std::set<std::string> realtime_roles{"data_receiver", "data_streamer"};
+
     class receiver {
     private:
         std::string discover_addr;
         in_port_t ctrl_port;
+        in_port_t fec_port;
+        size_t bsize;
+        bool fast_start;
+        bool multicast_nacks;
+        sikradio::common::realtime_config realtime;
+        // receiver metrics, counters are updated from the hot path without locking
+        sikradio::common::metrics::registry metrics{};
+        sikradio::common::metrics::histogram& playout_latency_us;
+        sikradio::common::metrics::histogram& repair_latency_us;
+        sikradio::common::metrics::histogram& interarrival_us;
         sikradio::receiver::buffer buffer;
         sikradio::receiver::data_socket data_socket;
+        sikradio::receiver::data_socket fec_socket;
+        sikradio::receiver::data_socket nack_socket;
         sikradio::common::ctrl_socket ctrl_socket;
+        sikradio::receiver::change_notifier ui_notifier;
         sikradio::receiver::station_set station_set;
         sikradio::receiver::rexmit_manager rexmit_manager;
         sikradio::receiver::state_manager state_manager;
         sikradio::receiver::ui_manager ui_manager;
         std::mutex data_mut{};
+        sikradio::common::metrics::counter& packets_received;
+        sikradio::common::metrics::counter& bytes_received;
+        sikradio::common::metrics::counter& parity_received;
+        sikradio::common::metrics::counter& fec_recovered;
+        sikradio::common::metrics::counter& gaps;
+        sikradio::common::metrics::counter& rexmit_requests_sent;
+        sikradio::common::metrics::counter& rexmit_ids_requested;
+        sikradio::common::metrics::counter& rexmit_ids_suppressed;
+        sikradio::common::metrics::counter& underruns;
+        sikradio::common::metrics::counter& playback_resets;
+        sikradio::common::metrics::counter& fast_starts;
+        sikradio::common::metrics::counter& unicast_repairs;
+        std::optional<sikradio::common::stats_server> stats_server{std::nullopt};
+        std::shared_ptr<sikradio::receiver::timeshift> timeshift;
+
+        void register_probes() {
+            metrics.register_probe("buffer_fill", [this]() {
+                return static_cast<double>(buffer.get_fill());
+            });
+            metrics.register_probe("duplicates", [this]() {
+                return static_cast<double>(buffer.get_duplicate_count());
+            });
+            metrics.register_probe("late_packets", [this]() {
+                return static_cast<double>(buffer.get_late_count());
+            });
+            metrics.register_probe("timeshift_delay_bytes", [this]() {
+                return timeshift ? static_cast<double>(timeshift->get_delay()) : 0.0;
+            });
+        }
 
         void run_playback_resetter() {  // LOCKS: 1 or 3
             std::optional<sikradio::receiver::structures::station> station;
@@ -50,25 +116,64 @@ namespace sikradio::receiver {
             while (true) {
                 std::tie(station, dirty) = state_manager.check_state();
                 if (dirty) {  // reset playback
-                    std::scoped_lock{data_mut};  // stops data_receiver
+                    // data_receiver does not write to the buffer until playback is reset
+                    std::scoped_lock lock{data_mut};
+                    playback_resets.add();
                     buffer.reset();
                     rexmit_manager.reset();
                     if (station.has_value())
                         data_socket.connect(station.value());
+                    if (station.has_value() && fast_start) {
+                        // sender bursts recent audio, so that playback does not wait for the buffer
+                        // to be filled by live stream
+                        auto addr = sikradio::common::make_address(
+                            station.value().ctrl_address, station.value().ctrl_port);
+                        ctrl_socket.force_send_to(addr, sikradio::common::make_catch_up(bsize*3/4));
+                    }
+                    if (station.has_value() && multicast_nacks) {
+                        // requests are sent to the data group, on the control port
+                        auto nack_station = station.value();
+                        nack_station.data_port = station.value().ctrl_port;
+                        nack_socket.connect(nack_station);
+                    }
+                    if (station.has_value() && fec_port != 0) {
+                        // parity is sent to the same group, on a separate port
+                        auto fec_station = station.value();
+                        fec_station.data_port = fec_port;
+                        fec_socket.connect(fec_station);
+                    }
                 }
                 std::this_thread::sleep_for(reset_check_freq);
             }
         }
 
+        bool is_selected_station(const struct sockaddr_in& sender_addr) {
+            auto current_station = station_set.get_selected();
+            if (!current_station.has_value()) return false;
+            auto station_addr = sikradio::common::make_address(
+                current_station.value().ctrl_address, current_station.value().ctrl_port);
+            return (station_addr.sin_addr.s_addr == sender_addr.sin_addr.s_addr
+                && station_addr.sin_port == sender_addr.sin_port);
+        }
+
         void run_ctrl_receiver() {  // LOCKS: 0 or 2
             sikradio::common::ctrl_msg msg;
             struct sockaddr_in sender_addr;
+            // retransmissions sent directly to this receiver come through the control socket
+            sikradio::common::pcm_codec codec{};
             while (true) {
                 auto rcv = ctrl_socket.try_read();
                 if (!rcv.has_value()) continue;
                 
                 std::tie(msg, sender_addr) = rcv.value();
-                if (!msg.is_reply()) continue;
+                if (msg.is_catch_up_reply()) {
+                    handle_catch_up_reply(msg, sender_addr);
+                    continue;
+                }
+                if (!msg.is_reply()) {
+                    if (is_selected_station(sender_addr)) handle_unicast_repair(msg, codec);
+                    continue;
+                }
                 
                 auto station = sikradio::receiver::structures::as_station(msg, sender_addr);
                 auto new_selected = station_set.update_get_selected(station);
@@ -78,6 +183,56 @@ namespace sikradio::receiver {
             }
         }
 
+        // buffer starts from the first packet of the burst, packets of the burst that do not arrive
+        // in time are requested like other missed packets
+        void handle_catch_up_reply(const sikradio::common::ctrl_msg& msg, const struct sockaddr_in& sender_addr) {
+            if (!fast_start || !is_selected_station(sender_addr)) return;
+            sikradio::common::msg_id_t session_id;
+            sikradio::common::msg_id_t first;
+            try {
+                std::tie(session_id, first, std::ignore) = msg.get_catch_up_reply_data();
+            } catch (sikradio::common::exceptions::ctrl_msg_exception &e) {
+                return;
+            }
+            // buffer was reset for this station, so its session does not have to reset it again
+            state_manager.expect_session(session_id);
+            auto missing_ids = buffer.start_session_at(first);
+            fast_starts.add();
+            if (!missing_ids.empty()) {
+                gaps.add(missing_ids.size());
+                rexmit_manager.append_ids(missing_ids);
+            }
+        }
+
+        // data message that was requested only by this receiver (or a few of them), other than control
+        // messages, selected station sends only these from its control port,
+        // repair is accepted only for the session and package size known from the data stream
+        void handle_unicast_repair(const sikradio::common::ctrl_msg& raw_msg, sikradio::common::pcm_codec& codec) {
+            auto psize = buffer.get_package_size();
+            if (!psize.has_value()) return;
+            auto raw = raw_msg.sendable();
+            // compressed audio is always smaller than raw
+            auto header_size = 2*sizeof(sikradio::common::msg_id_t);
+            if (raw.size() <= header_size || raw.size() > header_size + psize.value()) return;
+            auto arrival = std::chrono::steady_clock::now();
+            std::optional<sikradio::common::data_msg> msg;
+            try {
+                msg.emplace(sikradio::common::msg_t(raw.begin(), raw.end()));
+                if (!state_manager.is_current_session(msg.value().get_session_id())) return;
+                msg = codec.decode(std::move(msg.value()));
+            } catch (sikradio::common::exceptions::data_msg_exception &e) {
+                return;
+            }
+            if (msg.value().get_data().size() != psize.value()) return;
+            unicast_repairs.add();
+            try {
+                // repaired message is older than the newest one, so nothing new can be missed
+                (void)buffer.write_get_missed(msg.value(), arrival);
+            } catch (sikradio::receiver::exceptions::buffer_access_exception &e) {
+                // ignore
+            }
+        }
+
         void run_lookup_sender() {  // LOCKS: 1
             while (true) {
                 auto msg = sikradio::common::make_lookup();
@@ -97,7 +252,8 @@ namespace sikradio::receiver {
                 ids_to_rexmit = rexmit_manager.filter_get_ids(ids_to_forget);
                 ids_to_forget.clear();
                 for (auto it = ids_to_rexmit.begin(); it != ids_to_rexmit.end();) {
-                    if (!buffer.has_space_for(*it)) {
+                    // message could have been retransmitted or recovered in the meantime
+                    if (!buffer.is_missing(*it)) {
                         ids_to_forget.emplace(*it);
                         it = ids_to_rexmit.erase(it);
                     } else {
@@ -110,77 +266,207 @@ namespace sikradio::receiver {
                 auto current_station = station_set.get_selected();
                 if (!current_station.has_value()) continue;
                 
+                // multicast requests reach the sender and other receivers of the station
                 auto addr = sikradio::common::make_address(
-                    current_station.value().ctrl_address,
+                    multicast_nacks ? current_station.value().data_address : current_station.value().ctrl_address,
                     current_station.value().ctrl_port
                 );
                 ctrl_socket.send_to(addr, msg);
+                buffer.register_rexmit_request(ids_to_rexmit);
+                rexmit_requests_sent.add();
+                rexmit_ids_requested.add(ids_to_rexmit.size());
+            }
+        }
+
+        // requests of other receivers postpone the same requests of this one, as retransmission
+        // is sent to the data group and reaches all of them
+        void run_nack_receiver() {
+            while (true) {
+                if (!nack_socket.is_connected()) {
+                    std::this_thread::sleep_for(reset_check_freq);
+                    continue;
+                }
+                auto raw_msg = nack_socket.try_read_raw();
+                if (!raw_msg.has_value()) continue;
+                sikradio::common::ctrl_msg msg{std::string(raw_msg.value().begin(), raw_msg.value().end())};
+                if (!msg.is_rexmit()) continue;
+                auto ids = msg.get_rexmit_ids();
+                rexmit_ids_suppressed.add(
+                    rexmit_manager.postpone_ids(std::set<sikradio::common::msg_id_t>(ids.begin(), ids.end())));
             }
         }
 
         void run_data_receiver() {  // LOCKS: 1-4
+            sikradio::common::enter_role(realtime, "data_receiver");
             std::set<sikradio::common::msg_id_t> missed_ids;
+            std::optional<sikradio::receiver::arrival_time> last_arrival;
+            // compressed messages are decoded here, so buffer and fec only ever see raw audio
+            sikradio::common::pcm_codec codec{};
             while (true) {
-                std::scoped_lock{data_mut};
-
                 auto msg = data_socket.try_read();
                 if (!msg.has_value()) continue;
+                // lock is not held while waiting for data, so that reset does not wait for timeout
+                std::scoped_lock lock{data_mut};
+                auto arrival = std::chrono::steady_clock::now();
+                if (last_arrival.has_value())
+                    interarrival_us.record(to_us(arrival - last_arrival.value()));
+                last_arrival = arrival;
 
                 auto msg_session_id = msg.value().get_session_id();
                 auto ignore_msg = state_manager.register_session_check_ignore(msg_session_id);
                 if (ignore_msg) continue;
 
+                packets_received.add();
+                bytes_received.add(msg.value().get_data().size());
+                try {
+                    msg = codec.decode(std::move(msg.value()));
+                } catch (sikradio::common::exceptions::data_msg_exception &e) {
+                    // malformed message is treated as lost
+                    continue;
+                }
                 try {
-                    missed_ids = buffer.write_get_missed(msg.value());
+                    missed_ids = buffer.write_get_missed(msg.value(), arrival);
                 } catch (sikradio::receiver::exceptions::buffer_access_exception &e) {
                     state_manager.mark_dirty();
                     missed_ids.clear();
                 }
-                if (!missed_ids.empty())
+                if (!missed_ids.empty()) {
+                    gaps.add(missed_ids.size());
                     rexmit_manager.append_ids(missed_ids);
+                }
                 missed_ids.clear();
             }
         }
 
+        void run_fec_receiver() {  // LOCKS: 1-2
+            while (true) {
+                auto raw_msg = fec_socket.try_read_raw();
+                if (!raw_msg.has_value()) {
+                    if (!fec_socket.is_connected())
+                        std::this_thread::sleep_for(reset_check_freq);
+                    continue;
+                }
+
+                std::optional<sikradio::common::fec_msg> msg;
+                try {
+                    msg.emplace(raw_msg.value());
+                } catch (sikradio::common::exceptions::data_msg_exception &e) {
+                    continue;
+                }
+                auto ignore_msg = state_manager.register_session_check_ignore(msg.value().get_session_id());
+                if (ignore_msg) continue;
+
+                parity_received.add();
+                fec_recovered.add(buffer.write_parity_get_recovered(msg.value()).size());
+            }
+        }
+
+        // writes recorded audio while standard output accepts it without blocking, so that
+        // slow consumer does not stop the streamer, which keeps recording live stream
+        void play_shifted(size_t max_len) {
+            std::cout.flush();
+            struct pollfd out{STDOUT_FILENO, POLLOUT, 0};
+            while (max_len > 0 && poll(&out, 1, 0) > 0 && (out.revents & POLLOUT)) {
+                // pipe that polls writable accepts PIPE_BUF bytes without blocking
+                auto [data, len] = timeshift->next_output(std::min<size_t>(max_len, PIPE_BUF));
+                if (len == 0) return;
+                // playback already moved past the chunk, so all of it is written (other outputs
+                // than pipes can accept less)
+                size_t done = 0;
+                while (done < len) {
+                    ssize_t written = write(STDOUT_FILENO, data + done, len - done);
+                    if (written < 0 && errno == EINTR) continue;
+                    if (written <= 0) return;
+                    done += written;
+                }
+                max_len -= done;
+            }
+        }
+
         void run_data_streamer() {  // LOCKS: 1-2
-            std::optional<sikradio::common::msg_t> read_msg = std::nullopt;
+            sikradio::common::enter_role(realtime, "data_streamer");
+            std::optional<std::pair<sikradio::common::msg_t, sikradio::receiver::arrival_time>> read_msg;
+            bool playing = false;
             while (true) {
+                // sleeps until playback can start, instead of polling the buffer
+                if (!buffer.wait_readable(readable_wait)) continue;
                 try {
-                    read_msg = buffer.try_read();
+                    read_msg = buffer.try_read_timed();
                 } catch (sikradio::receiver::exceptions::buffer_access_exception &e) {
+                    // next message was not received in time, counted once until playback restarts
+                    if (playing) underruns.add();
+                    playing = false;
                     state_manager.mark_dirty();
                     read_msg = std::nullopt;
                 }
-                if (read_msg.has_value())
-                    std::cout << std::string(read_msg.value().begin(), read_msg.value().end());
+                if (!read_msg.has_value()) continue;
+                playing = true;
+                const auto& data = read_msg.value().first;
+                if (!timeshift || timeshift->record(data.data(), data.size()))
+                    std::cout << std::string(data.begin(), data.end());
+                else
+                    play_shifted(timeshift_catch_up_speed*data.size());
+                playout_latency_us.record(to_us(std::chrono::steady_clock::now() - read_msg.value().second));
+            }
+        }
+
+        static uint64_t to_us(std::chrono::steady_clock::duration d) {
+            return static_cast<uint64_t>(std::max<std::chrono::microseconds::rep>(
+                std::chrono::duration_cast<std::chrono::microseconds>(d).count(), 0));
+        }
+
+        int ui_wait_timeout_in_ms() {
+            // nothing changes until a station expires, unless notifier wakes ui manager earlier
+            auto next_expiry = station_set.get_next_expiry();
+            if (!next_expiry.has_value()) return -1;
+            auto wait = std::chrono::ceil<std::chrono::milliseconds>(
+                next_expiry.value() - std::chrono::system_clock::now());
+            return static_cast<int>(std::clamp<std::chrono::milliseconds::rep>(
+                wait.count(), 0, ui_max_wait_in_ms));
+        }
+
+        void handle_update(menu_selection_update msu) {
+            switch (msu) {
+                case menu_selection_update::UP:
+                case menu_selection_update::DOWN:
+                    (void)station_set.select_get_selected(msu);
+                    break;
+                case menu_selection_update::PAUSE:
+                    if (timeshift) timeshift->toggle_pause();
+                    break;
+                case menu_selection_update::REWIND:
+                    if (timeshift) timeshift->rewind();
+                    break;
+                case menu_selection_update::LIVE:
+                    if (timeshift) timeshift->go_live();
+                    break;
             }
         }
 
         void run_ui_handler() {  // LOCKS: 4-5
             std::optional<sikradio::receiver::structures::menu_selection_update> enqueued_msu;
-            std::optional<sikradio::receiver::structures::station> new_selected;
-            std::vector<std::string> station_names;
+            std::optional<uint64_t> rendered_version;
             enqueued_msu = std::nullopt;
-            new_selected = std::nullopt;
+            rendered_version = std::nullopt;
             while (true) {
-                // if update is present, change station
+                // if update is present, change station or control timeshift
                 if (enqueued_msu.has_value())
-                    new_selected = station_set.select_get_selected(enqueued_msu.value());                
-                else
-                    new_selected = station_set.get_selected();
-                // register current state of station list in ui manager
-                if (new_selected.has_value()) {
-                    state_manager.register_address_check_change(new_selected.value());
-                    station_names = station_set.get_station_names();
-                    std::sort(station_names.begin(), station_names.end());
-                    ui_manager.send_menu(station_names, new_selected.value().name);
-                } else {
-                    state_manager.mark_dirty();
-                    station_names.clear();
-                    ui_manager.send_menu(station_names);
+                    handle_update(enqueued_msu.value());
+                // menu is rendered only when station list or selection changed
+                if (rendered_version != station_set.get_version()) {
+                    // station names in snapshot are already sorted
+                    auto snapshot = station_set.get_snapshot();
+                    if (snapshot.selected.has_value()) {
+                        state_manager.register_address_check_change(snapshot.selected.value());
+                        ui_manager.send_menu(*snapshot.names, snapshot.selected_position);
+                    } else {
+                        state_manager.mark_dirty();
+                        ui_manager.send_menu(std::vector<std::string>());
+                    }
+                    rendered_version = snapshot.version;
                 }
-                // get update from ui manager
-                enqueued_msu = ui_manager.get_update();
+                // sleep until key press, station list change or station expiry
+                enqueued_msu = ui_manager.get_update(ui_wait_timeout_in_ms());
             }
         }
 
@@ -194,28 +480,88 @@ namespace sikradio::receiver {
                  in_port_t ui_port, 
                  size_t bsize, 
                  size_t rtime, 
-                 std::optional<std::string> preferred_station) : 
+                 std::optional<std::string> preferred_station,
+                 std::optional<double> target_underrun_probability=std::nullopt,
+                 in_port_t fec_port=0,
+                 in_port_t stats_port=0,
+                 std::shared_ptr<sikradio::common::transport> transport=sikradio::common::default_transport(),
+                 sikradio::common::realtime_config realtime={},
+                 std::shared_ptr<sikradio::receiver::timeshift> timeshift=nullptr,
+                 bool fast_start=false,
+                 bool multicast_nacks=false) : 
             discover_addr{discover_addr},
             ctrl_port{ctrl_port},
-            buffer{bsize},
-            data_socket{socket_timeout_in_ms},
-            ctrl_socket{ctrl_port, socket_timeout_in_ms, true, false},
-            station_set{preferred_station},
-            rexmit_manager{rtime},
+            fec_port{fec_port},
+            bsize{bsize},
+            fast_start{fast_start},
+            multicast_nacks{multicast_nacks},
+            realtime{std::move(realtime)},
+            playout_latency_us{metrics.get_histogram("playout_latency_us")},
+            repair_latency_us{metrics.get_histogram("repair_latency_us")},
+            interarrival_us{metrics.get_histogram("interarrival_us")},
+            buffer{bsize, target_underrun_probability, &repair_latency_us},
+            data_socket{socket_timeout_in_ms, transport, this->realtime.busy_poll_in_us},
+            fec_socket{socket_timeout_in_ms, transport, this->realtime.busy_poll_in_us},
+            nack_socket{socket_timeout_in_ms, transport},
+            ctrl_socket{ctrl_port, socket_timeout_in_ms, true, false, transport},
+            ui_notifier{},
+            station_set{preferred_station, &ui_notifier},
+            // backoff spreads the first requests of receivers that missed the same message
+            rexmit_manager{
+                std::chrono::milliseconds(rtime), 
+                std::chrono::milliseconds(multicast_nacks ? rtime/2 : 0)},
             state_manager{},
-            ui_manager{ui_port, socket_timeout_in_ms},
-            data_mut{} {}
+            ui_manager{ui_port, socket_timeout_in_ms, &ui_notifier},
+            data_mut{},
+            packets_received{metrics.get_counter("packets_received")},
+            bytes_received{metrics.get_counter("bytes_received")},
+            parity_received{metrics.get_counter("parity_received")},
+            fec_recovered{metrics.get_counter("fec_recovered")},
+            gaps{metrics.get_counter("gaps")},
+            rexmit_requests_sent{metrics.get_counter("rexmit_requests_sent")},
+            rexmit_ids_requested{metrics.get_counter("rexmit_ids_requested")},
+            rexmit_ids_suppressed{metrics.get_counter("rexmit_ids_suppressed")},
+            underruns{metrics.get_counter("underruns")},
+            playback_resets{metrics.get_counter("playback_resets")},
+            fast_starts{metrics.get_counter("fast_starts")},
+            unicast_repairs{metrics.get_counter("unicast_repairs")},
+            timeshift{std::move(timeshift)} {
+            register_probes();
+            if (stats_port != 0)
+                stats_server.emplace(stats_port, metrics);
+        }
+
+        sikradio::common::metrics::registry& get_metrics() {
+            return metrics;
+        }
 
         void run() {
+            sikradio::common::lock_memory(realtime);
             std::thread resetter(&receiver::run_playback_resetter, this);
             std::thread ctrl_receiver(&receiver::run_ctrl_receiver, this);
             std::thread lookup_sender(&receiver::run_lookup_sender, this);
             std::thread rexmit_sender(&receiver::run_rexmit_sender, this);
             std::thread data_receiver(&receiver::run_data_receiver, this);
             std::thread ui_handler(&receiver::run_ui_handler, this);
+            std::optional<std::thread> fec_receiver;
+            if (fec_port != 0)
+                fec_receiver.emplace(&receiver::run_fec_receiver, this);
+            std::optional<std::thread> nack_receiver;
+            if (multicast_nacks)
+                nack_receiver.emplace(&receiver::run_nack_receiver, this);
+            std::optional<std::thread> stats_thread;
+            if (stats_server.has_value())
+                stats_thread.emplace(&sikradio::common::stats_server::run, &stats_server.value());
 
             run_data_streamer();
 
+            if (fec_receiver.has_value())
+                fec_receiver.value().join();
+            if (nack_receiver.has_value())
+                nack_receiver.value().join();
+            if (stats_thread.has_value())
+                stats_thread.value().join();
+
             ui_handler.join();
             data_receiver.join();
             lookup_sender.join();
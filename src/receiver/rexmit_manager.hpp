@@ -4,6 +4,7 @@
 #include <set>
 #include <mutex>
 #include <chrono>
+#include <random>
 
 #include "../common/types.hpp"
 
@@ -11,15 +12,19 @@ namespace sikradio::receiver {
     struct rexmit_id {
         sikradio::common::msg_id_t id;
         std::chrono::system_clock::time_point scheduled_update;
+        // whether this receiver has already requested the id
+        bool requested{false};
 
         explicit rexmit_id(sikradio::common::msg_id_t id) : 
             id{id}, scheduled_update{std::chrono::system_clock::now()} {}
 
         rexmit_id(
                 sikradio::common::msg_id_t id, 
-                std::chrono::system_clock::time_point scheduled_update) : 
+                std::chrono::system_clock::time_point scheduled_update,
+                bool requested=false) : 
             id{id}, 
-            scheduled_update{scheduled_update} {}
+            scheduled_update{scheduled_update},
+            requested{requested} {}
 
         bool operator>(const rexmit_id& other) const {return id > other.id;}
         bool operator>=(const rexmit_id& other) const {return id >= other.id;}
@@ -34,27 +39,58 @@ namespace sikradio::receiver {
         std::set<rexmit_id> rexmit_ids{};
         std::chrono::system_clock::time_point last_update = std::chrono::system_clock::now();
         std::chrono::system_clock::duration rtime;
+        std::chrono::system_clock::duration backoff;
+        std::mt19937_64 random_engine{std::random_device{}()};
+
+        // with backoff, receivers that missed the same message request it at different times,
+        // so that the first request can suppress the others
+        std::chrono::system_clock::time_point next_update(std::chrono::system_clock::time_point now) {
+            if (backoff.count() == 0) return now + rtime;
+            std::uniform_int_distribution<std::chrono::system_clock::rep> distribution{0, backoff.count()};
+            return now + rtime + std::chrono::system_clock::duration(distribution(random_engine));
+        }
 
     public:
         rexmit_manager() = delete;
         rexmit_manager(const rexmit_manager& other) = delete;
         rexmit_manager(rexmit_manager&& other) = delete;
         
-        explicit rexmit_manager(size_t rtime_seconds) : 
-            rtime{std::chrono::seconds(rtime_seconds)} {}
+        explicit rexmit_manager(
+                std::chrono::milliseconds rtime, 
+                std::chrono::milliseconds backoff=std::chrono::milliseconds(0)) : 
+            rtime{rtime},
+            backoff{backoff} {}
 
         void append_ids(const std::set<sikradio::common::msg_id_t>& new_ids) {
-            std::scoped_lock{mut};
+            std::scoped_lock lock{mut};
 
-            auto next_update = std::chrono::system_clock::now() + rtime;
+            auto now = std::chrono::system_clock::now();
             for (auto it = new_ids.begin(); it != new_ids.end(); it++) {
-                rexmit_ids.emplace(*it, next_update);
+                rexmit_ids.emplace(*it, next_update(now));
+            }
+        }
+
+        // ids requested by another receiver are not requested by this one until the retransmission
+        // had time to arrive, returns number of postponed ids
+        size_t postpone_ids(const std::set<sikradio::common::msg_id_t>& requested_ids) {
+            std::scoped_lock lock{mut};
+
+            size_t postponed = 0;
+            auto now = std::chrono::system_clock::now();
+            for (auto id : requested_ids) {
+                auto it = rexmit_ids.find(rexmit_id(id));
+                // ids requested by this receiver are followed by its own retries
+                if (it == rexmit_ids.end() || it->requested) continue;
+                it = rexmit_ids.erase(it);
+                rexmit_ids.emplace_hint(it, id, next_update(now));
+                postponed++;
             }
+            return postponed;
         }
 
         std::set<sikradio::common::msg_id_t> 
         filter_get_ids(std::set<sikradio::common::msg_id_t> ids_to_forget) {
-            std::scoped_lock{mut};
+            std::scoped_lock lock{mut};
             // remove ids to forget from rexmit ids
             for (auto it = ids_to_forget.begin(); it != ids_to_forget.end(); it++) {
                 rexmit_ids.erase(rexmit_id(*it));
@@ -62,7 +98,6 @@ namespace sikradio::receiver {
             // get ids scheduled to update between previous call and this one
             std::set<sikradio::common::msg_id_t> ids_to_update;
             auto this_update = std::chrono::system_clock::now();
-            auto next_update = this_update + rtime;
             for (auto it = rexmit_ids.begin(); it != rexmit_ids.end(); /* update in body */) {
                 if (it->scheduled_update > this_update) {
                     it++;
@@ -72,13 +107,13 @@ namespace sikradio::receiver {
                 auto id_to_rexmit = it->id;
                 it = rexmit_ids.erase(it);
                 ids_to_update.emplace(id_to_rexmit);
-                rexmit_ids.emplace_hint(it, id_to_rexmit, next_update);
+                rexmit_ids.emplace_hint(it, id_to_rexmit, next_update(this_update), true);
             }
             return ids_to_update;
         }
 
         void reset() {
-            std::scoped_lock{mut};
+            std::scoped_lock lock{mut};
             rexmit_ids.clear();
             last_update = std::chrono::system_clock::now();
         }
@@ -19,6 +19,11 @@ namespace sikradio::receiver {
         std::optional<station> active_station{std::nullopt};
         std::atomic_bool dirty{false};
         sikradio::common::msg_id_t session_id{0};
+        // playback is reset for a new station (not for a new session)
+        bool station_reset{false};
+        // playback was reset for a new station and no message was registered since,
+        // so its session does not need another reset
+        bool fresh{false};
 
     public:
         state_manager() = default;
@@ -26,37 +31,59 @@ namespace sikradio::receiver {
         state_manager(state_manager&& other) = delete;
 
         std::tuple<std::optional<station>, in_port_t> check_state() {
-            std::scoped_lock{mut};
+            std::scoped_lock lock{mut};
 
             bool was_dirty = dirty;
             dirty = false;
+            if (was_dirty) {
+                fresh = station_reset;
+                station_reset = false;
+            }
             return std::make_tuple(active_station, was_dirty);
         }
 
         bool register_address_check_change(station new_station) {
-            std::scoped_lock{mut};
+            std::scoped_lock lock{mut};
 
             if (!active_station.has_value() || active_station.value() != new_station) {
                 active_station = std::make_optional(new_station);
                 dirty = true;
+                station_reset = true;
             }
             return dirty;
         }
 
         bool register_session_check_ignore(sikradio::common::msg_id_t new_session_id) {
-            std::scoped_lock{mut};
+            std::scoped_lock lock{mut};
 
             if (new_session_id < session_id) return true;
+            bool was_fresh = fresh;
+            fresh = false;
             if (new_session_id == session_id) return false;
             session_id = new_session_id;
+            if (was_fresh && !dirty) return false;
             dirty = true;
             return true;
         }
 
+        // does not register anything, for messages that must not change the session
+        bool is_current_session(sikradio::common::msg_id_t msg_session_id) {
+            std::scoped_lock lock{mut};
+            return msg_session_id == session_id;
+        }
+
+        // registers session of the active station that playback was reset for, so that its first
+        // message does not reset playback again
+        void expect_session(sikradio::common::msg_id_t new_session_id) {
+            std::scoped_lock lock{mut};
+            session_id = std::max(session_id, new_session_id);
+        }
+
         void mark_dirty() {
-            std::scoped_lock{mut};
+            std::scoped_lock lock{mut};
             active_station = std::nullopt;
             dirty = true;
+            station_reset = true;
         }
     };
 }
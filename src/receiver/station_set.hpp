@@ -1,58 +1,155 @@
 #ifndef SIKRADIO_RECEIVER_STATION_SET_HPP
 #define SIKRADIO_RECEIVER_STATION_SET_HPP
 
-#include <set>
+#include <queue>
 #include <tuple>
 #include <string>
-#include <iterator>
+#include <vector>
+#include <memory>
 #include <chrono>
 #include <mutex>
 #include <optional>
+#include <algorithm>
+#include <functional>
+#include <unordered_map>
 
 #include "structures.hpp"
+#include "change_notifier.hpp"
 
 namespace sikradio::receiver {
     namespace {
         const size_t MAX_INACTIVE_SECONDS = 20;
         const std::string STATION_PREFIX = "    ";
         const std::string SELECTED_STATION_PREFIX = "  > ";
+        // stale expiry entries are dropped when heap grows over this many per station
+        const size_t expiry_heap_slack = 2;
     }
 
     using station = sikradio::receiver::structures::station;
     using menu_selection_update = sikradio::receiver::structures::menu_selection_update;
 
+    // stations are identified by name and control address of the sender
+    struct station_key {
+        std::string name;
+        std::string ctrl_address;
+
+        explicit station_key(const station& s) : name{s.name}, ctrl_address{s.ctrl_address} {}
+
+        bool operator<(const station_key& other) const {
+            return std::tie(name, ctrl_address) < std::tie(other.name, other.ctrl_address);
+        }
+        bool operator==(const station_key& other) const {
+            return name == other.name && ctrl_address == other.ctrl_address;
+        }
+        bool operator!=(const station_key& other) const {return !((*this) == other);}
+    };
+
+    struct station_key_hash {
+        size_t operator()(const station_key& key) const {
+            size_t h = std::hash<std::string>{}(key.name);
+            return h ^ (std::hash<std::string>{}(key.ctrl_address) + 0x9e3779b9 + (h << 6) + (h >> 2));
+        }
+    };
+
+    // consistent view of the station list, shared between readers until it changes
+    struct station_snapshot {
+        uint64_t version;
+        std::shared_ptr<const std::vector<std::string>> names;
+        std::optional<station> selected;
+        std::optional<size_t> selected_position;  // in names
+    };
+
     class station_set {
     private:
+        using clock = std::chrono::system_clock;
+        typedef std::tuple<clock::time_point, station_key> expiry_entry;
+
         std::mutex mut{};
         std::optional<std::string> preferred_station_name{std::nullopt};
-        std::set<station> stations{};
-        std::set<station>::iterator selected_station{stations.end()};
+        std::unordered_map<station_key, station, station_key_hash> stations{};
+        // station keys and names sorted by name, rebuilt only when stations appear or expire,
+        // names of stations that share their name with another one contain sender address
+        std::vector<station_key> order{};
+        std::shared_ptr<const std::vector<std::string>> names{
+            std::make_shared<const std::vector<std::string>>()};
+        std::optional<station_key> selected_key{std::nullopt};
+        std::priority_queue<expiry_entry, std::vector<expiry_entry>, std::greater<expiry_entry>>
+            expiry_heap{};
+        // incremented whenever station list, selection or selected station changes
+        uint64_t version{0};
+        sikradio::receiver::change_notifier* notifier{nullptr};
+
+        void bump_version() {
+            version++;
+            if (notifier != nullptr) notifier->notify();
+        }
 
-        void remove_old_stations() {
-            auto now = std::chrono::system_clock::now();
-            for (auto it = stations.begin(); it != stations.end();/*update in body*/) {
-                auto last_update = it->last_reply;
-                auto duration_from_last_update = now - last_update;
-                if (duration_from_last_update <= std::chrono::seconds(MAX_INACTIVE_SECONDS)) {
-                    it++;
-                    continue;
-                }
-                if (*it == *selected_station) {
-                    // try to change selected station to an active one
-                    if (selected_station != stations.end()) 
-                        selected_station++;
-                    if (selected_station == stations.end()) 
-                        selected_station = stations.begin();
-                }
-                it = stations.erase(it);
+        static clock::time_point expiry_of(const station& s) {
+            return s.last_reply + std::chrono::seconds(MAX_INACTIVE_SECONDS);
+        }
+
+        size_t position_of(const station_key& key) const {
+            return std::lower_bound(order.begin(), order.end(), key) - order.begin();
+        }
+
+        void rebuild_names() {
+            auto new_names = std::make_shared<std::vector<std::string>>();
+            new_names->reserve(order.size());
+            for (size_t pos = 0; pos < order.size(); pos++) {
+                const auto& key = order[pos];
+                // stations with the same name are next to each other
+                bool has_twin = (pos > 0 && order[pos - 1].name == key.name)
+                    || (pos + 1 < order.size() && order[pos + 1].name == key.name);
+                if (has_twin)
+                    new_names->emplace_back(key.name + " (" + key.ctrl_address + ")");
+                else
+                    new_names->emplace_back(key.name);
+            }
+            names = std::move(new_names);
+        }
+
+        void compact_expiry_heap() {
+            if (expiry_heap.size() <= expiry_heap_slack*stations.size() + 16) return;
+            decltype(expiry_heap) fresh;
+            for (const auto& [key, s] : stations)
+                fresh.emplace(expiry_of(s), key);
+            expiry_heap = std::move(fresh);
+        }
+
+        void remove_station(const station_key& key) {
+            size_t pos = position_of(key);
+            if (selected_key.has_value() && selected_key.value() == key) {
+                // try to change selected station to an active one
+                if (order.size() > 1)
+                    selected_key = order[(pos + 1) % order.size()];
+                else
+                    selected_key = std::nullopt;
             }
+            order.erase(order.begin() + pos);
+            stations.erase(key);
         }
 
-        std::optional<station> get_selected_station() {
-            if (stations.empty()) {
-                return std::nullopt;
+        void remove_old_stations() {
+            auto now = clock::now();
+            bool removed = false;
+            while (!expiry_heap.empty() && std::get<0>(expiry_heap.top()) < now) {
+                auto [deadline, key] = expiry_heap.top();
+                expiry_heap.pop();
+                auto it = stations.find(key);
+                // entry is stale if station was refreshed (or removed) after it was pushed
+                if (it == stations.end() || expiry_of(it->second) != deadline) continue;
+                remove_station(key);
+                removed = true;
+            }
+            if (removed) {
+                rebuild_names();
+                bump_version();
             }
-            return std::make_optional(*selected_station);
+        }
+
+        std::optional<station> get_selected_station() const {
+            if (!selected_key.has_value()) return std::nullopt;
+            return std::make_optional(stations.at(selected_key.value()));
         }
 
     public:
@@ -64,60 +161,93 @@ namespace sikradio::receiver {
             this->preferred_station_name = std::make_optional(std::move(preferred_station_name));
         }
 
-        explicit station_set(std::optional<std::string> preferred_station_name) : 
+        explicit station_set(std::optional<std::string> preferred_station_name) :
                 preferred_station_name{preferred_station_name} {}
 
-        std::optional<station> 
+        station_set(
+                std::optional<std::string> preferred_station_name,
+                sikradio::receiver::change_notifier* notifier) :
+            preferred_station_name{preferred_station_name},
+            notifier{notifier} {}
+
+        std::optional<station>
         update_get_selected(const station &new_station) {
-            std::scoped_lock{mut};
+            std::scoped_lock lock{mut};
             remove_old_stations();
 
-            std::set<station>::iterator new_it;
-            size_t erased = stations.erase(new_station);
-            std::tie(new_it, std::ignore) = stations.emplace(new_station);
+            station_key key{new_station};
+            auto it = stations.find(key);
+            bool is_new = (it == stations.end());
+            if (is_new) {
+                stations.emplace(key, new_station);
+                order.insert(order.begin() + position_of(key), key);
+                rebuild_names();
+                bump_version();
+            } else {
+                if (it->second != new_station) bump_version();
+                it->second = new_station;
+            }
+            expiry_heap.emplace(expiry_of(new_station), key);
+            compact_expiry_heap();
 
-            if (selected_station == stations.end()) selected_station = new_it;
             // we will only select preferred station when it appears for the 1st time
-            if (preferred_station_name.has_value() 
-                    && preferred_station_name.value() == new_station.name
-                    && erased == 0)
-                selected_station = new_it;
-
+            bool is_preferred = preferred_station_name.has_value()
+                && preferred_station_name.value() == new_station.name;
+            if (!selected_key.has_value() || (is_new && is_preferred)) {
+                if (selected_key != key) bump_version();
+                selected_key = key;
+            }
             return get_selected_station();
         }
 
-        std::optional<station> 
+        std::optional<station>
         select_get_selected(const menu_selection_update msu) {
-            std::scoped_lock{mut};
+            std::scoped_lock lock{mut};
             remove_old_stations();
-            
-            if (stations.empty()) return get_selected_station();
-            if (msu == menu_selection_update::UP) {
-                if (selected_station != stations.end()) selected_station++;
-                if (selected_station == stations.end()) selected_station = stations.begin();
-            } else {
-                if (selected_station == stations.begin()) selected_station = stations.end();
-                if (selected_station != stations.begin()) selected_station--;
-            }
+
+            if (!selected_key.has_value() || order.size() < 2) return get_selected_station();
+            size_t pos = position_of(selected_key.value());
+            if (msu == menu_selection_update::UP)
+                pos = (pos + 1) % order.size();
+            else
+                pos = (pos + order.size() - 1) % order.size();
+            selected_key = order[pos];
+            bump_version();
             return get_selected_station();
         }
 
         std::optional<station> get_selected() {
-            std::scoped_lock{mut};
+            std::scoped_lock lock{mut};
             remove_old_stations();
             return get_selected_station();
         }
 
         std::vector<std::string> get_station_names() {
-            std::scoped_lock{mut};
+            std::scoped_lock lock{mut};
             remove_old_stations();
+            return *names;
+        }
 
-            std::vector<std::string> station_names;
-            station_names.reserve(stations.size());
-            for (auto it = stations.begin(); it != stations.end(); it++) {
-                station_names.emplace_back(it->name);
-            }
-            return station_names;
+        station_snapshot get_snapshot() {
+            std::scoped_lock lock{mut};
+            remove_old_stations();
+            std::optional<size_t> selected_position{std::nullopt};
+            if (selected_key.has_value()) selected_position = position_of(selected_key.value());
+            return station_snapshot{version, names, get_selected_station(), selected_position};
+        }
+
+        uint64_t get_version() {
+            std::scoped_lock lock{mut};
+            remove_old_stations();
+            return version;
+        }
+
+        // earliest moment at which some station may expire
+        std::optional<std::chrono::system_clock::time_point> get_next_expiry() {
+            std::scoped_lock lock{mut};
+            remove_old_stations();
+            if (expiry_heap.empty()) return std::nullopt;
+            return std::get<0>(expiry_heap.top());
         }
     };
 }
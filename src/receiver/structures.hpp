@@ -10,7 +10,8 @@
 #include "../common/ctrl_msg.hpp"
 
 namespace sikradio::receiver::structures {
-    enum class menu_selection_update {UP, DOWN};
+    // station selection and timeshift commands
+    enum class menu_selection_update {UP, DOWN, PAUSE, REWIND, LIVE};
 
     struct station {
         std::string name;
@@ -0,0 +1,141 @@
+#ifndef SIKRADIO_RECEIVER_TIMESHIFT_HPP
+#define SIKRADIO_RECEIVER_TIMESHIFT_HPP
+
+#include <mutex>
+#include <deque>
+#include <chrono>
+#include <string>
+#include <cstring>
+#include <utility>
+#include <optional>
+#include <algorithm>
+
+#include "../common/types.hpp"
+#include "../common/mapped_ring.hpp"
+
+namespace sikradio::receiver {
+    namespace {
+        // recorded position is remembered this often, rewinding lands on one of them
+        const auto timeshift_mark_interval = std::chrono::milliseconds(100);
+        const size_t timeshift_page_size = 4096;
+    }
+
+    // recording of played audio in a memory mapped ring file, which output can be paused,
+    // rewound and caught up with the live stream from, recording continues while playback
+    // is shifted, so live stream is never lost (until it is overwritten in the ring)
+    class timeshift {
+    public:
+        using clock = std::chrono::steady_clock;
+
+    private:
+        struct mark {
+            clock::time_point time;  // when byte at the position was recorded
+            uint64_t position;
+        };
+
+        std::mutex mut{};
+        sikradio::common::mapped_ring ring;
+        std::chrono::milliseconds rewind_step;
+        uint64_t written{0};  // bytes recorded since start
+        std::optional<uint64_t> playback{std::nullopt};  // position of shifted playback, none if live
+        bool paused{false};
+        std::deque<mark> marks{};
+
+        uint64_t oldest() const {
+            return (written > ring.get_size()) ? written - ring.get_size() : 0;
+        }
+
+        // playback that was overwritten skips to the oldest recorded position
+        void catch_up_with_ring() {
+            while (!marks.empty() && marks.front().position < oldest()) marks.pop_front();
+            if (playback.has_value() && playback.value() < oldest())
+                playback = marks.empty() ? written : marks.front().position;
+        }
+
+    public:
+        timeshift(const timeshift& other) = delete;
+        timeshift(timeshift&& other) = delete;
+
+        // capacity is rounded up to whole pages
+        timeshift(const std::string& path, size_t capacity, std::chrono::milliseconds rewind_step) :
+                ring{path, timeshift_page_size, 1 + (std::max<size_t>(capacity, 1) - 1) / timeshift_page_size},
+                rewind_step{rewind_step} {}
+
+        // records chunk of audio, returns true if it should be played right away (playback is live)
+        bool record(const sikradio::common::byte_t *data, size_t len, clock::time_point now = clock::now()) {
+            std::scoped_lock lock{mut};
+            if (marks.empty() || now - marks.back().time >= timeshift_mark_interval)
+                marks.push_back(mark{now, written});
+            auto base = ring.slot(0);
+            size_t done = 0;
+            while (done < len) {
+                auto offset = (written + done) % ring.get_size();
+                auto n = std::min(len - done, ring.get_size() - offset);
+                memcpy(base + offset, data + done, n);
+                done += n;
+            }
+            written += len;
+            catch_up_with_ring();
+            return !playback.has_value();
+        }
+
+        // returns up to max_len of recorded audio that is next to be played, recording only happens
+        // in the thread that plays, so returned data is valid until the next call to record,
+        // playback becomes live when it reaches the recording
+        std::pair<const sikradio::common::byte_t *, size_t> next_output(size_t max_len) {
+            std::scoped_lock lock{mut};
+            catch_up_with_ring();
+            if (!playback.has_value() || paused) return {nullptr, 0};
+            auto position = playback.value();
+            auto offset = position % ring.get_size();
+            auto n = std::min<uint64_t>({max_len, written - position, ring.get_size() - offset});
+            playback = position + n;
+            if (playback.value() == written) playback = std::nullopt;
+            return {ring.slot(0) + offset, static_cast<size_t>(n)};
+        }
+
+        // pauses or resumes playback, paused playback stays at its position while recording continues
+        void toggle_pause() {
+            std::scoped_lock lock{mut};
+            if (!playback.has_value()) playback = written;
+            paused = !paused;
+        }
+
+        // moves playback back by rewind step, to the oldest recorded position at most
+        void rewind() {
+            std::scoped_lock lock{mut};
+            catch_up_with_ring();
+            if (marks.empty()) return;
+            auto position = playback.value_or(written);
+            // time when currently played audio was recorded
+            auto current = std::upper_bound(
+                marks.begin(), marks.end(), position,
+                [](uint64_t p, const mark& m) { return p < m.position; });
+            if (current != marks.begin()) current--;
+            auto target_time = current->time - rewind_step;
+            auto target = std::lower_bound(
+                marks.begin(), current, target_time,
+                [](const mark& m, clock::time_point t) { return m.time < t; });
+            playback = target->position;
+        }
+
+        void go_live() {
+            std::scoped_lock lock{mut};
+            playback = std::nullopt;
+            paused = false;
+        }
+
+        bool is_live() {
+            std::scoped_lock lock{mut};
+            return !playback.has_value();
+        }
+
+        // bytes of recording between playback and live stream
+        uint64_t get_delay() {
+            std::scoped_lock lock{mut};
+            return written - playback.value_or(written);
+        }
+    };
+}
+
+#endif //SIKRADIO_RECEIVER_TIMESHIFT_HPP
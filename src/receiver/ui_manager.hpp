@@ -4,14 +4,23 @@
 #include <mutex>
 #include <vector>
 #include <string>
+#include <deque>
+#include <memory>
 #include <optional>
-#include <poll.h>
+#include <algorithm>
+#include <unordered_map>
+#include <sys/epoll.h>
 #include <netinet/in.h>
 
 #include "structures.hpp"
+#include "change_notifier.hpp"
 
 #ifndef MAX_UI_CLIENT_CONNECTIONS
-#define MAX_UI_CLIENT_CONNECTIONS (_POSIX_OPEN_MAX - 10)
+#define MAX_UI_CLIENT_CONNECTIONS 1024
+#endif
+
+#ifndef MAX_UI_CLIENT_QUEUE_BYTES
+#define MAX_UI_CLIENT_QUEUE_BYTES 65536
 #endif
 
 namespace sikradio::receiver {
@@ -20,6 +29,8 @@ namespace sikradio::receiver {
     namespace {
         const int listen_backlog = 5;
         const size_t buffer_size = 5;
+        // client that did not finish writing a frame during this many menu updates is evicted
+        const size_t max_stalled_frames = 64;
 
         const std::string telnet_mode = "\377\375\042\377\373\001";
         const std::string clear_terminal = "\033[2J\033[0;0H";
@@ -29,21 +40,22 @@ namespace sikradio::receiver {
         const std::string active_station_prefix = "  > ";
         const std::string telnet_endl = "\r\n";
 
+        // selected is a position in stations, as their names do not have to be unique
         std::string parse_stations(
-                std::vector<std::string> stations, 
-                std::optional<std::string> selected=std::nullopt) {
+                const std::vector<std::string>& stations, 
+                std::optional<size_t> selected=std::nullopt) {
             std::ostringstream ret;
             // header
             ret << hr << telnet_endl;
             ret << title << telnet_endl;
             ret << hr << telnet_endl;
             // station list
-            for (auto it = stations.begin(); it != stations.end(); it++) {
-                if (selected.has_value() && *it == selected.value()) 
+            for (size_t pos = 0; pos < stations.size(); pos++) {
+                if (selected.has_value() && pos == selected.value()) 
                     ret << active_station_prefix;
                 else 
                     ret << station_prefix;
-                ret << (*it);
+                ret << stations[pos];
                 ret << telnet_endl;
             }
             ret << hr << telnet_endl;
@@ -52,21 +64,51 @@ namespace sikradio::receiver {
 
         std::optional<sikradio::receiver::structures::menu_selection_update>
         parse_selection_update(std::string buffer) {
+            if (buffer == " ") return menu_selection_update::PAUSE;
             if (buffer.size() != 3) return std::nullopt;
             if (buffer[0] != '\x1B' || buffer[1] != '\x5B') return std::nullopt;
             if (buffer[2] == 'B') return menu_selection_update::UP; // char[27,91,66]
             else if (buffer[2] == 'A') return menu_selection_update::DOWN; // char[27,91,65]
+            else if (buffer[2] == 'D') return menu_selection_update::REWIND; // char[27,91,68], left arrow
+            else if (buffer[2] == 'C') return menu_selection_update::LIVE; // char[27,91,67], right arrow
             else return std::nullopt;
         }
     }
 
+    // rendered output shared by all clients it was queued for
+    typedef std::shared_ptr<const std::string> ui_frame;
+
+    struct ui_output {
+        ui_frame data;
+        bool droppable;  // menu frames can be replaced by newer ones before they are sent
+    };
+
+    struct ui_client {
+        std::deque<ui_output> output{};
+        size_t sent_bytes{0};  // bytes of output.front() already written
+        size_t queued_bytes{0};
+        size_t stalled_frames{0};
+        bool waits_for_write{false};
+    };
+
     class ui_manager {
     private:
         std::mutex mut;
         in_port_t ui_port;
         int poll_timeout_in_ms;
-        pollfd client_sockets[MAX_UI_CLIENT_CONNECTIONS];
+        int listen_sock{-1};
+        int epoll_fd{-1};
+        // wakes up get_update when menu contents change, optional
+        sikradio::receiver::change_notifier* notifier{nullptr};
+        // notification consumed while get_update was not waiting
+        bool change_pending{false};
+        // connected clients and clients with pending input, both sized by active clients
+        std::unordered_map<int, ui_client> clients{};
+        std::deque<int> ready_clients{};
+        std::vector<epoll_event> events{};
         std::string active_menu;
+        ui_frame active_frame;
+        ui_frame telnet_mode_frame{std::make_shared<const std::string>(telnet_mode)};
         char buffer[buffer_size];
 
         void throw_safely(int sock_to_close) {
@@ -74,48 +116,137 @@ namespace sikradio::receiver {
             throw sikradio::common::exceptions::socket_exception(strerror(errno));
         }
 
-        void send_string(int sock, const std::string& command) {
-            int err = write(sock, command.c_str(), command.size());
-            if (err != static_cast<int>(command.size())) throw_safely(sock);
-        }
-
         std::optional<std::string> read_string(int sock) {
             memset(buffer, 0, buffer_size);
             ssize_t read_bytes = read(sock, buffer, buffer_size);
-            if (read_bytes < 0) throw_safely(sock);
+            if (read_bytes < 0) {
+                // spurious wakeup, there is nothing to read yet
+                if (errno == EAGAIN || errno == EWOULDBLOCK) return std::string();
+                throw sikradio::common::exceptions::socket_exception(strerror(errno));
+            }
             if (read_bytes == 0) return std::nullopt;
             return std::string(buffer, buffer + read_bytes);
         }
 
-        void clear_revents() {
-            for (auto& cs : client_sockets) {
-                cs.revents = 0;
+        static ui_frame render_frame(const std::string& menu) {
+            return std::make_shared<const std::string>(clear_terminal + menu);
+        }
+
+        void watch_writable(int sock, ui_client& client, bool enable) {
+            if (client.waits_for_write == enable) return;
+            epoll_event ev{};
+            ev.events = enable ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+            ev.data.fd = sock;
+            if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, sock, &ev) < 0)
+                throw sikradio::common::exceptions::socket_exception(strerror(errno));
+            client.waits_for_write = enable;
+        }
+
+        // writes as much of queued output as socket accepts, returns false if client disconnected
+        bool flush_client(int sock, ui_client& client) {
+            while (!client.output.empty()) {
+                const auto& data = *client.output.front().data;
+                ssize_t len = send(
+                    sock, 
+                    data.data() + client.sent_bytes, 
+                    data.size() - client.sent_bytes, 
+                    MSG_NOSIGNAL);
+                if (len < 0) {
+                    if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+                    return false;
+                }
+                client.sent_bytes += len;
+                if (client.sent_bytes < data.size()) continue;
+                client.queued_bytes -= data.size();
+                client.sent_bytes = 0;
+                client.stalled_frames = 0;
+                client.output.pop_front();
+            }
+            try {
+                watch_writable(sock, client, !client.output.empty());
+            } catch (sikradio::common::exceptions::socket_exception& e) {
+                return false;
+            }
+            return true;
+        }
+
+        // queues output for client, returns false if client has to be evicted
+        bool enqueue(ui_client& client, ui_frame data, bool droppable) {
+            if (droppable) {
+                // only the latest menu matters, drop frames that were not started yet
+                size_t keep = (client.sent_bytes > 0) ? 1 : 0;
+                for (size_t i = client.output.size(); i > keep; i--) {
+                    if (!client.output[i - 1].droppable) continue;
+                    client.queued_bytes -= client.output[i - 1].data->size();
+                    client.output.erase(client.output.begin() + (i - 1));
+                    client.stalled_frames++;
+                }
+            }
+            client.queued_bytes += data->size();
+            client.output.push_back(ui_output{std::move(data), droppable});
+            return client.queued_bytes <= MAX_UI_CLIENT_QUEUE_BYTES
+                && client.stalled_frames <= max_stalled_frames;
+        }
+
+        void disconnect_client(int sock) {
+            // closing the socket also removes it from epoll set
+            close(sock);
+            clients.erase(sock);
+            ready_clients.erase(
+                std::remove(ready_clients.begin(), ready_clients.end(), sock),
+                ready_clients.end());
+        }
+
+        void accept_client() {
+            int msg_sock = accept4(listen_sock, NULL, 0, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (msg_sock < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ECONNABORTED) return;
+                throw_safely(listen_sock);
             }
+            if (clients.size() >= MAX_UI_CLIENT_CONNECTIONS) {
+                close(msg_sock);
+                return;
+            }
+            epoll_event ev{};
+            ev.events = EPOLLIN;
+            ev.data.fd = msg_sock;
+            if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, msg_sock, &ev) < 0) {
+                close(msg_sock);
+                return;
+            }
+            auto& client = clients[msg_sock];
+            (void)enqueue(client, telnet_mode_frame, false);
+            (void)enqueue(client, active_frame, true);
+            if (!flush_client(msg_sock, client)) disconnect_client(msg_sock);
         }
 
-        void check_new_clients() {
-            int err = poll(
-                client_sockets, 
-                MAX_UI_CLIENT_CONNECTIONS, 
-                poll_timeout_in_ms);
-            if (err < 0) throw_safely(client_sockets[0].fd);
-            // handle new clients
-            if (client_sockets[0].revents & POLLIN) {
-                int msg_sock = accept(client_sockets[0].fd, NULL, 0);
-                if (msg_sock < 0) throw_safely(client_sockets[0].fd);
-                // find available space and register new client socket
-                for (int i=1; i<MAX_UI_CLIENT_CONNECTIONS; i++) {
-                    if (client_sockets[i].fd >= 0) continue;
-                    client_sockets[i].fd = msg_sock;
-                    try {
-                        send_string(msg_sock, telnet_mode);
-                        send_string(msg_sock, clear_terminal);
-                        send_string(msg_sock, active_menu);
-                    } catch (sikradio::common::exceptions::socket_exception& e) {
-                        // client disconnected
-                        client_sockets[i].fd = -1;
-                    }
-                    break;
+        void check_events(int timeout_in_ms) {
+            events.resize(clients.size() + 2);
+            int n = epoll_wait(epoll_fd, events.data(), static_cast<int>(events.size()), timeout_in_ms);
+            if (n < 0) {
+                if (errno == EINTR) return;
+                throw_safely(-1);
+            }
+            for (int i = 0; i < n; i++) {
+                int fd = events[i].data.fd;
+                if (fd == listen_sock) {
+                    accept_client();
+                    continue;
+                }
+                if (notifier != nullptr && fd == notifier->get_fd()) {
+                    change_pending = notifier->consume() || change_pending;
+                    continue;
+                }
+                auto client = clients.find(fd);
+                if (client == clients.end()) continue;
+                if ((events[i].events & EPOLLOUT) && !flush_client(fd, client->second)) {
+                    disconnect_client(fd);
+                    continue;
+                }
+                if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+                    // hangups and errors are detected when reading
+                    auto it = std::find(ready_clients.begin(), ready_clients.end(), fd);
+                    if (it == ready_clients.end()) ready_clients.push_back(fd);
                 }
             }
         }
@@ -125,19 +256,18 @@ namespace sikradio::receiver {
         ui_manager(const ui_manager& other) = delete;
         ui_manager(ui_manager&& other) = delete;
         
-        ui_manager(in_port_t ui_port, int poll_timeout_in_ms) : 
+        ui_manager(
+                in_port_t ui_port, 
+                int poll_timeout_in_ms, 
+                sikradio::receiver::change_notifier* notifier=nullptr) : 
                 ui_port{ui_port},
-                poll_timeout_in_ms{poll_timeout_in_ms} {
+                poll_timeout_in_ms{poll_timeout_in_ms},
+                notifier{notifier} {
             // initialize stations to empty list with header
             active_menu = parse_stations(std::vector<std::string>());
-            // initialize poll table
-            for (int i=0; i < MAX_UI_CLIENT_CONNECTIONS; i++) {
-                client_sockets[i].fd = -1;
-                client_sockets[i].events = POLLIN;
-                client_sockets[i].revents = 0;
-            }
+            active_frame = render_frame(active_menu);
             // setup ui socket
-            int sock = socket(PF_INET, SOCK_STREAM, 0);
+            int sock = socket(PF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
             if (sock < 0) throw_safely(sock);
             // reuse address
             int reuse = 1;
@@ -162,52 +292,88 @@ namespace sikradio::receiver {
             // listen for client requests
             err = listen(sock, listen_backlog);
             if (err < 0) throw_safely(sock);
-            // store ui socket at the beginning of poll table
-            client_sockets[0].fd = sock;
+            listen_sock = sock;
+            // register ui socket in epoll set
+            epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+            if (epoll_fd < 0) throw_safely(listen_sock);
+            epoll_event ev{};
+            ev.events = EPOLLIN;
+            ev.data.fd = listen_sock;
+            err = epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_sock, &ev);
+            if (err < 0) {
+                close(epoll_fd);
+                throw_safely(listen_sock);
+            }
+            if (notifier != nullptr) {
+                ev.events = EPOLLIN;
+                ev.data.fd = notifier->get_fd();
+                err = epoll_ctl(epoll_fd, EPOLL_CTL_ADD, notifier->get_fd(), &ev);
+                if (err < 0) {
+                    close(epoll_fd);
+                    throw_safely(listen_sock);
+                }
+            }
         }
 
         void send_menu(
-                std::vector<std::string> stations, 
-                std::optional<std::string> selected=std::nullopt) {
-            clear_revents();
-            check_new_clients();
+                const std::vector<std::string>& stations, 
+                std::optional<size_t> selected=std::nullopt) {
+            // accept waiting clients and flush writable ones without blocking the caller
+            check_events(0);
             auto new_menu = parse_stations(stations, selected);
             if (new_menu == active_menu) return;
-            // menu changed and needs to sent to all of the clients
-            for (int i=1; i<MAX_UI_CLIENT_CONNECTIONS; i++) {
-                if (client_sockets[i].fd < 0) continue;
-                try {
-                    send_string(client_sockets[i].fd, clear_terminal);
-                    send_string(client_sockets[i].fd, new_menu);
-                } catch (sikradio::common::exceptions::socket_exception& e) {
-                    // client disconnected
-                    client_sockets[i].fd = -1;
-                }
+            // menu changed, it is rendered once and queued for all of the clients
+            active_menu = std::move(new_menu);
+            active_frame = render_frame(active_menu);
+            std::vector<int> disconnected;
+            for (auto& [sock, client] : clients) {
+                if (!enqueue(client, active_frame, true) || !flush_client(sock, client))
+                    disconnected.push_back(sock);
             }
-            active_menu = new_menu;
+            for (int sock : disconnected)
+                disconnect_client(sock);
         }
 
         std::optional<menu_selection_update> get_update() {
-            clear_revents();
-            check_new_clients();
+            return get_update(poll_timeout_in_ms);
+        }
+
+        // waits until client sends input, menu change is notified or timeout passes
+        std::optional<menu_selection_update> get_update(int timeout_in_ms) {
+            if (ready_clients.empty() && !change_pending)
+                check_events(timeout_in_ms);
+            change_pending = false;
             std::optional<std::string> str;
-            for (int i=1; i<MAX_UI_CLIENT_CONNECTIONS; i++) {
-                if (client_sockets[i].fd < 0) continue;
-                if (!(client_sockets[i].revents & POLLIN)) continue;
+            while (!ready_clients.empty()) {
+                int sock = ready_clients.front();
+                ready_clients.pop_front();
                 try {
-                    str = read_string(client_sockets[i].fd);
+                    str = read_string(sock);
                 } catch (sikradio::common::exceptions::socket_exception& e) {
+                    str = std::nullopt;
+                }
+                if (!str.has_value()) {
                     // client disconnected
-                    client_sockets[i].fd = -1;
+                    disconnect_client(sock);
                     continue;
                 }
-                if (str.has_value()) {
-                    // return first update received from any client
-                    return parse_selection_update(str.value());
-                }
+                if (str.value().empty()) continue;
+                // return first update received from any client
+                return parse_selection_update(str.value());
             }
             return std::nullopt;
         }
+
+        size_t get_client_count() const {
+            return clients.size();
+        }
+
+        ~ui_manager() {
+            for (auto& [sock, client] : clients)
+                close(sock);
+            if (epoll_fd >= 0) close(epoll_fd);
+            if (listen_sock >= 0) close(listen_sock);
+        }
     };
 }
 
@@ -1,4 +1,14 @@
 #include "sender/transmitter.hpp"
+#include "common/transport.hpp"
+#include "common/impaired_transport.hpp"
+#include "common/transport_factory.hpp"
+#include "common/realtime.hpp"
+#include "common/pcm_codec.hpp"
+#include "sender/input_source.hpp"
+#include "sender/mapped_input.hpp"
+#include "sender/archive.hpp"
+#include <memory>
+#include <vector>
 #include <boost/program_options.hpp>
 
 
@@ -15,17 +25,67 @@ int main(int argc, char *argv[]) {
             (",p", po::value<size_t>()->default_value(512), "PSIZE")
             (",f", po::value<size_t>()->default_value(131072), "FSIZE")
             (",R", po::value<size_t>()->default_value(250), "RTIME")
-            (",n", po::value<std::string>()->default_value("Nienazwany_nadajnik"), "NAZWA");
+            (",n", po::value<std::string>()->default_value("Nienazwany_nadajnik"), "NAZWA")
+            (",F", po::value<uint16_t>()->default_value(0), "FEC_PORT")
+            (",K", po::value<size_t>()->default_value(8), "FEC_GROUP")
+            (",D", po::value<size_t>()->default_value(1), "FEC_INTERLEAVE")
+            (",S", po::value<uint16_t>()->default_value(0), "STATS_PORT")
+            (",I", po::value<std::string>()->default_value(""), "MCAST_IF")
+            (",X", po::value<std::string>()->default_value(""), "IMPAIRMENT")
+            (",B", po::value<std::string>()->default_value("udp"), "IO_BACKEND")
+            (",T", po::value<std::string>()->default_value(""), "REALTIME")
+            (",i", po::value<std::vector<std::string>>()->composing(), "INPUT_FILE")
+            (",l", po::bool_switch(), "LOOP")
+            (",r", po::value<uint64_t>()->default_value(176400), "INPUT_RATE")
+            (",H", po::value<std::string>()->default_value(""), "ARCHIVE_FILE")
+            (",M", po::value<size_t>()->default_value(10), "ARCHIVE_MINUTES")
+            (",c", po::value<size_t>()->default_value(0), "CODEC_CHANNELS")
+            (",Q", po::value<size_t>()->default_value(4), "FAST_START_SPEED")
+            (",E", po::value<size_t>()->default_value(20), "REXMIT_BUDGET")
+            (",e", po::value<size_t>()->default_value(20), "REXMIT_INTERVAL")
+            (",m", po::bool_switch(), "MULTICAST_NACKS")
+            (",u", po::value<size_t>()->default_value(0), "UNICAST_LIMIT");
 
     po::variables_map vm;
     try {
         po::store(po::parse_command_line(argc, argv, desc), vm);
         po::notify(vm);
+        if (vm["-c"].as<size_t>() > sikradio::common::pcm_max_channels)
+            throw po::error("CODEC_CHANNELS has to be at most " + std::to_string(sikradio::common::pcm_max_channels));
     } catch (po::error &e) {
         std::cerr << e.what() << std::endl;
         exit(1);
     }
 
+    // received control messages are impaired to emulate a lossy network
+    std::shared_ptr<sikradio::common::transport> transport;
+    std::shared_ptr<sikradio::common::impaired_transport> impaired{nullptr};
+    sikradio::common::realtime_config realtime{};
+    // raw audio files given with `-i` are played instead of standard input
+    std::shared_ptr<sender::input_source> input = std::make_shared<sender::fd_input>();
+    // sent messages are archived for retransmission for `-M` minutes of the stream at `-r` rate
+    std::shared_ptr<sender::archive> archive{nullptr};
+    try {
+        if (!vm["-H"].as<std::string>().empty())
+            archive = std::make_shared<sender::archive>(
+                vm["-H"].as<std::string>(),
+                vm["-M"].as<size_t>()*60*vm["-r"].as<uint64_t>(),
+                vm["-p"].as<size_t>());
+        if (vm.count("-i"))
+            input = std::make_shared<sender::playlist_input>(
+                vm["-i"].as<std::vector<std::string>>(), vm["-l"].as<bool>(), vm["-r"].as<uint64_t>());
+        realtime = sikradio::common::parse_realtime(vm["-T"].as<std::string>(), sender::realtime_roles);
+        transport = sikradio::common::make_transport(vm["-B"].as<std::string>());
+        if (!vm["-X"].as<std::string>().empty()) {
+            impaired = std::make_shared<sikradio::common::impaired_transport>(
+                transport, sikradio::common::parse_impairment(vm["-X"].as<std::string>()));
+            transport = impaired;
+        }
+    } catch (sikradio::common::exceptions::base_exception &e) {
+        std::cerr << e.what() << std::endl;
+        exit(1);
+    }
+
     sender::transmitter transmitter(
             vm["-p"].as<size_t>(),
             vm["-f"].as<size_t>(),
@@ -33,8 +93,25 @@ int main(int argc, char *argv[]) {
             vm["-a"].as<std::string>(),
             vm["-P"].as<uint16_t>(),
             vm["-C"].as<uint16_t>(),
-            vm["-n"].as<std::string>()
+            vm["-n"].as<std::string>(),
+            vm["-F"].as<uint16_t>(),
+            vm["-K"].as<size_t>(),
+            vm["-D"].as<size_t>(),
+            vm["-S"].as<uint16_t>(),
+            vm["-I"].as<std::string>(),
+            transport,
+            realtime,
+            input,
+            archive,
+            vm["-c"].as<size_t>(),
+            vm["-Q"].as<size_t>(),
+            vm["-r"].as<uint64_t>(),
+            vm["-E"].as<size_t>(),
+            vm["-e"].as<size_t>(),
+            vm["-m"].as<bool>(),
+            vm["-u"].as<size_t>()
     );
+    if (impaired) impaired->register_probes(transmitter.get_metrics());
 
     transmitter.transmit();
     return 0;
@@ -0,0 +1,68 @@
+#ifndef SIKRADIO_SENDER_ARCHIVE_HPP
+#define SIKRADIO_SENDER_ARCHIVE_HPP
+
+#include <mutex>
+#include <string>
+#include <cstring>
+#include <optional>
+#include <algorithm>
+
+#include "../common/types.hpp"
+#include "../common/data_msg.hpp"
+#include "../common/mapped_ring.hpp"
+
+namespace sikradio::sender {
+    // sent messages kept in a memory mapped file, much longer than in the cache, so that
+    // retransmissions can be served from it after messages were evicted from the cache,
+    // like in cache consecutive messages go to consecutive slots
+    class archive {
+    private:
+        // slot header, slot written by a sender of another session (before restart) is not used
+        struct slot_header {
+            sikradio::common::msg_id_t session_id;
+            sikradio::common::msg_id_t id;
+            uint64_t len;
+        };
+
+        std::mutex mut{};
+        size_t package_size;
+        sikradio::common::mapped_ring ring;
+
+    public:
+        archive(const archive& other) = delete;
+        archive(archive&& other) = delete;
+
+        // capacity is in bytes of audio data, rounded up to whole packages
+        archive(const std::string& path, size_t capacity, size_t package_size) :
+                package_size{std::max<size_t>(package_size, 1)},
+                ring{path, sizeof(slot_header) + this->package_size, 1 + (std::max<size_t>(capacity, 1) - 1) / this->package_size} {}
+
+        void atomic_push(const sikradio::common::data_msg& msg, sikradio::common::msg_id_t session_id) {
+            std::scoped_lock lock{mut};
+            auto slot = ring.slot(msg.get_id() / package_size);
+            const auto& data = msg.get_data();
+            slot_header header{session_id, msg.get_id(), std::min(data.size(), package_size)};
+            memcpy(slot, &header, sizeof(header));
+            memcpy(slot + sizeof(header), data.data(), header.len);
+        }
+
+        std::optional<sikradio::common::data_msg> atomic_get(
+                sikradio::common::msg_id_t id, sikradio::common::msg_id_t session_id) {
+            std::scoped_lock lock{mut};
+            auto slot = ring.slot(id / package_size);
+            slot_header header{};
+            memcpy(&header, slot, sizeof(header));
+            if (header.session_id != session_id || header.id != id || header.len > package_size)
+                return std::nullopt;
+            auto data_start = slot + sizeof(header);
+            return sikradio::common::data_msg(id, sikradio::common::msg_t(data_start, data_start + header.len));
+        }
+
+        // number of messages that fit in the archive
+        size_t get_capacity() const {
+            return ring.get_slot_count();
+        }
+    };
+}
+
+#endif //SIKRADIO_SENDER_ARCHIVE_HPP
@@ -5,16 +5,15 @@
 #include <cstdlib>
 #include <string>
 #include <utility>
+#include <memory>
+#include <vector>
 #include <zconf.h>
 #include <cstring>
 #include <arpa/inet.h>
 
 #include "../common/data_msg.hpp"
 #include "../common/exceptions.hpp"
-
-#ifndef TTL_VALUE
-#define TTL_VALUE 64
-#endif
+#include "../common/transport.hpp"
 
 namespace sikradio::sender {
     using socket_exception = sikradio::common::exceptions::socket_exception;
@@ -23,57 +22,55 @@ namespace sikradio::sender {
     private:
         std::string remote_dotted_address;
         in_port_t remote_port;
-        bool connected{false};
-        int sock{-1};
+        std::string interface_dotted_address;  // empty if kernel should choose the interface
+        std::shared_ptr<sikradio::common::transport> transport;
+        std::unique_ptr<sikradio::common::datagram_socket> sock{nullptr};
 
         void open_connection() {
-            if (connected) return;
-            // get file descriptor
-            sock = socket(AF_INET, SOCK_DGRAM, 0);
-            if (sock < 0) throw socket_exception(strerror(errno));
+            if (sock) return;
+            auto new_sock = transport->open_datagram();
             // enable broadcast
-            int optval = 1;
-            int err = setsockopt(
-                sock, 
-                SOL_SOCKET, 
-                SO_BROADCAST, 
-                (void *) &optval, 
-                sizeof optval);
-            if (err < 0) throw socket_exception(strerror(errno));
+            new_sock->enable_broadcast();
             // set ttl value for broadcast
-            optval = TTL_VALUE;
-            err = setsockopt(
-                sock, 
-                IPPROTO_IP, 
-                IP_MULTICAST_TTL, 
-                (void *) &optval, 
-                sizeof optval);
-            if (err < 0) throw socket_exception(strerror(errno));
+            new_sock->set_multicast_ttl(TTL_VALUE);
+            // set outgoing interface for multicast
+            if (!interface_dotted_address.empty()) {
+                struct in_addr interface_address{};
+                int err = inet_aton(interface_dotted_address.c_str(), &interface_address);
+                if (err == 0) throw socket_exception("Invalid interface address");
+                new_sock->set_multicast_interface(interface_address);
+            }
             // set broadcast address
             struct sockaddr_in remote_address{
                     .sin_family = AF_INET,
                     .sin_port = htons(remote_port)
             };
-            err = inet_aton(remote_dotted_address.c_str(), &remote_address.sin_addr);
+            int err = inet_aton(remote_dotted_address.c_str(), &remote_address.sin_addr);
             if (err == 0) throw socket_exception("Invalid address");
             // connect to the address
-            err = connect(sock, (struct sockaddr *) &remote_address, sizeof(remote_address));
-            if (err < 0) throw socket_exception(strerror(errno));
-            connected = true;
+            new_sock->connect(remote_address);
+            sock = std::move(new_sock);
         }
 
     public:
         data_socket(
             std::string remote_dotted_address, 
-            in_port_t remote_port) : remote_dotted_address(std::move(remote_dotted_address)), 
-                                     remote_port(remote_port) {}
+            in_port_t remote_port,
+            std::string interface_dotted_address = "",
+            std::shared_ptr<sikradio::common::transport> transport = sikradio::common::default_transport()) : 
+                remote_dotted_address(std::move(remote_dotted_address)), 
+                remote_port(remote_port),
+                interface_dotted_address(std::move(interface_dotted_address)),
+                transport(std::move(transport)) {}
 
-        void transmit(sikradio::common::msg_t sendable_msg) {
-            if (!connected) open_connection();
+        void transmit(const sikradio::common::msg_t& sendable_msg) {
+            open_connection();
+            sock->send(sendable_msg.data(), sendable_msg.size());
+        }
 
-            auto msg_len = sendable_msg.size();
-            auto sent_len = write(sock, sendable_msg.data(), msg_len);
-            if (sent_len != static_cast<ssize_t>(msg_len)) throw socket_exception(strerror(errno));
+        void transmit_batch(const std::vector<sikradio::common::msg_t>& sendable_msgs) {
+            open_connection();
+            sock->send_batch(sendable_msgs);
         }
 
         void transmit_force(sikradio::common::msg_t sendable_msg) {
@@ -87,13 +84,20 @@ namespace sikradio::sender {
             }
         }
 
-        void close_connection() {
-            if (!connected) return;
-            close(sock);
+        // after a failure whole batch is sent again, receivers ignore duplicated messages
+        void transmit_batch_force(const std::vector<sikradio::common::msg_t>& sendable_msgs) {
+            while (true) {
+                try {
+                    transmit_batch(sendable_msgs);
+                    break;
+                } catch (socket_exception &e) {
+                    // retry
+                }
+            }
         }
 
-        ~data_socket() {
-            close_connection();
+        void close_connection() {
+            sock.reset();
         }
     };
 }
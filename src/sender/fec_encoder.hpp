@@ -0,0 +1,81 @@
+#ifndef SIKRADIO_SENDER_FEC_ENCODER_HPP
+#define SIKRADIO_SENDER_FEC_ENCODER_HPP
+
+#include <vector>
+#include <optional>
+
+#include "../common/types.hpp"
+#include "../common/data_msg.hpp"
+#include "../common/fec_msg.hpp"
+
+namespace sikradio::sender {
+    // accumulates xor parity of data messages, messages are split into blocks of
+    // group_size*interleave messages aligned to block size, and i-th message of a block
+    // belongs to group (i % interleave), so up to `interleave` consecutive losses are recoverable
+    class fec_encoder {
+    private:
+        struct parity_group {
+            sikradio::common::msg_t parity;
+            std::optional<sikradio::common::msg_id_t> first_id{std::nullopt};
+            size_t count{0};
+        };
+
+        size_t group_size;
+        size_t interleave;
+        size_t package_size;
+        std::vector<parity_group> groups;
+
+        void reset(parity_group& group, std::optional<sikradio::common::msg_id_t> first_id) {
+            std::fill(group.parity.begin(), group.parity.end(), 0);
+            group.first_id = first_id;
+            group.count = 0;
+        }
+
+    public:
+        fec_encoder() = delete;
+
+        fec_encoder(size_t group_size, size_t package_size) :
+            fec_encoder(group_size, 1, package_size) {}
+
+        fec_encoder(size_t group_size, size_t interleave, size_t package_size) :
+                group_size{group_size},
+                interleave{std::max<size_t>(interleave, 1)},
+                package_size{package_size} {
+            groups.resize(this->interleave);
+            for (auto& group : groups)
+                group.parity.assign(package_size, 0);
+        }
+
+        // returns parity message when data message completes a group
+        std::optional<sikradio::common::fec_msg> push(
+                const sikradio::common::data_msg &msg,
+                sikradio::common::msg_id_t session_id) {
+            const auto& data = msg.get_data();
+            if (data.size() != package_size) return std::nullopt;
+
+            auto block_size = group_size*interleave;
+            auto index = (msg.get_id() / package_size) % block_size;
+            auto lane = index % interleave;
+            auto first_id = msg.get_id() - (index - lane)*package_size;
+            auto& group = groups[lane];
+            if (group.first_id != first_id) {
+                // previous group was not completed, its parity would be useless
+                reset(group, first_id);
+            }
+            sikradio::common::xor_into(group.parity.data(), data.data(), package_size);
+            group.count++;
+            if (group.count < group_size) return std::nullopt;
+
+            sikradio::common::fec_msg ret{
+                session_id,
+                first_id,
+                static_cast<uint16_t>(group_size),
+                static_cast<uint16_t>(interleave),
+                group.parity};
+            reset(group, std::nullopt);
+            return ret;
+        }
+    };
+}
+
+#endif //SIKRADIO_SENDER_FEC_ENCODER_HPP
@@ -0,0 +1,99 @@
+#ifndef SIKRADIO_SENDER_INPUT_SOURCE_HPP
+#define SIKRADIO_SENDER_INPUT_SOURCE_HPP
+
+#include <new>
+#include <memory>
+#include <string>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <unistd.h>
+
+#include "../common/exceptions.hpp"
+#include "../common/types.hpp"
+
+namespace sikradio::sender {
+    using input_exception = sikradio::common::exceptions::input_exception;
+
+    namespace {
+        // data is read from the descriptor in blocks of this size (or less, if less is available)
+        const size_t input_block_size = 256*1024;
+    }
+
+    // audio data read by the sender, split into packets of the size of the given buffer
+    class input_source {
+    public:
+        virtual ~input_source() = default;
+
+        // fills packet with next audio data, returns false if there is no more data
+        virtual bool read_packet(sikradio::common::msg_t& packet) = 0;
+    };
+
+    // reads descriptor (standard input by default) with large reads into a page aligned block,
+    // which packets are sliced from, read returns as soon as any data is available, so it does not
+    // add latency to a slow producer, the last packet is padded with zeros
+    class fd_input : public input_source {
+    private:
+        struct free_block {
+            void operator()(sikradio::common::byte_t *block) const {
+                free(block);
+            }
+        };
+
+        int fd;
+        size_t block_size;
+        std::unique_ptr<sikradio::common::byte_t, free_block> block{nullptr};
+        size_t staged{0};  // bytes in the block
+        size_t offset{0};  // bytes of the block already sliced into packets
+        bool eof{false};
+
+        // returns false at the end of input
+        bool refill() {
+            while (!eof) {
+                ssize_t len = read(fd, block.get(), block_size);
+                if (len < 0) {
+                    if (errno == EINTR) continue;
+                    throw input_exception("Cannot read input: " + std::string(strerror(errno)));
+                }
+                if (len == 0) {
+                    eof = true;
+                    break;
+                }
+                staged = static_cast<size_t>(len);
+                offset = 0;
+                return true;
+            }
+            return false;
+        }
+
+    public:
+        fd_input(const fd_input& other) = delete;
+        fd_input(fd_input&& other) = delete;
+
+        explicit fd_input(int fd = STDIN_FILENO, size_t block_size = input_block_size) : fd{fd} {
+            auto page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+            this->block_size = std::max(page_size, (block_size + page_size - 1) / page_size * page_size);
+            void *memory = nullptr;
+            if (posix_memalign(&memory, page_size, this->block_size) != 0)
+                throw std::bad_alloc();
+            block.reset(static_cast<sikradio::common::byte_t *>(memory));
+        }
+
+        bool read_packet(sikradio::common::msg_t& packet) override {
+            size_t filled = 0;
+            while (filled < packet.size()) {
+                if (offset == staged && !refill()) break;
+                auto len = std::min(packet.size() - filled, staged - offset);
+                memcpy(packet.data() + filled, block.get() + offset, len);
+                filled += len;
+                offset += len;
+            }
+            if (filled == 0) return false;
+            std::fill(packet.begin() + filled, packet.end(), 0);
+            return true;
+        }
+    };
+}
+
+#endif //SIKRADIO_SENDER_INPUT_SOURCE_HPP
@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <mutex>
+#include <algorithm>
 #include "../common/data_msg.hpp"
 #include <optional>
 
@@ -15,26 +16,29 @@ namespace sikradio::sender {
         std::mutex mut{};
         std::vector<sikradio::common::data_msg> container{};
         size_t container_size;
+        size_t package_size;
 
+        // message ids are byte numbers, consecutive messages go to consecutive slots
         size_t internal_id(sikradio::common::msg_id_t id) {
-            return (id % container_size);
+            return ((id / package_size) % container_size);
         }
 
     public:
-        explicit lockable_cache(size_t container_size) : 
-            container_size(container_size) {
+        explicit lockable_cache(size_t container_size, size_t package_size = 1) : 
+                container_size(container_size),
+                package_size(std::max<size_t>(package_size, 1)) {
             container.reserve(container_size);
         }
 
+        // returns cached message stored in the slot for id, caller has to check if ids match
         optional<sikradio::common::data_msg> atomic_get(sikradio::common::msg_id_t id) {
-            if (id >= container.size()) return nullopt;
-
-            std::scoped_lock{mut};
+            std::scoped_lock lock{mut};
+            if (internal_id(id) >= container.size()) return nullopt;
             return optional<sikradio::common::data_msg>(container[internal_id(id)]);
         }
 
         void atomic_push(sikradio::common::data_msg msg) {
-            std::scoped_lock{mut};
+            std::scoped_lock lock{mut};
             // just to prevent segfault when copying to uninitialized memory
             if (internal_id(msg.get_id()) == container.size()) container.push_back(msg);
             container[internal_id(msg.get_id())] = msg;
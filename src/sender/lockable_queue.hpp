@@ -4,7 +4,7 @@
 #include <mutex>
 #include <queue>
 #include <atomic>
-#include <set>
+#include <vector>
 #include "../common/data_msg.hpp"
 #include <optional>
 
@@ -21,7 +21,7 @@ namespace sikradio::sender {
         lockable_queue() = default;
 
         optional<sikradio::common::data_msg> atomic_get_and_pop() {
-            std::scoped_lock{mut};
+            std::scoped_lock lock{mut};
 
             if (q.empty()) return nullopt;
             auto ret = q.front();
@@ -29,21 +29,27 @@ namespace sikradio::sender {
             return optional<sikradio::common::data_msg>(ret);
         }
 
-        std::set<sikradio::common::data_msg> atomic_get_unique() {
-            std::scoped_lock{mut};
-            
-            std::set<sikradio::common::data_msg> ret;
-            while (!q.empty()) {
-                ret.insert(q.front());
+        // pops up to max_count messages from the front of the queue under a single lock
+        std::vector<sikradio::common::data_msg> atomic_pop_batch(size_t max_count) {
+            std::scoped_lock lock{mut};
+
+            std::vector<sikradio::common::data_msg> ret;
+            while (!q.empty() && ret.size() < max_count) {
+                ret.push_back(std::move(q.front()));
                 q.pop();
             }
             return ret;
         }
 
         void atomic_push(sikradio::common::data_msg msg) {
-            std::scoped_lock{mut};
+            std::scoped_lock lock{mut};
             q.push(std::move(msg));
         }
+
+        size_t atomic_size() {
+            std::scoped_lock lock{mut};
+            return q.size();
+        }
     };
 }
 
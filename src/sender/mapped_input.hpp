@@ -0,0 +1,167 @@
+#ifndef SIKRADIO_SENDER_MAPPED_INPUT_HPP
+#define SIKRADIO_SENDER_MAPPED_INPUT_HPP
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <thread>
+#include <cstring>
+#include <optional>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../common/exceptions.hpp"
+#include "../common/types.hpp"
+#include "input_source.hpp"
+
+namespace sikradio::sender {
+    // read-only mapping of a whole file, read sequentially so that the kernel reads ahead aggressively
+    class mapped_file {
+    private:
+        const sikradio::common::byte_t *data{nullptr};
+        size_t size{0};
+
+        [[noreturn]] static void fail(const std::string& path) {
+            throw input_exception(path + ": " + strerror(errno));
+        }
+
+    public:
+        mapped_file(const mapped_file& other) = delete;
+        mapped_file(mapped_file&& other) = delete;
+
+        explicit mapped_file(const std::string& path) {
+            int fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0) fail(path);
+            struct stat file_stat{};
+            if (fstat(fd, &file_stat) < 0) {
+                close(fd);
+                fail(path);
+            }
+            size = static_cast<size_t>(file_stat.st_size);
+            if (size > 0) {
+                void *mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (mapping == MAP_FAILED) {
+                    close(fd);
+                    fail(path);
+                }
+                madvise(mapping, size, MADV_SEQUENTIAL);
+                data = static_cast<const sikradio::common::byte_t *>(mapping);
+            }
+            // mapping stays valid after the descriptor is closed
+            close(fd);
+        }
+
+        const sikradio::common::byte_t *get_data() const {
+            return data;
+        }
+
+        size_t get_size() const {
+            return size;
+        }
+
+        ~mapped_file() {
+            if (data != nullptr) munmap(const_cast<sikradio::common::byte_t *>(data), size);
+        }
+    };
+
+    // releases input at a constant byte rate, measured from the first packet
+    class pacer {
+    private:
+        using pacer_clock = std::chrono::steady_clock;
+
+        uint64_t bytes_per_second;
+        uint64_t released_bytes{0};
+        pacer_clock::time_point start{};
+        bool started{false};
+
+    public:
+        // rate of 0 releases input as fast as it is read
+        explicit pacer(uint64_t bytes_per_second) : bytes_per_second{bytes_per_second} {}
+
+        void wait(size_t bytes) {
+            if (bytes_per_second == 0) return;
+            if (!started) {
+                start = pacer_clock::now();
+                started = true;
+            }
+            // split to avoid overflow of nanoseconds for long running streams
+            auto whole_seconds = released_bytes / bytes_per_second;
+            auto rest_ns = (released_bytes % bytes_per_second) * 1000000000ull / bytes_per_second;
+            std::this_thread::sleep_until(
+                start + std::chrono::seconds(whole_seconds) + std::chrono::nanoseconds(rest_ns));
+            released_bytes += bytes;
+        }
+    };
+
+    // raw audio files played one after another, packets are copied straight from mapped files,
+    // only the file being played is mapped, so that archives larger than memory can be played
+    class playlist_input : public input_source {
+    private:
+        std::vector<std::string> paths;
+        bool loop;
+        sikradio::sender::pacer pacer;
+        size_t current_path{0};
+        std::optional<mapped_file> current_file{std::nullopt};
+        size_t offset{0};
+
+        // opens next non-empty file, returns false at the end of playlist
+        bool advance() {
+            while (true) {
+                if (current_file.has_value()) {
+                    current_file.reset();
+                    current_path++;
+                }
+                if (current_path == paths.size()) {
+                    if (!loop) return false;
+                    current_path = 0;
+                }
+                offset = 0;
+                current_file.emplace(paths[current_path]);
+                if (current_file.value().get_size() > 0) return true;
+            }
+        }
+
+    public:
+        playlist_input(const playlist_input& other) = delete;
+        playlist_input(playlist_input&& other) = delete;
+
+        playlist_input(std::vector<std::string> paths, bool loop, uint64_t bytes_per_second) :
+                paths{std::move(paths)},
+                loop{loop},
+                pacer{bytes_per_second} {
+            // missing files are reported at startup and empty playlist cannot be looped forever
+            size_t total_size = 0;
+            for (const auto& path : this->paths) {
+                struct stat file_stat{};
+                if (stat(path.c_str(), &file_stat) < 0)
+                    throw input_exception(path + ": " + strerror(errno));
+                total_size += static_cast<size_t>(file_stat.st_size);
+            }
+            if (total_size == 0) this->loop = false;
+        }
+
+        // packets can span files, the last packet of a playlist that is not looped is padded with zeros
+        bool read_packet(sikradio::common::msg_t& packet) override {
+            size_t filled = 0;
+            while (filled < packet.size()) {
+                if (!current_file.has_value() || offset == current_file.value().get_size()) {
+                    if (!advance()) break;
+                }
+                const auto& file = current_file.value();
+                auto len = std::min(packet.size() - filled, file.get_size() - offset);
+                memcpy(packet.data() + filled, file.get_data() + offset, len);
+                filled += len;
+                offset += len;
+            }
+            if (filled == 0) return false;
+            std::fill(packet.begin() + filled, packet.end(), 0);
+            pacer.wait(packet.size());
+            return true;
+        }
+    };
+}
+
+#endif //SIKRADIO_SENDER_MAPPED_INPUT_HPP
@@ -0,0 +1,188 @@
+#ifndef SIKRADIO_SENDER_REXMIT_SCHEDULER_HPP
+#define SIKRADIO_SENDER_REXMIT_SCHEDULER_HPP
+
+#include <mutex>
+#include <map>
+#include <deque>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <optional>
+#include <netinet/in.h>
+#include "../common/types.hpp"
+#include "../common/data_msg.hpp"
+
+namespace sikradio::sender {
+    struct rexmit {
+        sikradio::common::data_msg msg;
+        // receivers to which message is sent directly, it is multicast if there are none
+        std::vector<struct sockaddr_in> requesters;
+    };
+
+    // messages waiting for retransmission, sent by the egress thread when no live message is waiting,
+    // the one that receivers play first goes first, and all of them share a bandwidth budget
+    class rexmit_scheduler {
+    private:
+        using scheduler_clock = std::chrono::steady_clock;
+
+        struct pending_rexmit {
+            sikradio::common::data_msg msg;
+            bool expires;
+            bool multicast;
+            std::vector<struct sockaddr_in> requesters;
+        };
+
+        // distinct receivers that requested a message, kept until requester_interval passes after
+        // it was sent, so that requests which arrive after it was sent directly are counted too
+        struct requester_history {
+            std::vector<struct sockaddr_in> requesters;
+            std::optional<scheduler_clock::time_point> sent;  // none while message waits
+        };
+
+        std::mutex mut{};
+        // receivers play messages in order of their ids, so the lowest id has the earliest deadline
+        std::map<sikradio::common::msg_id_t, pending_rexmit> pending{};
+        uint64_t bytes_per_second;
+        uint64_t max_tokens;
+        uint64_t tokens;
+        size_t max_requesters;
+        std::map<sikradio::common::msg_id_t, requester_history> history{};
+        std::deque<std::pair<scheduler_clock::time_point, sikradio::common::msg_id_t>> sent_order{};
+        scheduler_clock::duration requester_interval;
+        scheduler_clock::time_point refilled{scheduler_clock::now()};
+
+        // message sent directly is sent once to each of its requesters
+        static uint64_t cost(const pending_rexmit& pending_msg) {
+            auto msg_cost = pending_msg.msg.get_data().size() + 2*sizeof(sikradio::common::msg_id_t);
+            return msg_cost * std::max<size_t>(pending_msg.requesters.size(), 1);
+        }
+
+        static void add_unique(std::vector<struct sockaddr_in>& addresses, const struct sockaddr_in& address) {
+            for (auto& known : addresses)
+                if (known.sin_addr.s_addr == address.sin_addr.s_addr && known.sin_port == address.sin_port)
+                    return;
+            addresses.push_back(address);
+        }
+
+        void forget_requesters(scheduler_clock::time_point now) {
+            while (!sent_order.empty() && now - sent_order.front().first >= requester_interval) {
+                auto [sent, id] = sent_order.front();
+                sent_order.pop_front();
+                auto it = history.find(id);
+                // entry is stale if message was requested again since
+                if (it != history.end() && it->second.sent == sent) history.erase(it);
+            }
+        }
+
+        // message requested by more than max_requesters distinct receivers is multicast, including
+        // the ones that requested it before it was sent directly to others
+        void add_requester(
+                sikradio::common::msg_id_t id,
+                pending_rexmit& pending_msg,
+                const std::optional<struct sockaddr_in>& requester) {
+            if (pending_msg.multicast) return;
+            if (!requester.has_value() || max_requesters == 0) {
+                pending_msg.multicast = true;
+                pending_msg.requesters.clear();
+                return;
+            }
+            auto& seen = history[id];
+            seen.sent.reset();
+            add_unique(seen.requesters, requester.value());
+            add_unique(pending_msg.requesters, requester.value());
+            if (seen.requesters.size() <= max_requesters) return;
+            pending_msg.multicast = true;
+            pending_msg.requesters.clear();
+        }
+
+        // budget is refilled in whole bytes, remainder of elapsed time counts towards the next refill
+        void refill() {
+            auto now = scheduler_clock::now();
+            auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(now - refilled).count();
+            uint64_t earned = static_cast<uint64_t>(elapsed) * bytes_per_second / 1000000000ull;
+            if (earned == 0) return;
+            tokens = std::min<uint64_t>(max_tokens, tokens + earned);
+            refilled += std::chrono::nanoseconds(earned * 1000000000ull / bytes_per_second);
+            if (tokens == max_tokens) refilled = now;
+        }
+
+    public:
+        // rate of 0 does not limit retransmissions, unused budget is kept up to burst_bytes,
+        // max_requesters of 0 multicasts all retransmissions, requesters of a message are counted
+        // until requester_interval after it was sent
+        explicit rexmit_scheduler(
+                uint64_t bytes_per_second,
+                uint64_t burst_bytes,
+                size_t max_requesters = 0,
+                std::chrono::milliseconds requester_interval = std::chrono::milliseconds(0)) :
+                bytes_per_second{bytes_per_second},
+                max_tokens{burst_bytes},
+                tokens{burst_bytes},
+                max_requesters{max_requesters},
+                requester_interval{requester_interval} {}
+
+        // returns false if message with the same id is already waiting, its requester is added then,
+        // messages that do not expire are sent even after their id leaves the cache (e.g. the ones
+        // from archive), messages of unknown requesters are multicast
+        bool atomic_push(
+                sikradio::common::data_msg msg,
+                bool expires = true,
+                std::optional<struct sockaddr_in> requester = std::nullopt) {
+            std::scoped_lock lock{mut};
+            forget_requesters(scheduler_clock::now());
+            auto id = msg.get_id();
+            auto [it, inserted] = pending.try_emplace(id, pending_rexmit{std::move(msg), expires, false, {}});
+            add_requester(id, it->second, requester);
+            return inserted;
+        }
+
+        // drops expiring messages with ids lower than oldest_id, returns number of dropped messages
+        size_t atomic_drop_expired(sikradio::common::msg_id_t oldest_id) {
+            std::scoped_lock lock{mut};
+            size_t dropped = 0;
+            for (auto it = pending.begin(); it != pending.end() && it->first < oldest_id;) {
+                if (!it->second.expires) {
+                    it++;
+                    continue;
+                }
+                history.erase(it->first);
+                it = pending.erase(it);
+                dropped++;
+            }
+            return dropped;
+        }
+
+        // pops up to max_count messages with the earliest deadlines that fit in the budget
+        std::vector<rexmit> atomic_pop_due(size_t max_count) {
+            std::scoped_lock lock{mut};
+            std::vector<rexmit> ret;
+            auto now = scheduler_clock::now();
+            forget_requesters(now);
+            if (bytes_per_second != 0) refill();
+            while (!pending.empty() && ret.size() < max_count) {
+                auto it = pending.begin();
+                auto msg_cost = cost(it->second);
+                if (bytes_per_second != 0) {
+                    // message larger than the whole budget would never be sent
+                    if (tokens < std::min(msg_cost, max_tokens)) break;
+                    tokens -= std::min(msg_cost, tokens);
+                }
+                auto seen = history.find(it->first);
+                if (seen != history.end()) {
+                    seen->second.sent = now;
+                    sent_order.emplace_back(now, it->first);
+                }
+                ret.push_back(rexmit{std::move(it->second.msg), std::move(it->second.requesters)});
+                pending.erase(it);
+            }
+            return ret;
+        }
+
+        size_t atomic_size() {
+            std::scoped_lock lock{mut};
+            return pending.size();
+        }
+    };
+}
+
+#endif //SIKRADIO_SENDER_REXMIT_SCHEDULER_HPP
@@ -0,0 +1,80 @@
+#ifndef SIKRADIO_SENDER_REXMIT_WINDOW_HPP
+#define SIKRADIO_SENDER_REXMIT_WINDOW_HPP
+
+#include <mutex>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <algorithm>
+#include "../common/types.hpp"
+
+namespace sikradio::sender {
+    // remembers which messages were retransmitted recently, slots are aligned with the cache,
+    // so that each message in it has one bit in each of two bitmaps: of the current interval
+    // and of the previous one, message is suppressed for at least an interval after it was sent
+    class rexmit_window {
+    private:
+        using window_clock = std::chrono::steady_clock;
+
+        std::mutex mut{};
+        size_t container_size;
+        size_t package_size;
+        std::chrono::milliseconds interval;
+        std::vector<sikradio::common::msg_id_t> slot_ids;
+        std::vector<uint64_t> current;
+        std::vector<uint64_t> previous;
+        window_clock::time_point interval_start{window_clock::now()};
+
+        size_t internal_id(sikradio::common::msg_id_t id) const {
+            return ((id / package_size) % container_size);
+        }
+
+        // bitmap of an interval that ended long ago is empty
+        void rotate() {
+            auto now = window_clock::now();
+            if (now - interval_start < interval) return;
+            if (now - interval_start < 2*interval) {
+                std::swap(current, previous);
+                interval_start += interval;
+            } else {
+                std::fill(previous.begin(), previous.end(), 0);
+                interval_start = now;
+            }
+            std::fill(current.begin(), current.end(), 0);
+        }
+
+    public:
+        // interval of 0 does not suppress anything
+        explicit rexmit_window(size_t container_size, size_t package_size, std::chrono::milliseconds interval) :
+                container_size(std::max<size_t>(container_size, 1)),
+                package_size(std::max<size_t>(package_size, 1)),
+                interval(interval),
+                slot_ids(this->container_size, 0),
+                current((this->container_size + 63) / 64, 0),
+                previous((this->container_size + 63) / 64, 0) {}
+
+        void atomic_mark_sent(sikradio::common::msg_id_t id) {
+            if (interval.count() == 0) return;
+            std::scoped_lock lock{mut};
+            rotate();
+            auto slot = internal_id(id);
+            if (slot_ids[slot] != id) {
+                // bits of a message that used the slot before are no longer valid
+                previous[slot / 64] &= ~(1ull << (slot % 64));
+                slot_ids[slot] = id;
+            }
+            current[slot / 64] |= (1ull << (slot % 64));
+        }
+
+        bool atomic_is_suppressed(sikradio::common::msg_id_t id) {
+            if (interval.count() == 0) return false;
+            std::scoped_lock lock{mut};
+            rotate();
+            auto slot = internal_id(id);
+            if (slot_ids[slot] != id) return false;
+            return ((current[slot / 64] | previous[slot / 64]) >> (slot % 64)) & 1;
+        }
+    };
+}
+
+#endif //SIKRADIO_SENDER_REXMIT_WINDOW_HPP
@@ -4,16 +4,47 @@
 #include <cstdint>
 #include <iostream>
 #include <future>
+#include <optional>
+#include <thread>
 #include <utility>
+#include <memory>
+#include <vector>
+#include <set>
+#include <atomic>
+#include <string>
 
 #include "../common/types.hpp"
 #include "../common/data_msg.hpp"
 #include "../common/ctrl_socket.hpp"
+#include "../common/metrics.hpp"
+#include "../common/stats_server.hpp"
+#include "../common/transport.hpp"
+#include "../common/realtime.hpp"
+#include "../common/pcm_codec.hpp"
+#include "../common/address_helpers.hpp"
 #include "data_socket.hpp"
 #include "lockable_cache.hpp"
 #include "lockable_queue.hpp"
+#include "rexmit_scheduler.hpp"
+#include "rexmit_window.hpp"
+#include "fec_encoder.hpp"
+#include "input_source.hpp"
+#include "archive.hpp"
+#include "mapped_input.hpp"
 
 namespace sikradio::sender {
+    namespace {
+        // how often stats thread checks if transmission has finished
+        const int stats_poll_timeout_in_ms = 100;
+        // maximum number of messages sent together by the sender thread
+        const size_t send_batch_size = 32;
+        // catch up burst is taken from the queue in batches of this size
+        const size_t burst_batch_size = 8;
+    }
+
+    // threads that can be pinned to a cpu in realtime mode
+    const std::set<std::string> realtime_roles{"sender"};
+
     class transmitter {
     private:
         // transmitter parameters
@@ -24,89 +55,308 @@ namespace sikradio::sender {
         uint16_t DATA_PORT;
         uint16_t CTRL_PORT;
         std::string NAME;
+        uint16_t FEC_PORT;
+        size_t FEC_GROUP;
+        size_t FEC_INTERLEAVE;
+        uint16_t STATS_PORT;
+        std::string MCAST_IF;
+        std::shared_ptr<sikradio::common::transport> transport;
+        sikradio::common::realtime_config realtime;
+        std::shared_ptr<sikradio::sender::input_source> input;
+        std::shared_ptr<sikradio::sender::archive> archive;
+        size_t CODEC_CHANNELS;
+        size_t FAST_START_SPEED;
+        uint64_t LIVE_RATE;
+        size_t REXMIT_BUDGET;
+        size_t REXMIT_INTERVAL;
+        bool MCAST_NACKS;
+        size_t UNICAST_LIMIT;
 
         // transmitter state
+        sikradio::common::ctrl_socket ctrl_socket;
         size_t sent_msgs_cache_size;
         sikradio::sender::lockable_queue send_q{};
-        sikradio::sender::lockable_queue resend_q{};
+        sikradio::sender::lockable_queue burst_q{};
+        std::atomic<sikradio::common::msg_id_t> read_bytes{0};  // first byte number of the next packet
         sikradio::sender::lockable_cache sent_msgs;
+        sikradio::sender::rexmit_scheduler rexmits;
+        sikradio::sender::rexmit_window rexmitted;
         sikradio::common::msg_id_t session_id;
 
-        void retransmit_ids(const std::vector<sikradio::common::msg_id_t>& msg_ids) {
+        // transmitter metrics, counters are updated from the hot path without locking
+        sikradio::common::metrics::registry metrics{};
+        sikradio::common::metrics::counter& packets_sent;
+        sikradio::common::metrics::counter& bytes_sent;
+        sikradio::common::metrics::counter& parity_sent;
+        sikradio::common::metrics::counter& rexmit_requested;
+        sikradio::common::metrics::counter& rexmit_cache_hits;
+        sikradio::common::metrics::counter& rexmit_cache_misses;
+        sikradio::common::metrics::counter& rexmit_archive_hits;
+        sikradio::common::metrics::counter& rexmit_sent;
+        sikradio::common::metrics::counter& rexmit_unicast;
+        sikradio::common::metrics::counter& rexmit_expired;
+        sikradio::common::metrics::counter& rexmit_suppressed;
+        sikradio::common::metrics::counter& packets_compressed;
+        sikradio::common::metrics::counter& fast_starts;
+        sikradio::common::metrics::counter& burst_sent;
+
+        void retransmit_ids(
+                const std::vector<sikradio::common::msg_id_t>& msg_ids, 
+                const struct sockaddr_in& receiver) {
+            rexmit_requested.add(msg_ids.size());
+            // multicast requests are answered with multicast, so that receivers that heard them get it
+            auto requester = MCAST_NACKS ? std::nullopt : std::make_optional(receiver);
             for (auto id : msg_ids) {
+                // other receivers asked for it too, and it is on its way to all of them
+                if (rexmitted.atomic_is_suppressed(id)) {
+                    rexmit_suppressed.add();
+                    continue;
+                }
                 optional<sikradio::common::data_msg> msg = sent_msgs.atomic_get(id);
                 if (msg.has_value() && msg.value().get_id() == id) {
                     // message with desired id was still stored in cache
-                    resend_q.atomic_push(msg.value());
+                    rexmits.atomic_push(msg.value(), true, requester);
+                    rexmit_cache_hits.add();
+                    continue;
+                }
+                rexmit_cache_misses.add();
+                if (!archive) continue;
+                msg = archive->atomic_get(id, session_id);
+                if (msg.has_value()) {
+                    // it was requested after leaving the cache, so it does not expire with it
+                    rexmits.atomic_push(msg.value(), false, requester);
+                    rexmit_archive_hits.add();
                 }
             }
         }
 
+        // queues the most recent cached messages to be sent in a burst, and tells the receiver
+        // which ones they are and which one is the newest, ignored if fast start is disabled
+        void start_burst(const sikradio::common::ctrl_msg& msg, const struct sockaddr_in& receiver) {
+            auto read = read_bytes.load();
+            if (FAST_START_SPEED == 0 || read == 0) return;
+            uint64_t bytes;
+            try {
+                bytes = msg.get_catch_up_bytes();
+            } catch (sikradio::common::exceptions::ctrl_msg_exception &e) {
+                return;
+            }
+            auto head = read - PSIZE;
+            // the oldest message in cache may be overwritten before it is sent
+            auto count = std::min<uint64_t>({
+                std::max<uint64_t>(bytes / PSIZE, 1),
+                std::max<size_t>(sent_msgs_cache_size - 1, 1),
+                read / PSIZE});
+            auto first = head - (count - 1)*PSIZE;
+            // reply goes first, so that receiver knows the session before the burst arrives
+            ctrl_socket.force_send_to(receiver, sikradio::common::make_catch_up_reply(session_id, first, head));
+            for (auto id = first; id <= head; id += PSIZE) {
+                auto cached = sent_msgs.atomic_get(id);
+                if (cached.has_value() && cached.value().get_id() == id) burst_q.atomic_push(cached.value());
+            }
+            fast_starts.add();
+        }
+
+        void register_probes() {
+            metrics.register_probe("send_queue_depth", [this]() {
+                return static_cast<double>(send_q.atomic_size());
+            });
+            metrics.register_probe("resend_queue_depth", [this]() {
+                return static_cast<double>(rexmits.atomic_size());
+            });
+            metrics.register_probe("rexmit_cache_hit_ratio", [this]() {
+                auto hits = rexmit_cache_hits.get();
+                auto all = hits + rexmit_cache_misses.get();
+                return (all == 0) ? 0.0 : static_cast<double>(hits) / all;
+            });
+        }
+
+        // id of the oldest message that is still in the cache, retransmissions of older ones come too
+        // late for receivers that play the live stream
+        sikradio::common::msg_id_t oldest_cached_id() const {
+            auto read = read_bytes.load();
+            auto cached_bytes = sent_msgs_cache_size*PSIZE;
+            return (read > cached_bytes) ? read - cached_bytes : 0;
+        }
+
+        // data messages are compressed only when sent, so cache, archive and parity keep raw audio
+        // and every message can be decoded on its own
+        sikradio::common::msg_t make_sendable(sikradio::common::pcm_codec& codec, const sikradio::common::data_msg& msg) {
+            if (CODEC_CHANNELS == 0) return msg.sendable();
+            auto ret = codec.sendable(msg);
+            if (ret.size() < msg.get_data().size() + 2*sizeof(sikradio::common::msg_id_t)) packets_compressed.add();
+            return ret;
+        }
+
         void read_input() {
             sikradio::common::msg_t buf(PSIZE);
             sikradio::common::msg_id_t current_msg_id = 0;
 
-            while (!std::cin.eof()) {
-                std::cin.read(reinterpret_cast<char *>(buf.data()), buf.size());  // or `&buf[0]` on older platforms
+            while (true) {
+                try {
+                    if (!input->read_packet(buf)) break;
+                } catch (sikradio::common::exceptions::input_exception &e) {
+                    // input that became unreadable ends transmission, like end of file
+                    std::cerr << e.what() << std::endl;
+                    break;
+                }
                 sikradio::common::data_msg msg(current_msg_id, buf);
                 current_msg_id += PSIZE;
 
                 send_q.atomic_push(msg);
                 sent_msgs.atomic_push(msg);
+                if (archive) archive->atomic_push(msg, session_id);
+                read_bytes.store(current_msg_id);
             }
         }
 
         void run_listener(std::shared_future<void> reading_complete) {
-            sikradio::common::ctrl_socket sock{CTRL_PORT};
+            // receivers may multicast retransmission requests to the data group, on the control port
+            if (MCAST_NACKS) ctrl_socket.join_group(sikradio::common::make_address(MCAST_ADDR, CTRL_PORT).sin_addr);
 
             while (reading_complete.wait_for(std::chrono::milliseconds(1)) == std::future_status::timeout) {
-                auto req = sock.try_read();
+                auto req = ctrl_socket.try_read();
                 if (!req.has_value()) continue;
                 
                 sikradio::common::ctrl_msg msg{std::get<0>(req.value())};
                 struct sockaddr_in sender{std::get<1>(req.value())};
                 if (msg.is_lookup()) {
                     auto reply = sikradio::common::make_reply(NAME, MCAST_ADDR, DATA_PORT);
-                    sock.force_send_to(sender, reply);
+                    ctrl_socket.force_send_to(sender, reply);
                 }
                 if (msg.is_rexmit()) {
-                    retransmit_ids(msg.get_rexmit_ids());
+                    retransmit_ids(msg.get_rexmit_ids(), sender);
+                }
+                if (msg.is_catch_up()) {
+                    start_burst(msg, sender);
                 }
             }
         }
 
-        void run_retransmitter(std::shared_future<void> reading_complete) {
-            sikradio::sender::data_socket sock{MCAST_ADDR, static_cast<in_port_t>(DATA_PORT)};
+        // sends catch up bursts to the data group, oldest message first, at FAST_START_SPEED times
+        // the live rate, receivers that did not ask for the burst ignore messages they already have
+        void run_fast_starter(std::shared_future<void> reading_complete) {
+            sikradio::sender::data_socket sock{MCAST_ADDR, static_cast<in_port_t>(DATA_PORT), MCAST_IF, transport};
+            sikradio::common::pcm_codec codec{CODEC_CHANNELS};
+            std::optional<sikradio::sender::pacer> pacer{std::nullopt};
 
             while (reading_complete.wait_for(std::chrono::milliseconds(1)) == std::future_status::timeout) {
-                // make set not to retransmit same message twice in one batch
-                std::set<sikradio::common::data_msg> unique_msgs = resend_q.atomic_get_unique();
-                for (auto msg : unique_msgs) {
+                auto msgs = burst_q.atomic_pop_batch(burst_batch_size);
+                if (msgs.empty()) {
+                    // next burst is paced from its own start
+                    pacer.reset();
+                    continue;
+                }
+                if (!pacer.has_value()) pacer.emplace(FAST_START_SPEED*LIVE_RATE);
+                for (auto& msg : msgs) {
                     msg.set_session_id(session_id);
                     try {
-                        auto sndbl_msg = msg.sendable();
-                        sock.transmit_force(sndbl_msg);
+                        auto sendable = make_sendable(codec, msg);
+                        pacer.value().wait(msg.get_data().size());
+                        sock.transmit_force(sendable);
+                        burst_sent.add();
                     } catch (sikradio::common::exceptions::data_msg_exception &e) {
                         // ignore
                     }
                 }
-                std::this_thread::sleep_for(std::chrono::milliseconds(RTIME));
             }
         }
 
+        // retransmissions are sent only when no live message is waiting, within their budget
+        void send_rexmits(
+                sikradio::sender::data_socket& sock,
+                sikradio::common::pcm_codec& codec,
+                std::vector<sikradio::common::msg_t>& sendable_msgs) {
+            if (send_q.atomic_size() != 0) return;
+            rexmit_expired.add(rexmits.atomic_drop_expired(oldest_cached_id()));
+            auto due = rexmits.atomic_pop_due(send_batch_size);
+            if (due.empty()) return;
+            sendable_msgs.clear();
+            for (auto& [msg, requesters] : due) {
+                msg.set_session_id(session_id);
+                try {
+                    auto sendable = make_sendable(codec, msg);
+                    if (requesters.empty()) {
+                        sendable_msgs.push_back(std::move(sendable));
+                        // only multicast retransmission reaches other receivers that may ask for it
+                        rexmitted.atomic_mark_sent(msg.get_id());
+                        continue;
+                    }
+                    for (auto& requester : requesters) {
+                        ctrl_socket.send_data_to(requester, sendable);
+                        rexmit_unicast.add();
+                    }
+                    rexmit_sent.add();
+                } catch (sikradio::common::exceptions::data_msg_exception &e) {
+                    // ignore
+                } catch (sikradio::common::exceptions::socket_exception &e) {
+                    // lost like any other datagram, receiver asks again
+                }
+            }
+            if (!sendable_msgs.empty()) {
+                sock.transmit_batch_force(sendable_msgs);
+                rexmit_sent.add(sendable_msgs.size());
+            }
+        }
+
+        // the only thread sending live messages and retransmissions, so that live ones go first
         void run_sender(std::shared_future<void> reading_complete) {
-            sikradio::sender::data_socket sock{MCAST_ADDR, static_cast<in_port_t>(DATA_PORT)};
+            sikradio::common::enter_role(realtime, "sender");
+            sikradio::sender::data_socket sock{MCAST_ADDR, static_cast<in_port_t>(DATA_PORT), MCAST_IF, transport};
+            // parity is sent to separate port, so that receivers without fec ignore it
+            sikradio::sender::data_socket fec_sock{MCAST_ADDR, static_cast<in_port_t>(FEC_PORT), MCAST_IF, transport};
+            sikradio::sender::fec_encoder encoder{FEC_GROUP, FEC_INTERLEAVE, PSIZE};
+            sikradio::common::pcm_codec codec{CODEC_CHANNELS};
+            bool fec_enabled = (FEC_PORT != 0 && FEC_GROUP > 1 
+                && FEC_GROUP <= UINT16_MAX && FEC_INTERLEAVE <= UINT16_MAX);
+            std::vector<sikradio::common::msg_t> sendable_msgs;
+            std::vector<sikradio::common::msg_t> parity_msgs;
 
             while (reading_complete.wait_for(std::chrono::milliseconds(1)) == std::future_status::timeout) {
-                optional<sikradio::common::data_msg> msg = send_q.atomic_get_and_pop();
-                if (msg.has_value()) {
-                    msg.value().set_session_id(session_id);
+                // messages queued since last iteration are sent together, with a single system call
+                // if transport supports it
+                auto msgs = send_q.atomic_pop_batch(send_batch_size);
+                if (msgs.empty()) {
+                    send_rexmits(sock, codec, sendable_msgs);
+                    continue;
+                }
+                sendable_msgs.clear();
+                parity_msgs.clear();
+                size_t sendable_bytes = 0;
+                for (auto& msg : msgs) {
+                    msg.set_session_id(session_id);
                     try {
-                        auto sndbl_msg = msg.value().sendable();
-                        sock.transmit_force(sndbl_msg);
+                        sendable_msgs.push_back(make_sendable(codec, msg));
+                        sendable_bytes += sendable_msgs.back().size();
                     } catch (sikradio::common::exceptions::data_msg_exception &e) {
                         // ignore
                     }
+                    if (!fec_enabled) continue;
+                    auto parity = encoder.push(msg, session_id);
+                    if (parity.has_value()) parity_msgs.push_back(parity.value().sendable());
+                }
+                if (!sendable_msgs.empty()) {
+                    sock.transmit_batch_force(sendable_msgs);
+                    packets_sent.add(sendable_msgs.size());
+                    bytes_sent.add(sendable_bytes);
+                }
+                if (!parity_msgs.empty()) {
+                    fec_sock.transmit_batch_force(parity_msgs);
+                    parity_sent.add(parity_msgs.size());
+                }
+                send_rexmits(sock, codec, sendable_msgs);
+            }
+        }
+
+        void run_stats_server(std::shared_future<void> reading_complete) {
+            sikradio::common::stats_server server{STATS_PORT, metrics};
+
+            while (reading_complete.wait_for(std::chrono::milliseconds(0)) == std::future_status::timeout) {
+                if (!server.wait_for_client(stats_poll_timeout_in_ms)) continue;
+                try {
+                    server.serve_one();
+                } catch (sikradio::common::exceptions::socket_exception &e) {
+                    // keep serving other clients
                 }
             }
         }
@@ -119,7 +369,23 @@ namespace sikradio::sender {
                 std::string MCAST_ADDR,
                 uint16_t DATA_PORT,
                 uint16_t CTRL_PORT,
-                std::string NAME) : 
+                std::string NAME,
+                uint16_t FEC_PORT=0,
+                size_t FEC_GROUP=0,
+                size_t FEC_INTERLEAVE=1,
+                uint16_t STATS_PORT=0,
+                std::string MCAST_IF="",
+                std::shared_ptr<sikradio::common::transport> transport=sikradio::common::default_transport(),
+                sikradio::common::realtime_config realtime={},
+                std::shared_ptr<sikradio::sender::input_source> input=std::make_shared<sikradio::sender::fd_input>(),
+                std::shared_ptr<sikradio::sender::archive> archive=nullptr,
+                size_t CODEC_CHANNELS=0,
+                size_t FAST_START_SPEED=0,
+                uint64_t LIVE_RATE=176400,
+                size_t REXMIT_BUDGET=20,
+                size_t REXMIT_INTERVAL=0,
+                bool MCAST_NACKS=false,
+                size_t UNICAST_LIMIT=0) : 
             PSIZE(PSIZE),
             FSIZE(FSIZE),
             RTIME(RTIME),
@@ -127,24 +393,75 @@ namespace sikradio::sender {
             DATA_PORT(DATA_PORT),
             CTRL_PORT(CTRL_PORT),
             NAME(std::move(NAME)),
+            FEC_PORT(FEC_PORT),
+            FEC_GROUP(FEC_GROUP),
+            FEC_INTERLEAVE(FEC_INTERLEAVE),
+            STATS_PORT(STATS_PORT),
+            MCAST_IF(std::move(MCAST_IF)),
+            transport(std::move(transport)),
+            realtime(std::move(realtime)),
+            input(std::move(input)),
+            archive(std::move(archive)),
+            CODEC_CHANNELS(CODEC_CHANNELS),
+            FAST_START_SPEED(FAST_START_SPEED),
+            LIVE_RATE(LIVE_RATE),
+            REXMIT_BUDGET(REXMIT_BUDGET),
+            REXMIT_INTERVAL(REXMIT_INTERVAL),
+            MCAST_NACKS(MCAST_NACKS),
+            UNICAST_LIMIT(UNICAST_LIMIT),
+            ctrl_socket(CTRL_PORT, 500, false, true, this->transport),
             sent_msgs_cache_size(1 + ((FSIZE - 1) / PSIZE)),
-            sent_msgs(sent_msgs_cache_size),
-            session_id(static_cast<sikradio::common::msg_id_t>(time(nullptr))) {}
+            sent_msgs(sent_msgs_cache_size, PSIZE),
+            // unused budget is kept for RTIME, but at least one message always fits in it
+            rexmits(LIVE_RATE*REXMIT_BUDGET/100, std::max<uint64_t>(
+                LIVE_RATE*REXMIT_BUDGET/100*RTIME/1000, PSIZE + 2*sizeof(sikradio::common::msg_id_t)),
+                UNICAST_LIMIT, std::chrono::milliseconds(REXMIT_INTERVAL)),
+            rexmitted(sent_msgs_cache_size, PSIZE, std::chrono::milliseconds(REXMIT_INTERVAL)),
+            session_id(static_cast<sikradio::common::msg_id_t>(time(nullptr))),
+            packets_sent(metrics.get_counter("packets_sent")),
+            bytes_sent(metrics.get_counter("bytes_sent")),
+            parity_sent(metrics.get_counter("parity_sent")),
+            rexmit_requested(metrics.get_counter("rexmit_requested")),
+            rexmit_cache_hits(metrics.get_counter("rexmit_cache_hits")),
+            rexmit_cache_misses(metrics.get_counter("rexmit_cache_misses")),
+            rexmit_archive_hits(metrics.get_counter("rexmit_archive_hits")),
+            rexmit_sent(metrics.get_counter("rexmit_sent")),
+            rexmit_unicast(metrics.get_counter("rexmit_unicast")),
+            rexmit_expired(metrics.get_counter("rexmit_expired")),
+            rexmit_suppressed(metrics.get_counter("rexmit_suppressed")),
+            packets_compressed(metrics.get_counter("packets_compressed")),
+            fast_starts(metrics.get_counter("fast_starts")),
+            burst_sent(metrics.get_counter("burst_sent")) {
+            register_probes();
+        }
+
+        sikradio::common::metrics::registry& get_metrics() {
+            return metrics;
+        }
 
         void transmit() {
             std::promise<void> reading_complete;
             std::shared_future<void> sc_future(reading_complete.get_future());
+            sikradio::common::lock_memory(realtime);
 
             std::thread sender(&transmitter::run_sender, this, sc_future);
             std::thread listener(&transmitter::run_listener, this, sc_future);
-            std::thread retransmitter(&transmitter::run_retransmitter, this, sc_future);
+            std::optional<std::thread> fast_starter;
+            if (FAST_START_SPEED != 0)
+                fast_starter.emplace(&transmitter::run_fast_starter, this, sc_future);
+            std::optional<std::thread> stats;
+            if (STATS_PORT != 0)
+                stats.emplace(&transmitter::run_stats_server, this, sc_future);
 
             read_input();
             reading_complete.set_value();
 
             listener.join();
-            retransmitter.join();
             sender.join();
+            if (fast_starter.has_value())
+                fast_starter.value().join();
+            if (stats.has_value())
+                stats.value().join();
         }
     };
 }
@@ -1,13 +1,33 @@
 #include "catch.hpp"
 
 #include <set>
-#include <cmemory>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <cstring>
+#include <cmath>
+#include <arpa/inet.h>
 
 #include "../src/common/types.hpp"
 #include "../src/common/ctrl_msg.hpp"
 #include "../src/common/ctrl_socket.hpp"
 #include "../src/common/exceptions.hpp"
 #include "../src/common/data_msg.hpp"
+#include "../src/common/fec_msg.hpp"
+#include "../src/common/metrics.hpp"
+#include "../src/common/stats_server.hpp"
+#include "../src/common/mpmc_ring.hpp"
+#include "../src/common/transport.hpp"
+#include "../src/common/memory_transport.hpp"
+#include "../src/common/impaired_transport.hpp"
+#include "../src/common/uring_transport.hpp"
+#include "../src/common/transport_factory.hpp"
+#include "../src/common/realtime.hpp"
+#include "../src/common/pcm_codec.hpp"
+#include "../src/common/address_helpers.hpp"
 
 #ifndef UDP_DATAGRAM_DATA_LEN_MAX
 #define UDP_DATAGRAM_DATA_LEN_MAX 65535
@@ -65,6 +85,33 @@ TEST_CASE("control message construction") {
             }
         }
     }
+
+    SECTION("catch up message") {
+        auto msg = sikradio::common::make_catch_up(49152);
+
+        REQUIRE(msg.is_catch_up());
+        REQUIRE_FALSE(msg.is_rexmit());
+        REQUIRE_FALSE(msg.is_catch_up_reply());
+        REQUIRE(msg.get_catch_up_bytes() == 49152);
+        REQUIRE_THROWS_AS(
+            sikradio::common::ctrl_msg("CATCH_UP_PLEASE many\n").get_catch_up_bytes(),
+            sikradio::common::ctrl_msg_exception);
+    }
+
+    SECTION("catch up reply message") {
+        auto msg = sikradio::common::make_catch_up_reply(1589, 512, 2048);
+
+        REQUIRE(msg.is_catch_up_reply());
+        REQUIRE_FALSE(msg.is_catch_up());
+        REQUIRE_FALSE(msg.is_reply());
+        auto [session_id, first, head] = msg.get_catch_up_reply_data();
+        REQUIRE(session_id == 1589);
+        REQUIRE(first == 512);
+        REQUIRE(head == 2048);
+        REQUIRE_THROWS_AS(
+            sikradio::common::ctrl_msg("CATCH_UP_HERE 1 2048 512\n").get_catch_up_reply_data(),
+            sikradio::common::ctrl_msg_exception);
+    }
 }
 
 TEST_CASE("control socket construction") {
@@ -127,3 +174,614 @@ TEST_CASE("comparison of data messages") {
 
         REQUIRE(msg1 < msg2);
     }
+}
+
+TEST_CASE("parity message") {
+    sikradio::common::msg_t parity = {1,2,3,4,5,6,7,8,9,10};
+    auto msg = sikradio::common::fec_msg(7, 30, 3, parity);
+
+    SECTION("returns correct attributes") {
+        REQUIRE(msg.get_session_id() == 7);
+        REQUIRE(msg.get_first_id() == 30);
+        REQUIRE(msg.get_count() == 3);
+        REQUIRE(msg.protected_id(2) == 50);
+    }
+
+    SECTION("from raw received message") {
+        auto rcvd = sikradio::common::fec_msg(msg.sendable());
+
+        REQUIRE(rcvd.get_session_id() == 7);
+        REQUIRE(rcvd.get_first_id() == 30);
+        REQUIRE(rcvd.get_count() == 3);
+        REQUIRE(rcvd.get_parity() == parity);
+    }
+
+    SECTION("with stride") {
+        auto interleaved = sikradio::common::fec_msg(7, 30, 3, 4, parity);
+        auto rcvd = sikradio::common::fec_msg(interleaved.sendable());
+
+        REQUIRE(rcvd.get_stride() == 4);
+        REQUIRE(rcvd.protected_id(1) == 70);
+        REQUIRE(rcvd.protects(30));
+        REQUIRE(rcvd.protects(110));
+        REQUIRE_FALSE(rcvd.protects(40));
+        REQUIRE_FALSE(rcvd.protects(150));
+    }
+
+    SECTION("too short raw message throws") {
+        sikradio::common::msg_t raw = {1,2,3};
+
+        REQUIRE_THROWS_AS(sikradio::common::fec_msg(raw), sikradio::common::exceptions::data_msg_exception);
+    }
+}
+
+TEST_CASE("xor of messages") {
+    // long enough to use vector and scalar parts of the kernel
+    sikradio::common::msg_t a(83), b(83);
+    for (size_t i = 0; i < a.size(); i++) {
+        a[i] = static_cast<sikradio::common::byte_t>(i);
+        b[i] = static_cast<sikradio::common::byte_t>(3*i + 7);
+    }
+    auto parity = a;
+    sikradio::common::xor_into(parity.data(), b.data(), b.size());
+
+    for (size_t i = 0; i < a.size(); i++)
+        REQUIRE(parity[i] == (a[i] ^ b[i]));
+
+    sikradio::common::xor_into(parity.data(), b.data(), b.size());
+    REQUIRE(parity == a);
+}
+
+TEST_CASE("metrics") {
+    sikradio::common::metrics::registry registry;
+
+    SECTION("counter sums increments from all threads") {
+        auto& counter = registry.get_counter("packets");
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 20; t++) {
+            threads.emplace_back([&counter]() {
+                for (int i = 0; i < 1000; i++) counter.add();
+            });
+        }
+        for (auto& t : threads) t.join();
+
+        REQUIRE(counter.get() == 20000);
+        REQUIRE(&registry.get_counter("packets") == &counter);
+    }
+
+    SECTION("render lists metrics sorted by name") {
+        registry.get_counter("b_counter").add(3);
+        registry.get_gauge("c_gauge").set(-2);
+        registry.register_probe("a_probe", []() { return 0.5; });
+
+        REQUIRE(registry.render() == "a_probe 0.5\nb_counter 3\nc_gauge -2\n");
+    }
+}
+
+TEST_CASE("histogram") {
+    sikradio::common::metrics::histogram h;
+
+    SECTION("is empty before recording") {
+        REQUIRE(h.get_count() == 0);
+        REQUIRE(h.get_percentile(0.99) == 0);
+    }
+
+    SECTION("small values are exact") {
+        for (uint64_t v = 1; v <= 10; v++) h.record(v);
+
+        REQUIRE(h.get_count() == 10);
+        REQUIRE(h.get_percentile(0.5) == 5);
+        REQUIRE(h.get_percentile(1.0) == 10);
+        REQUIRE(h.get_max() == 10);
+    }
+
+    SECTION("large values are within bucket precision") {
+        for (uint64_t v = 1; v <= 100000; v++) h.record(v);
+
+        auto p99 = h.get_percentile(0.99);
+        REQUIRE(p99 >= 99000);
+        REQUIRE(p99 <= 99000 + 99000/16);
+        REQUIRE(h.get_percentile(1.0) == 100000);
+    }
+
+    SECTION("is reported as percentiles") {
+        sikradio::common::metrics::registry registry;
+        registry.get_histogram("latency").record(3);
+        auto rendered = registry.render();
+
+        REQUIRE(rendered.find("latency_count 1\n") != std::string::npos);
+        REQUIRE(rendered.find("latency_p50 3\n") != std::string::npos);
+        REQUIRE(rendered.find("latency_p999 3\n") != std::string::npos);
+        REQUIRE(rendered.find("latency_max 3\n") != std::string::npos);
+    }
+}
+
+TEST_CASE("stats server") {
+    sikradio::common::metrics::registry registry;
+    registry.get_counter("packets").add(7);
+    in_port_t port = 45831;
+    sikradio::common::stats_server server{port, registry};
+
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    REQUIRE(connect(sock, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == 0);
+
+    REQUIRE(server.wait_for_client(1000));
+    server.serve_one();
+    char buf[64]{};
+    std::string received;
+    ssize_t len;
+    while ((len = read(sock, buf, sizeof(buf))) > 0) received.append(buf, len);
+    close(sock);
+
+    REQUIRE(received == "packets 7\n");
+}
+
+TEST_CASE("mpmc ring") {
+    sikradio::common::mpmc_ring<int> ring{3};
+
+    SECTION("capacity is rounded up to power of two") {
+        REQUIRE(ring.capacity() == 4);
+    }
+
+    SECTION("is empty after construction") {
+        REQUIRE(ring.try_pop() == std::nullopt);
+    }
+
+    SECTION("returns values in order of insertion") {
+        for (int i = 0; i < 4; i++) REQUIRE(ring.try_push(i));
+        for (int i = 0; i < 4; i++) REQUIRE(ring.try_pop() == i);
+        REQUIRE(ring.try_pop() == std::nullopt);
+    }
+
+    SECTION("rejects values when full") {
+        for (int i = 0; i < 4; i++) REQUIRE(ring.try_push(i));
+        int extra = 4;
+        REQUIRE(!ring.try_push(extra));
+        REQUIRE(ring.try_pop() == 0);
+        REQUIRE(ring.try_push(extra));
+    }
+
+    SECTION("passes every value once between threads") {
+        sikradio::common::mpmc_ring<int> shared{64};
+        const int n_values = 10000;
+        std::vector<std::thread> producers;
+        for (int t = 0; t < 2; t++) {
+            producers.emplace_back([&shared, t]() {
+                for (int i = t; i < n_values; i += 2) {
+                    int value = i;
+                    while (!shared.try_push(value)) std::this_thread::yield();
+                }
+            });
+        }
+        std::vector<int> received;
+        while (received.size() < static_cast<size_t>(n_values)) {
+            auto value = shared.try_pop();
+            if (value.has_value()) received.push_back(value.value());
+        }
+        for (auto& producer : producers) producer.join();
+        std::sort(received.begin(), received.end());
+        for (int i = 0; i < n_values; i++) REQUIRE(received[i] == i);
+    }
+}
+
+TEST_CASE("memory transport") {
+    auto network = std::make_shared<sikradio::common::memory_transport>();
+    const std::string text = "some datagram";
+    auto data = reinterpret_cast<const sikradio::common::byte_t *>(text.data());
+    sikradio::common::byte_t buf[UDP_DATAGRAM_DATA_LEN_MAX];
+
+    SECTION("delivers unicast datagrams to bound socket") {
+        auto receiver = network->open_datagram();
+        receiver->bind(sikradio::common::make_address("0.0.0.0", 20000));
+        auto sender = network->open_datagram();
+        sender->send_to(sikradio::common::make_address("127.0.0.1", 20000), data, text.size());
+
+        struct sockaddr_in from{};
+        auto len = receiver->receive(buf, sizeof(buf), &from);
+        REQUIRE(len == text.size());
+        REQUIRE(std::string(buf, buf + len.value()) == text);
+        REQUIRE(ntohs(from.sin_port) >= 49152);
+
+        // reply reaches the sender on its ephemeral port
+        receiver->send_to(from, data, text.size());
+        REQUIRE(sender->receive(buf, sizeof(buf)) == text.size());
+    }
+
+    SECTION("delivers multicast datagrams only to sockets that joined the group") {
+        auto group = sikradio::common::make_address("239.10.11.12", 20001);
+        auto member = network->open_datagram();
+        member->join_group(group.sin_addr);
+        member->enable_reuse_address();
+        member->set_receive_timeout(10);
+        member->bind(group);
+        auto other_member = network->open_datagram();
+        other_member->join_group(group.sin_addr);
+        other_member->enable_reuse_address();
+        other_member->bind(group);
+        auto stranger = network->open_datagram();
+        stranger->set_receive_timeout(10);
+        stranger->bind(sikradio::common::make_address("0.0.0.0", 20001));
+
+        auto sender = network->open_datagram();
+        sender->connect(group);
+        sender->send(data, text.size());
+
+        REQUIRE(member->receive(buf, sizeof(buf)) == text.size());
+        REQUIRE(other_member->receive(buf, sizeof(buf)) == text.size());
+        REQUIRE(stranger->receive(buf, sizeof(buf)) == std::nullopt);
+        REQUIRE(member->receive(buf, sizeof(buf)) == std::nullopt);
+    }
+
+    SECTION("does not bind the same address twice without reuse") {
+        auto first = network->open_datagram();
+        first->bind(sikradio::common::make_address("0.0.0.0", 20002));
+        auto second = network->open_datagram();
+        REQUIRE_THROWS_AS(
+            second->bind(sikradio::common::make_address("0.0.0.0", 20002)),
+            sikradio::common::exceptions::socket_exception);
+    }
+
+    SECTION("frees the address when socket is closed") {
+        auto first = network->open_datagram();
+        first->bind(sikradio::common::make_address("0.0.0.0", 20003));
+        first.reset();
+        auto second = network->open_datagram();
+        REQUIRE_NOTHROW(second->bind(sikradio::common::make_address("0.0.0.0", 20003)));
+    }
+}
+
+TEST_CASE("control socket over memory transport") {
+    auto network = std::make_shared<sikradio::common::memory_transport>();
+    sikradio::common::ctrl_socket listener{20010, 100, false, true, network};
+    sikradio::common::ctrl_socket client{20010, 100, true, false, network};
+
+    client.send_to(sikradio::common::make_address("255.255.255.255", 20010), sikradio::common::make_lookup());
+    auto req = listener.try_read();
+    REQUIRE(req.has_value());
+    REQUIRE(std::get<0>(req.value()).is_lookup());
+
+    listener.send_to(std::get<1>(req.value()), sikradio::common::make_reply("Radio", "239.10.11.12", 20011));
+    auto reply = client.try_read();
+    REQUIRE(reply.has_value());
+    REQUIRE(std::get<0>(reply.value()).is_reply());
+}
+
+TEST_CASE("impairment specification") {
+    SECTION("is parsed") {
+        auto cfg = sikradio::common::parse_impairment("loss=0.01,burst=0.02:0.3,dup=0.5,delay=5,jitter=2.5,seed=7");
+
+        REQUIRE(cfg.loss == 0.01);
+        REQUIRE(cfg.burst_enter == 0.02);
+        REQUIRE(cfg.burst_exit == 0.3);
+        REQUIRE(cfg.burst_loss == 1.0);
+        REQUIRE(cfg.duplicate == 0.5);
+        REQUIRE(cfg.delay_ms == 5);
+        REQUIRE(cfg.jitter_ms == 2.5);
+        REQUIRE(cfg.seed == 7);
+        REQUIRE(cfg.delays());
+    }
+
+    SECTION("rejects invalid values") {
+        REQUIRE_THROWS_AS(sikradio::common::parse_impairment("loss=2"), 
+                          sikradio::common::exceptions::impairment_exception);
+        REQUIRE_THROWS_AS(sikradio::common::parse_impairment("loss=abc"), 
+                          sikradio::common::exceptions::impairment_exception);
+        REQUIRE_THROWS_AS(sikradio::common::parse_impairment("burst=0.1"), 
+                          sikradio::common::exceptions::impairment_exception);
+        REQUIRE_THROWS_AS(sikradio::common::parse_impairment("speed=1"), 
+                          sikradio::common::exceptions::impairment_exception);
+    }
+}
+
+TEST_CASE("loss model") {
+    std::mt19937_64 rng{1};
+    const int draws = 100000;
+
+    SECTION("bernoulli losses have given rate") {
+        sikradio::common::loss_model model{sikradio::common::parse_impairment("loss=0.1")};
+        int lost = 0;
+        for (int i = 0; i < draws; i++) lost += model.lose(rng);
+
+        REQUIRE(lost > 0.09*draws);
+        REQUIRE(lost < 0.11*draws);
+    }
+
+    SECTION("gilbert-elliott losses come in bursts") {
+        // bad state lasts 1/0.25 = 4 datagrams on average, and is entered every 1/0.05 = 20 datagrams
+        sikradio::common::loss_model model{sikradio::common::parse_impairment("burst=0.05:0.25")};
+        int lost = 0, bursts = 0;
+        bool previous_lost = false;
+        for (int i = 0; i < draws; i++) {
+            bool is_lost = model.lose(rng);
+            lost += is_lost;
+            if (is_lost && !previous_lost) bursts++;
+            previous_lost = is_lost;
+        }
+        double loss_rate = static_cast<double>(lost) / draws;
+        double mean_burst = static_cast<double>(lost) / bursts;
+
+        REQUIRE(loss_rate > 0.15);
+        REQUIRE(loss_rate < 0.19);
+        REQUIRE(mean_burst > 3.5);
+        REQUIRE(mean_burst < 4.5);
+    }
+}
+
+TEST_CASE("impaired transport") {
+    auto network = std::make_shared<sikradio::common::memory_transport>();
+    const std::string text = "some datagram";
+    auto data = reinterpret_cast<const sikradio::common::byte_t *>(text.data());
+    sikradio::common::byte_t buf[UDP_DATAGRAM_DATA_LEN_MAX];
+    auto address = sikradio::common::make_address("127.0.0.1", 20030);
+    auto sender = network->open_datagram();
+
+    auto open_receiver = [&](const std::string& spec) {
+        auto impaired = std::make_shared<sikradio::common::impaired_transport>(
+            network, sikradio::common::parse_impairment(spec));
+        auto receiver = impaired->open_datagram();
+        receiver->set_receive_timeout(20);
+        receiver->bind(address);
+        return std::make_pair(impaired, std::move(receiver));
+    };
+
+    SECTION("passes datagrams without impairment") {
+        auto [impaired, receiver] = open_receiver("");
+        sender->send_to(address, data, text.size());
+
+        REQUIRE(receiver->receive(buf, sizeof(buf)) == text.size());
+        REQUIRE(impaired->get_counters().received == 1);
+        REQUIRE(impaired->get_counters().dropped == 0);
+    }
+
+    SECTION("drops lost datagrams") {
+        auto [impaired, receiver] = open_receiver("loss=1");
+        sender->send_to(address, data, text.size());
+
+        REQUIRE(receiver->receive(buf, sizeof(buf)) == std::nullopt);
+        REQUIRE(impaired->get_counters().dropped == 1);
+    }
+
+    SECTION("duplicates datagrams") {
+        auto [impaired, receiver] = open_receiver("dup=1");
+        sender->send_to(address, data, text.size());
+
+        REQUIRE(receiver->receive(buf, sizeof(buf)) == text.size());
+        REQUIRE(receiver->receive(buf, sizeof(buf)) == text.size());
+        REQUIRE(receiver->receive(buf, sizeof(buf)) == std::nullopt);
+        REQUIRE(impaired->get_counters().duplicated == 1);
+    }
+
+    SECTION("delays datagrams") {
+        auto [impaired, receiver] = open_receiver("delay=50");
+        sender->send_to(address, data, text.size());
+        auto start = std::chrono::steady_clock::now();
+
+        REQUIRE(receiver->receive(buf, sizeof(buf)) == std::nullopt);
+        receiver->set_receive_timeout(200);
+        REQUIRE(receiver->receive(buf, sizeof(buf)) == text.size());
+        REQUIRE(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(50));
+    }
+
+    SECTION("reorders datagrams") {
+        auto [impaired, receiver] = open_receiver("reorder=0.5,reorder_delay=30");
+        const size_t datagrams = 20;
+        sikradio::common::msg_t payload(datagrams, 7);
+        for (size_t len = 1; len <= datagrams; len++) sender->send_to(address, payload.data(), len);
+        receiver->set_receive_timeout(200);
+        std::vector<size_t> received;
+        for (size_t i = 0; i < datagrams; i++) received.push_back(receiver->receive(buf, sizeof(buf)).value());
+
+        REQUIRE(!std::is_sorted(received.begin(), received.end()));
+        std::sort(received.begin(), received.end());
+        for (size_t i = 0; i < datagrams; i++) REQUIRE(received[i] == i + 1);
+        REQUIRE(impaired->get_counters().reordered > 0);
+        REQUIRE(impaired->get_counters().reordered < datagrams);
+    }
+}
+
+namespace {
+    // sends and receives datagrams between two sockets of a kernel transport on loopback
+    void check_kernel_transport(sikradio::common::transport& transport, in_port_t port) {
+        auto address = sikradio::common::make_address("127.0.0.1", port);
+        auto receiver = transport.open_datagram();
+        receiver->enable_reuse_address();
+        receiver->set_receive_timeout(200);
+        receiver->bind(address);
+        auto sender = transport.open_datagram();
+        sender->connect(address);
+        sikradio::common::byte_t buf[UDP_DATAGRAM_DATA_LEN_MAX];
+
+        // single datagram
+        sikradio::common::msg_t datagram(1000, 42);
+        sender->send(datagram.data(), datagram.size());
+        struct sockaddr_in from{};
+        REQUIRE(receiver->receive(buf, sizeof(buf), &from) == datagram.size());
+        REQUIRE(sikradio::common::msg_t(buf, buf + datagram.size()) == datagram);
+        REQUIRE(ntohl(from.sin_addr.s_addr) == INADDR_LOOPBACK);
+
+        // reply to the sender's address
+        receiver->send_to(from, datagram.data(), 10);
+        sender->set_receive_timeout(200);
+        REQUIRE(sender->receive(buf, sizeof(buf)) == 10);
+
+        // batch arrives whole and in order
+        std::vector<sikradio::common::msg_t> batch;
+        for (size_t i = 0; i < 100; i++) batch.emplace_back(i + 1, static_cast<sikradio::common::byte_t>(i));
+        sender->send_batch(batch);
+        for (size_t i = 0; i < batch.size(); i++) REQUIRE(receiver->receive(buf, sizeof(buf)) == i + 1);
+
+        // timeout
+        receiver->set_receive_timeout(20);
+        REQUIRE(receiver->receive(buf, sizeof(buf)) == std::nullopt);
+    }
+}
+
+TEST_CASE("udp transport") {
+    sikradio::common::udp_transport transport;
+    check_kernel_transport(transport, 45850);
+}
+
+TEST_CASE("io_uring transport") {
+    std::optional<sikradio::common::uring_transport> transport;
+    try {
+        transport.emplace();
+    } catch (sikradio::common::exceptions::socket_exception &e) {
+        WARN("io_uring is not available: " << e.what());
+        return;
+    }
+    check_kernel_transport(transport.value(), 45851);
+}
+
+TEST_CASE("transport selection") {
+    REQUIRE(sikradio::common::make_transport("udp") == sikradio::common::default_transport());
+    REQUIRE(sikradio::common::make_transport("uring") != nullptr);
+    REQUIRE_THROWS_AS(sikradio::common::make_transport("tcp"), sikradio::common::exceptions::socket_exception);
+}
+
+TEST_CASE("realtime mode specification") {
+    const std::set<std::string> roles{"sender", "retransmitter"};
+    using realtime_exception = sikradio::common::exceptions::realtime_exception;
+
+    auto none = sikradio::common::parse_realtime("", roles);
+    REQUIRE_FALSE(none.enabled());
+
+    auto cfg = sikradio::common::parse_realtime("sender=2,retransmitter=3,fifo=80,mlock,busy_poll=50", roles);
+    REQUIRE(cfg.enabled());
+    REQUIRE(cfg.cores.at("sender") == 2);
+    REQUIRE(cfg.cores.at("retransmitter") == 3);
+    REQUIRE(cfg.fifo_priority == 80);
+    REQUIRE(cfg.lock_memory);
+    REQUIRE(cfg.busy_poll_in_us == 50);
+
+    REQUIRE_THROWS_AS(sikradio::common::parse_realtime("data_streamer=1", roles), realtime_exception);
+    REQUIRE_THROWS_AS(sikradio::common::parse_realtime("sender=-1", roles), realtime_exception);
+    REQUIRE_THROWS_AS(sikradio::common::parse_realtime("sender=x", roles), realtime_exception);
+    REQUIRE_THROWS_AS(sikradio::common::parse_realtime("fifo=0", roles), realtime_exception);
+    REQUIRE_THROWS_AS(sikradio::common::parse_realtime("fifo=100", roles), realtime_exception);
+    REQUIRE_THROWS_AS(sikradio::common::parse_realtime("mlock=1", roles), realtime_exception);
+}
+
+TEST_CASE("realtime thread pinning") {
+    // pinning is done in a separate thread, so that the test runner keeps its affinity
+    std::thread pinned([]() {
+        cpu_set_t allowed;
+        REQUIRE(sched_getaffinity(0, sizeof(allowed), &allowed) == 0);
+        int cpu = 0;
+        while (!CPU_ISSET(cpu, &allowed)) cpu++;
+
+        sikradio::common::realtime_config cfg{};
+        cfg.cores["sender"] = cpu;
+        sikradio::common::enter_role(cfg, "sender");
+        cpu_set_t current;
+        REQUIRE(pthread_getaffinity_np(pthread_self(), sizeof(current), &current) == 0);
+        REQUIRE(CPU_COUNT(&current) == 1);
+        REQUIRE(CPU_ISSET(cpu, &current));
+        REQUIRE(sched_getcpu() == cpu);
+
+        REQUIRE_THROWS_AS(
+            sikradio::common::pin_current_thread(CPU_SETSIZE - 1),
+            sikradio::common::exceptions::realtime_exception);
+    });
+    pinned.join();
+}
+
+TEST_CASE("busy poll") {
+    // backends without device queues ignore the setting
+    auto network = std::make_shared<sikradio::common::memory_transport>();
+    network->open_datagram()->set_busy_poll(50);
+
+    // kernel socket accepts values up to the system default without privileges
+    auto sock = sikradio::common::udp_transport().open_datagram();
+    sock->set_busy_poll(0);
+}
+
+TEST_CASE("pcm codec") {
+    using sikradio::common::msg_t;
+    using sikradio::common::byte_t;
+    auto pcm = [](const std::vector<int16_t>& samples) {
+        msg_t ret;
+        for (auto s : samples) {
+            ret.push_back(static_cast<byte_t>(static_cast<uint16_t>(s) & 0xFF));
+            ret.push_back(static_cast<byte_t>(static_cast<uint16_t>(s) >> 8));
+        }
+        return ret;
+    };
+    auto round_trip = [](sikradio::common::pcm_codec& codec, const msg_t& raw) {
+        auto compressed = codec.encode(raw.data(), raw.size());
+        REQUIRE(compressed.has_value());
+        REQUIRE(compressed->size() < raw.size());
+        REQUIRE(codec.decode(compressed->data(), compressed->size()) == raw);
+    };
+
+    SECTION("compresses smooth stereo signal") {
+        sikradio::common::pcm_codec codec{2};
+        std::vector<int16_t> samples;
+        for (int i = 0; i < 256; i++) {
+            samples.push_back(static_cast<int16_t>(8000*sin(i*0.05)));
+            samples.push_back(static_cast<int16_t>(3000*cos(i*0.11)));
+        }
+        round_trip(codec, pcm(samples));
+    }
+
+    SECTION("keeps bytes of incomplete frame") {
+        sikradio::common::pcm_codec codec{6};
+        std::vector<int16_t> samples;
+        for (int i = 0; i < 601; i++) samples.push_back(static_cast<int16_t>(i % 50));
+        auto raw = pcm(samples);
+        raw.push_back('x');
+        round_trip(codec, raw);
+    }
+
+    SECTION("escapes extreme residuals") {
+        sikradio::common::pcm_codec codec{1};
+        std::vector<int16_t> samples(512, 0);
+        samples[100] = INT16_MIN;
+        samples[101] = INT16_MAX;
+        samples[300] = INT16_MIN;
+        round_trip(codec, pcm(samples));
+    }
+
+    SECTION("does not compress noise") {
+        sikradio::common::pcm_codec codec{2};
+        std::mt19937 gen(2137);
+        std::vector<int16_t> samples;
+        for (int i = 0; i < 512; i++) samples.push_back(static_cast<int16_t>(gen()));
+        auto raw = pcm(samples);
+        REQUIRE_FALSE(codec.encode(raw.data(), raw.size()).has_value());
+
+        // noise is sent raw, without the flag
+        sikradio::common::data_msg msg{1024, 7, raw};
+        auto received = codec.decode(sikradio::common::data_msg(codec.sendable(msg)));
+        REQUIRE(received.get_id() == 1024);
+        REQUIRE(received.get_data() == raw);
+    }
+
+    SECTION("flags compressed messages") {
+        sikradio::common::pcm_codec codec{2};
+        auto raw = pcm(std::vector<int16_t>(512, 100));
+        sikradio::common::data_msg msg{1024, 7, raw};
+        auto sent = codec.sendable(msg);
+        REQUIRE(sent.size() < msg.sendable().size());
+        sikradio::common::data_msg wire{sent};
+        REQUIRE(wire.get_id() == (1024 | sikradio::common::compressed_id_flag));
+        auto received = codec.decode(wire);
+        REQUIRE(received.get_id() == 1024);
+        REQUIRE(received.get_session_id() == 7);
+        REQUIRE(received.get_data() == raw);
+    }
+
+    SECTION("rejects malformed data") {
+        sikradio::common::pcm_codec codec{2};
+        auto raw = pcm(std::vector<int16_t>(512, 100));
+        auto compressed = codec.encode(raw.data(), raw.size()).value();
+        REQUIRE_THROWS_AS(codec.decode(compressed.data(), 3), data_msg_exception);
+        compressed[0] = 2;
+        REQUIRE_THROWS_AS(codec.decode(compressed.data(), compressed.size()), data_msg_exception);
+        compressed[0] = 1;
+        REQUIRE_THROWS_AS(codec.decode(compressed.data(), compressed.size() - 1), data_msg_exception);
+    }
+}
@@ -6,11 +6,19 @@
 
 #include "../src/receiver/buffer.hpp"
 #include "../src/common/data_msg.hpp"
+#include "../src/common/fec_msg.hpp"
+#include "../src/common/histogram.hpp"
 #include "../src/receiver/data_socket.hpp"
+#include "../src/receiver/jitter_estimator.hpp"
 #include "../src/receiver/rexmit_manager.hpp"
 #include "../src/receiver/state_manager.hpp"
 #include "../src/receiver/station_set.hpp"
 #include "../src/receiver/structures.hpp"
+#include "../src/receiver/ui_manager.hpp"
+#include "../src/receiver/change_notifier.hpp"
+#include "../src/receiver/timeshift.hpp"
+#include "../src/sender/data_socket.hpp"
+#include "../src/common/memory_transport.hpp"
 
 namespace {
     const std::string msg_data = "some random message data";
@@ -29,6 +37,7 @@ namespace {
         ret.ctrl_address = "192.168.5.5";
         ret.ctrl_port = 8888;
         ret.data_address = "239.10.11.12";
+        ret.data_port = 25830;
         ret.last_reply = std::chrono::system_clock::now();
         return ret;
     }
@@ -39,40 +48,46 @@ namespace {
         ret.ctrl_address = "192.168.6.6";
         ret.ctrl_port = 9999;
         ret.data_address = "239.10.11.13";
+        ret.data_port = 25830;
         ret.last_reply = std::chrono::system_clock::now();
         return ret;
     }
 }
 
 TEST_CASE("buffer access") {
-    sikradio::receiver::buffer buf{10};
+    size_t psize = msg_data.size();
+    size_t buf_size = 10;
+    sikradio::receiver::buffer buf{buf_size*psize};
 
     SECTION("empty read returns null") {
         REQUIRE(buf.try_read() == std::nullopt);
     }
 
+    SECTION("package size is known after first write until reset") {
+        REQUIRE_FALSE(buf.get_package_size().has_value());
+        (void)buf.write_get_missed(msg(psize));
+        REQUIRE(buf.get_package_size() == psize);
+        buf.reset();
+        REQUIRE_FALSE(buf.get_package_size().has_value());
+    }
+
     SECTION("after 1 write returns null") {
-        auto m = msg(1);
-        buf.write(m);
+        (void)buf.write_get_missed(msg(psize));
 
         REQUIRE(buf.try_read() == std::nullopt);
     }
 
     SECTION("after 3/4*size - 1 writes returns null") {
-        for (sikradio::common::msg_id_t id = 0; id < 7; id++) {
-            auto m = msg(id);
-            buf.write(m);
+        for (sikradio::common::msg_id_t id = 0; id < buf_size*3/4; id++) {
+            (void)buf.write_get_missed(msg(id*psize));
         }
 
         REQUIRE(buf.try_read() == std::nullopt);
     }
 
     SECTION("after 3/4*size writes") {
-        size_t buf_size = 10;
-        sikradio::receiver::buffer buf{buf_size};
         for (sikradio::common::msg_id_t id = 0; id < buf_size*3/4 + 1; id++) {
-            auto m = msg(id);
-            buf.write(m);
+            (void)buf.write_get_missed(msg(id*psize));
         }
 
         SECTION("read possible") {
@@ -93,33 +108,67 @@ TEST_CASE("buffer access") {
 
             REQUIRE(buf.try_read() == std::nullopt);
         }
+
+        SECTION("and failed read, is not readable until reset") {
+            REQUIRE(buf.wait_readable(std::chrono::milliseconds(10)));
+            while (true) {
+                try {
+                    (void)buf.try_read();
+                } catch (sikradio::receiver::exceptions::buffer_access_exception &e) {
+                    break;
+                }
+            }
+
+            REQUIRE_FALSE(buf.wait_readable(std::chrono::milliseconds(10)));
+            buf.reset();
+            for (sikradio::common::msg_id_t id = 0; id < buf_size*3/4 + 1; id++) {
+                (void)buf.write_get_missed(msg(id*psize));
+            }
+            REQUIRE(buf.wait_readable(std::chrono::milliseconds(10)));
+        }
+    }
+
+    SECTION("wakes up waiting reader when it becomes readable") {
+        REQUIRE_FALSE(buf.wait_readable(std::chrono::milliseconds(10)));
+        std::thread writer([&]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            for (sikradio::common::msg_id_t id = 0; id < buf_size*3/4 + 1; id++) {
+                (void)buf.write_get_missed(msg(id*psize));
+            }
+        });
+        auto start = std::chrono::steady_clock::now();
+        bool readable = buf.wait_readable(std::chrono::seconds(5));
+        auto waited = std::chrono::steady_clock::now() - start;
+        writer.join();
+
+        REQUIRE(readable);
+        REQUIRE(waited < std::chrono::seconds(1));
     }
 }
 
 TEST_CASE("buffer space management") {
+    size_t psize = msg_data.size();
     size_t buf_size = 10;
-    sikradio::receiver::buffer buf{buf_size};
+    sikradio::receiver::buffer buf{buf_size*psize};
         
     SECTION("empty has space for no message") {
         REQUIRE_FALSE(buf.has_space_for(0));
-        REQUIRE_FALSE(buf.has_space_for(10));
+        REQUIRE_FALSE(buf.has_space_for(buf_size*psize));
     }
 
     SECTION("full") {
-        auto m = msg(1);
-        buf.write(m);
-        m = msg(buf_size);
-        buf.write(m);
+        (void)buf.write_get_missed(msg(psize));
+        (void)buf.write_get_missed(msg(buf_size*psize));
 
         SECTION("has space for all missed messages") {
             for (sikradio::common::msg_id_t id = 2; id < buf_size; id++) {
-                REQUIRE(buf.has_space_for(id));
+                REQUIRE(buf.has_space_for(id*psize));
             }
         }
 
         SECTION("has space for inserted messages") {
-            REQUIRE(buf.has_space_for(1));
-            REQUIRE(buf.has_space_for(buf_size));
+            REQUIRE(buf.has_space_for(psize));
+            REQUIRE(buf.has_space_for(buf_size*psize));
         }
 
         SECTION("has no space for older message") {
@@ -127,18 +176,348 @@ TEST_CASE("buffer space management") {
         }
 
         SECTION("has no space for future message") {
-            REQUIRE_FALSE(buf.has_space_for(buf_size+1));
+            REQUIRE_FALSE(buf.has_space_for((buf_size+1)*psize));
         }
 
         SECTION("after reset has space for no message") {
             buf.reset();
             for (sikradio::common::msg_id_t id = 0; id < buf_size+1; id++) {
-                REQUIRE_FALSE(buf.has_space_for(id));
+                REQUIRE_FALSE(buf.has_space_for(id*psize));
             }
         }
     }
 }
 
+TEST_CASE("jitter estimator") {
+    using clock = std::chrono::steady_clock;
+    size_t package_size = 4;
+    size_t max_elements = 1000;
+    auto start = clock::now();
+    sikradio::receiver::jitter_estimator est{0.001};
+
+    SECTION("has no estimate before warmup") {
+        est.register_arrival(0, package_size, 0, start);
+        est.register_arrival(4, package_size, 0, start + std::chrono::milliseconds(1));
+
+        REQUIRE_FALSE(est.target_elements(max_elements).has_value());
+    }
+
+    SECTION("on regular link") {
+        for (size_t i = 0; i < 100; i++) {
+            est.register_arrival(i*package_size, package_size, 0, start + std::chrono::milliseconds(i));
+        }
+
+        SECTION("keeps minimal threshold") {
+            auto target = est.target_elements(max_elements);
+
+            REQUIRE(target.has_value());
+            REQUIRE(target.value() <= 3);
+        }
+
+        SECTION("has no losses") {
+            REQUIRE(est.get_loss_rate() == 0);
+        }
+    }
+
+    SECTION("on jittery lossy link requires deeper buffer") {
+        sikradio::receiver::jitter_estimator regular{0.001};
+        sikradio::common::msg_id_t id = 0;
+        for (size_t i = 0; i < 200; i++) {
+            auto at = start + std::chrono::milliseconds(i);
+            regular.register_arrival(id, package_size, 0, at);
+            auto jitter = std::chrono::microseconds((i % 2) ? 900 : 0);
+            if (i % 10 == 5) {
+                // one package lost and repaired 20ms later
+                est.register_missed(id - package_size, at + jitter);
+                est.register_arrival(id, package_size, 1, at + jitter);
+                est.register_repair(id - package_size, at + jitter + std::chrono::milliseconds(20));
+            } else {
+                est.register_arrival(id, package_size, 0, at + jitter);
+            }
+            id += package_size;
+        }
+
+        REQUIRE(est.get_loss_rate() > 0);
+        REQUIRE(est.get_repair_us() > 0);
+        REQUIRE(est.target_elements(max_elements).value() > regular.target_elements(max_elements).value());
+    }
+
+    SECTION("never exceeds buffer size") {
+        for (size_t i = 0; i < 100; i++) {
+            est.register_arrival(i*package_size, package_size, 0, start + std::chrono::milliseconds(i*i));
+        }
+
+        REQUIRE(est.target_elements(10).value() < 10);
+    }
+}
+
+TEST_CASE("adaptive buffer access") {
+    size_t buf_size = 1000;
+    sikradio::receiver::buffer buf{buf_size, std::make_optional(0.001)};
+
+    SECTION("uses fixed threshold before warmup") {
+        for (sikradio::common::msg_id_t id = 0; id < 10; id++) {
+            (void)buf.write_get_missed(msg(id*msg_data.size()));
+        }
+
+        REQUIRE(buf.try_read() == std::nullopt);
+    }
+
+    SECTION("reports missed ids") {
+        (void)buf.write_get_missed(msg(0));
+        auto missed = buf.write_get_missed(msg(3*msg_data.size()));
+        std::set<sikradio::common::msg_id_t> expected = {msg_data.size(), 2*msg_data.size()};
+
+        REQUIRE(missed == expected);
+    }
+
+    SECTION("starts playback") {
+        size_t psize = msg_data.size();
+        size_t max_elements = 100;
+        auto start = std::chrono::steady_clock::now();
+        // returns number of packages written until buffer became readable, packages arrive every
+        // 1ms, every 10th one (but the first one) is lost and arrives 20ms later when lossy
+        auto writes_until_readable = [&](sikradio::receiver::buffer& b, bool lossy) {
+            size_t writes = 0;
+            for (sikradio::common::msg_id_t i = 0; i < max_elements; i++) {
+                auto at = start + std::chrono::milliseconds(i);
+                if (!lossy || i % 10 != 5) {
+                    (void)b.write_get_missed(msg(i*psize), at);
+                    writes++;
+                }
+                if (lossy && i >= 20 && (i - 20) % 10 == 5) {
+                    (void)b.write_get_missed(msg((i - 20)*psize), at);
+                    writes++;
+                }
+                if (b.try_read().has_value()) return writes;
+            }
+            return writes + 1;
+        };
+        sikradio::receiver::buffer fixed{max_elements*psize};
+        sikradio::receiver::buffer clean{max_elements*psize, std::make_optional(0.001)};
+        sikradio::receiver::buffer lossy{max_elements*psize, std::make_optional(0.001)};
+        auto fixed_writes = writes_until_readable(fixed, false);
+        auto clean_writes = writes_until_readable(clean, false);
+
+        SECTION("earlier than fixed threshold on clean link") {
+            REQUIRE(fixed_writes == max_elements*3/4 + 1);
+            REQUIRE(clean_writes < fixed_writes);
+        }
+
+        SECTION("with deeper threshold on lossy link") {
+            auto lossy_writes = writes_until_readable(lossy, true);
+
+            REQUIRE(lossy_writes > clean_writes);
+            REQUIRE(lossy_writes < fixed_writes);
+        }
+    }
+}
+
+TEST_CASE("buffer statistics") {
+    size_t psize = msg_data.size();
+    sikradio::receiver::buffer buf{4*psize};
+
+    (void)buf.write_get_missed(msg(0));
+    (void)buf.write_get_missed(msg(2*psize));
+    REQUIRE(buf.get_fill() == 3);
+
+    (void)buf.write_get_missed(msg(2*psize));
+    (void)buf.write_get_missed(msg(psize));
+    REQUIRE(buf.get_duplicate_count() == 1);
+
+    // pushes message 0 out of the buffer
+    (void)buf.write_get_missed(msg(4*psize));
+    (void)buf.write_get_missed(msg(0));
+    REQUIRE(buf.get_late_count() == 1);
+    REQUIRE(buf.get_fill() == 4);
+
+    buf.reset();
+    REQUIRE(buf.get_fill() == 0);
+}
+
+TEST_CASE("buffer latency tracking") {
+    size_t psize = msg_data.size();
+    sikradio::common::metrics::histogram repair_latency;
+    sikradio::receiver::buffer buf{4*psize, std::nullopt, &repair_latency};
+    auto start = std::chrono::steady_clock::now();
+
+    SECTION("read returns arrival time") {
+        for (sikradio::common::msg_id_t id = 0; id < 4; id++)
+            (void)buf.write_get_missed(msg(id*psize), start + std::chrono::milliseconds(id));
+        auto read = buf.try_read_timed();
+
+        REQUIRE(read.has_value());
+        REQUIRE(read.value().first == sikradio::common::msg_t(msg_data.begin(), msg_data.end()));
+        REQUIRE(read.value().second == start);
+    }
+
+    SECTION("repair latency is measured from first request") {
+        (void)buf.write_get_missed(msg(0), start);
+        auto missed = buf.write_get_missed(msg(2*psize), start);
+        buf.register_rexmit_request(missed, start);
+        buf.register_rexmit_request(missed, start + std::chrono::milliseconds(1));
+        (void)buf.write_get_missed(msg(psize), start + std::chrono::milliseconds(3));
+
+        REQUIRE(repair_latency.get_count() == 1);
+        REQUIRE(repair_latency.get_max() == 3000);
+    }
+
+    SECTION("messages that were not requested are not measured") {
+        (void)buf.write_get_missed(msg(0), start);
+        (void)buf.write_get_missed(msg(2*psize), start);
+        (void)buf.write_get_missed(msg(psize), start);
+
+        REQUIRE(repair_latency.get_count() == 0);
+    }
+}
+
+TEST_CASE("buffer recovery from parity") {
+    size_t psize = msg_data.size();
+    sikradio::receiver::buffer buf{100*psize};
+    // parity of messages 0-3
+    sikradio::common::msg_t parity(psize, 0);
+    std::vector<sikradio::common::msg_t> contents;
+    for (size_t i = 0; i < 4; i++) {
+        sikradio::common::msg_t data(msg_data.begin(), msg_data.end());
+        data[0] = static_cast<sikradio::common::byte_t>('a' + i);
+        sikradio::common::xor_into(parity.data(), data.data(), psize);
+        contents.push_back(data);
+    }
+    auto data_msg = [&](size_t i) {
+        return sikradio::common::data_msg(i*psize, 42, contents[i]);
+    };
+    sikradio::common::fec_msg fec{42, 0, 4, parity};
+
+    SECTION("recovers single missing message when parity comes last") {
+        (void)buf.write_get_missed(data_msg(0));
+        (void)buf.write_get_missed(data_msg(1));
+        auto missed = buf.write_get_missed(data_msg(3));
+        REQUIRE(missed.count(2*psize) == 1);
+        REQUIRE(buf.is_missing(2*psize));
+
+        auto recovered = buf.write_parity_get_recovered(fec);
+
+        REQUIRE(recovered.count(2*psize) == 1);
+        REQUIRE_FALSE(buf.is_missing(2*psize));
+    }
+
+    SECTION("recovers single missing message when parity comes first") {
+        (void)buf.write_get_missed(data_msg(0));
+        REQUIRE(buf.write_parity_get_recovered(fec).empty());
+        (void)buf.write_get_missed(data_msg(2));
+        auto missed = buf.write_get_missed(data_msg(3));
+
+        REQUIRE(missed.empty());
+        REQUIRE_FALSE(buf.is_missing(psize));
+    }
+
+    SECTION("does not recover two missing messages") {
+        (void)buf.write_get_missed(data_msg(0));
+        (void)buf.write_get_missed(data_msg(3));
+
+        REQUIRE(buf.write_parity_get_recovered(fec).empty());
+        REQUIRE(buf.is_missing(psize));
+        REQUIRE(buf.is_missing(2*psize));
+    }
+}
+
+TEST_CASE("buffer fast start") {
+    size_t psize = msg_data.size();
+    // playback threshold is 3/4 of 8 places
+    sikradio::receiver::buffer buf{8*psize};
+    auto data_msg = [&](sikradio::common::msg_id_t i) { return msg(i*psize); };
+
+    SECTION("session starts before first received message") {
+        REQUIRE(buf.start_session_at(10*psize).empty());
+        auto missed = buf.write_get_missed(data_msg(16));
+
+        REQUIRE(missed.size() == 6);
+        REQUIRE(buf.is_missing(10*psize));
+        REQUIRE(buf.is_missing(15*psize));
+        REQUIRE(buf.get_fill() == 7);
+    }
+
+    SECTION("session is extended when reply comes after first message") {
+        (void)buf.write_get_missed(data_msg(16));
+        auto missing = buf.start_session_at(10*psize);
+
+        REQUIRE(missing.size() == 6);
+        REQUIRE(buf.is_missing(10*psize));
+    }
+
+    SECTION("extension is limited by buffer size") {
+        (void)buf.write_get_missed(data_msg(16));
+
+        auto missing = buf.start_session_at(0);
+
+        REQUIRE(missing.size() == 7);
+        REQUIRE(buf.is_missing(9*psize));
+        REQUIRE_FALSE(buf.is_missing(8*psize));
+    }
+
+    SECTION("playback waits until places up to threshold are filled") {
+        REQUIRE(buf.start_session_at(10*psize).empty());
+        (void)buf.write_get_missed(data_msg(16));
+        for (size_t i = 10; i < 15; i++) {
+            (void)buf.write_get_missed(data_msg(i));
+            REQUIRE_FALSE(buf.try_read().has_value());
+        }
+        (void)buf.write_get_missed(data_msg(15));
+
+        REQUIRE(buf.try_read().has_value());
+    }
+
+    SECTION("has no effect after playback started") {
+        for (size_t i = 10; i < 17; i++) (void)buf.write_get_missed(data_msg(i));
+        REQUIRE(buf.try_read().has_value());
+
+        REQUIRE(buf.start_session_at(8*psize).empty());
+    }
+
+    SECTION("is forgotten on reset") {
+        REQUIRE(buf.start_session_at(10*psize).empty());
+        buf.reset();
+        auto missed = buf.write_get_missed(data_msg(16));
+
+        REQUIRE(missed.empty());
+    }
+}
+
+TEST_CASE("buffer recovery from interleaved parity") {
+    size_t psize = msg_data.size();
+    size_t group_size = 3;
+    size_t interleave = 4;
+    sikradio::receiver::buffer buf{100*psize};
+    std::vector<sikradio::common::msg_t> contents;
+    std::vector<sikradio::common::msg_t> parities(interleave, sikradio::common::msg_t(psize, 0));
+    for (size_t i = 0; i < group_size*interleave + 1; i++) {
+        sikradio::common::msg_t data(msg_data.begin(), msg_data.end());
+        data[0] = static_cast<sikradio::common::byte_t>('a' + i);
+        if (i < group_size*interleave)
+            sikradio::common::xor_into(parities[i % interleave].data(), data.data(), psize);
+        contents.push_back(data);
+    }
+
+    SECTION("recovers burst of interleave length") {
+        // messages 4-7 are lost
+        for (size_t i = 0; i < contents.size(); i++) {
+            if (4 <= i && i < 8) continue;
+            (void)buf.write_get_missed(sikradio::common::data_msg(i*psize, 42, contents[i]));
+        }
+        std::set<sikradio::common::msg_id_t> recovered;
+        for (size_t lane = 0; lane < interleave; lane++) {
+            sikradio::common::fec_msg fec{
+                42, lane*psize, static_cast<uint16_t>(group_size), 
+                static_cast<uint16_t>(interleave), parities[lane]};
+            for (auto id : buf.write_parity_get_recovered(fec)) recovered.insert(id);
+        }
+
+        REQUIRE(recovered.size() == interleave);
+        for (size_t i = 4; i < 8; i++)
+            REQUIRE_FALSE(buf.is_missing(i*psize));
+    }
+}
+
 TEST_CASE("data socket construction") {
     REQUIRE_NOTHROW(sikradio::receiver::data_socket());
     REQUIRE_NOTHROW(sikradio::receiver::data_socket(9999));
@@ -152,9 +531,72 @@ TEST_CASE("data socket not connected") {
     }
 }
 
+TEST_CASE("data socket over memory transport") {
+    auto network = std::make_shared<sikradio::common::memory_transport>();
+    sikradio::receiver::structures::station station{"Radio", "127.0.0.1", 20021, "239.10.11.12", 20020, {}};
+    sikradio::receiver::data_socket sock{100, network};
+    sock.connect(station);
+    sikradio::sender::data_socket sender_sock{"239.10.11.12", 20020, "", network};
+
+    SECTION("receives sent messages") {
+        sender_sock.transmit(msg(0).sendable());
+        auto received = sock.try_read();
+
+        REQUIRE(received.has_value());
+        REQUIRE(received.value().get_id() == 0);
+        REQUIRE(received.value().get_data() == msg(0).get_data());
+    }
+
+    SECTION("returns null after timeout") {
+        REQUIRE(sock.try_read() == std::nullopt);
+    }
+
+    SECTION("stops receiving from previous station after reconnect") {
+        sikradio::receiver::structures::station other{"Other", "127.0.0.1", 20021, "239.10.11.13", 20020, {}};
+        sock.connect(other);
+        sender_sock.transmit(msg(0).sendable());
+
+        REQUIRE(sock.try_read() == std::nullopt);
+    }
+}
+
+TEST_CASE("rexmit manager suppression") {
+    sikradio::receiver::rexmit_manager mng{std::chrono::milliseconds(50)};
+    std::set<sikradio::common::msg_id_t> empty_set;
+
+    SECTION("postpones ids requested by others") {
+        mng.append_ids({1, 2});
+        std::this_thread::sleep_for(std::chrono::milliseconds(30));
+        REQUIRE(mng.postpone_ids({1, 3}) == 1);
+        std::this_thread::sleep_for(std::chrono::milliseconds(30));
+
+        REQUIRE(mng.filter_get_ids(empty_set) == std::set<sikradio::common::msg_id_t>{2});
+        std::this_thread::sleep_for(std::chrono::milliseconds(30));
+        REQUIRE(mng.filter_get_ids(empty_set) == std::set<sikradio::common::msg_id_t>{1});
+    }
+
+    SECTION("does not postpone ids it requested") {
+        mng.append_ids({1});
+        std::this_thread::sleep_for(std::chrono::milliseconds(60));
+        REQUIRE(mng.filter_get_ids(empty_set).size() == 1);
+
+        REQUIRE(mng.postpone_ids({1}) == 0);
+    }
+
+    SECTION("requests ids within backoff") {
+        sikradio::receiver::rexmit_manager backed_off{
+            std::chrono::milliseconds(20), std::chrono::milliseconds(40)};
+        backed_off.append_ids({1, 2, 3});
+        REQUIRE(backed_off.filter_get_ids(empty_set).empty());
+        std::this_thread::sleep_for(std::chrono::milliseconds(70));
+
+        REQUIRE(backed_off.filter_get_ids(empty_set).size() == 3);
+    }
+}
+
 TEST_CASE("rexmit manager access") {
     size_t rtime = 1;  // in seconds
-    sikradio::receiver::rexmit_manager mng{rtime};
+    sikradio::receiver::rexmit_manager mng{std::chrono::seconds(rtime)};
     std::set<sikradio::common::msg_id_t> empty_set;
     
     SECTION("returns empty set when no ids were inserted") {
@@ -162,14 +604,14 @@ TEST_CASE("rexmit manager access") {
     }
 
     SECTION("before rtime returns empty set after id is inserted") {
-        mng.append_ids(2, 3);
+        mng.append_ids({2});
 
         auto rexmit_set = mng.filter_get_ids(empty_set);
         REQUIRE(rexmit_set.empty());
     }
 
     SECTION("after rtime returns set with inserted id") {
-        mng.append_ids(2, 3);
+        mng.append_ids({2});
         std::this_thread::sleep_for(std::chrono::seconds(rtime));
         
         auto rexmit_set = mng.filter_get_ids(empty_set);
@@ -177,7 +619,7 @@ TEST_CASE("rexmit manager access") {
     }
 
     SECTION("after rtime and reset returns empty set") {
-        mng.append_ids(2,3);
+        mng.append_ids({2});
         std::set<sikradio::common::msg_id_t> forget_inserted_ids = {2};
         std::this_thread::sleep_for(std::chrono::seconds(rtime));
         mng.reset();
@@ -187,7 +629,7 @@ TEST_CASE("rexmit manager access") {
     }
 
     SECTION("after rtime forgotten inserted id is not returned") {
-        mng.append_ids(2,3);
+        mng.append_ids({2});
         std::set<sikradio::common::msg_id_t> forget_inserted_ids = {2};
 
         SECTION("when forgotten immediately") {
@@ -209,7 +651,7 @@ TEST_CASE("rexmit manager access") {
 
 TEST_CASE("state manager check") {
     sikradio::receiver::state_manager sm;
-    std::optional<std::string> addr;
+    std::optional<sikradio::receiver::station> addr;
     bool dirty;
 
     SECTION("after construction") {
@@ -227,11 +669,11 @@ TEST_CASE("state manager check") {
         REQUIRE_FALSE(addr.has_value());
     }
 
-    SECTION("after address registration") {
-        std::string reg_addr = "239.10.11.12";
-        sm.register_address(reg_addr);
+    SECTION("after station registration") {
+        auto reg_addr = pref();
+        REQUIRE(sm.register_address_check_change(reg_addr));
 
-        SECTION("is dirty with correct address") {
+        SECTION("is dirty with correct station") {
             std::tie(addr, dirty) = sm.check_state();
             
             REQUIRE(dirty);
@@ -245,7 +687,7 @@ TEST_CASE("state manager check") {
             REQUIRE_FALSE(dirty);
         }
 
-        SECTION("persists correct address on consecutive checks") {
+        SECTION("persists correct station on consecutive checks") {
             std::tie(addr, dirty) = sm.check_state();
             REQUIRE(addr == reg_addr);
 
@@ -253,9 +695,9 @@ TEST_CASE("state manager check") {
             REQUIRE(addr == reg_addr);
         }
 
-        SECTION("is not dirty after re-registration of same address") {
+        SECTION("is not dirty after re-registration of same station") {
             (void)sm.check_state();
-            sm.register_address(reg_addr);
+            REQUIRE_FALSE(sm.register_address_check_change(reg_addr));
             std::tie(addr, dirty) = sm.check_state();
 
             REQUIRE_FALSE(dirty);
@@ -290,6 +732,16 @@ TEST_CASE("state manager check") {
             REQUIRE(ignore);
             REQUIRE_FALSE(dirty);
         }
+
+        SECTION("checks only current session without registering it") {
+            REQUIRE(sm.is_current_session(5));
+            REQUIRE_FALSE(sm.is_current_session(4));
+            REQUIRE_FALSE(sm.is_current_session(6));
+            std::tie(std::ignore, dirty) = sm.check_state();
+
+            REQUIRE_FALSE(dirty);
+            REQUIRE_FALSE(sm.register_session_check_ignore(5));
+        }
     }
 }
 
@@ -336,7 +788,84 @@ TEST_CASE("station set") {
     }
 
     SECTION("after long inactivity") {
-        // Implement this test in case of problems
+        auto stale = other();
+        stale.last_reply -= std::chrono::seconds(30);
+        (void)s.update_get_selected(pref());
+        (void)s.update_get_selected(stale);
+
+        SECTION("removes inactive station") {
+            std::vector<std::string> names = {pref().name};
+
+            REQUIRE(s.get_station_names() == names);
+        }
+
+        SECTION("moves selection to active station") {
+            sikradio::receiver::station_set st;
+            (void)st.update_get_selected(stale);
+            auto selected = st.update_get_selected(pref());
+
+            REQUIRE(selected == pref());
+        }
+    }
+
+    SECTION("keeps stations with same name and different address") {
+        auto twin = pref();
+        twin.ctrl_address = "192.168.7.7";
+        (void)s.update_get_selected(pref());
+        (void)s.update_get_selected(twin);
+
+        REQUIRE(s.get_station_names().size() == 2);
+
+        SECTION("and tells them apart by address") {
+            std::vector<std::string> names = {
+                pref().name + " (" + pref().ctrl_address + ")",
+                twin.name + " (" + twin.ctrl_address + ")"};
+
+            REQUIRE(s.get_station_names() == names);
+        }
+
+        SECTION("and marks only the selected one") {
+            (void)s.select_get_selected(msu::UP);
+            auto snapshot = s.get_snapshot();
+
+            REQUIRE(snapshot.selected == twin);
+            REQUIRE(snapshot.selected_position == std::make_optional<size_t>(1));
+        }
+    }
+
+    SECTION("snapshot") {
+        (void)s.update_get_selected(pref());
+        (void)s.update_get_selected(other());
+        auto snapshot = s.get_snapshot();
+
+        SECTION("contains sorted names and selection") {
+            std::vector<std::string> names = {other().name, pref().name};
+
+            REQUIRE(*snapshot.names == names);
+            REQUIRE(snapshot.selected == pref());
+            REQUIRE(snapshot.selected_position == std::make_optional<size_t>(1));
+        }
+
+        SECTION("is not changed by station refresh") {
+            (void)s.update_get_selected(other());
+
+            REQUIRE(s.get_version() == snapshot.version);
+        }
+
+        SECTION("is changed by selection") {
+            (void)s.select_get_selected(msu::UP);
+
+            REQUIRE(s.get_version() != snapshot.version);
+        }
+
+        SECTION("is changed by new station") {
+            auto third = other();
+            third.name = "Third Station";
+            (void)s.update_get_selected(third);
+
+            REQUIRE(s.get_version() != snapshot.version);
+            REQUIRE(s.get_snapshot().names->back() == third.name);
+        }
     }
 
     SECTION("returns printable names in correct format") {
@@ -347,6 +876,36 @@ TEST_CASE("station set") {
         REQUIRE(s.get_station_names() == names);
     }
 
+    SECTION("notifies about changes") {
+        sikradio::receiver::change_notifier notifier;
+        sikradio::receiver::station_set sn{std::nullopt, &notifier};
+        (void)sn.update_get_selected(pref());
+        REQUIRE(notifier.consume());
+
+        SECTION("after selection") {
+            (void)sn.update_get_selected(other());
+            (void)notifier.consume();
+            (void)sn.select_get_selected(msu::UP);
+
+            REQUIRE(notifier.consume());
+        }
+
+        SECTION("not after refresh") {
+            (void)sn.update_get_selected(pref());
+
+            REQUIRE_FALSE(notifier.consume());
+        }
+    }
+
+    SECTION("reports next expiry") {
+        REQUIRE_FALSE(s.get_next_expiry().has_value());
+
+        auto p = pref();
+        (void)s.update_get_selected(p);
+
+        REQUIRE(s.get_next_expiry() == p.last_reply + std::chrono::seconds(20));
+    }
+
     SECTION("with preferred station") {
         sikradio::receiver::station_set sp{pref().name};
 
@@ -377,3 +936,135 @@ TEST_CASE("station set") {
         }
     }
 }
+
+TEST_CASE("ui manager") {
+    in_port_t ui_port = 19999;
+    sikradio::receiver::ui_manager ui{ui_port, 100};
+    using msu = sikradio::receiver::menu_selection_update;
+
+    SECTION("returns no update without clients") {
+        REQUIRE_FALSE(ui.get_update().has_value());
+    }
+
+    SECTION("wakes up on notification") {
+        sikradio::receiver::change_notifier notifier;
+        sikradio::receiver::ui_manager notified_ui{static_cast<in_port_t>(ui_port + 1), 100, &notifier};
+        notifier.notify();
+        auto start = std::chrono::steady_clock::now();
+
+        REQUIRE_FALSE(notified_ui.get_update(5000).has_value());
+        REQUIRE(std::chrono::steady_clock::now() - start < std::chrono::seconds(1));
+    }
+
+    SECTION("with connected client") {
+        int client = socket(AF_INET, SOCK_STREAM, 0);
+        auto addr = sikradio::common::make_address("127.0.0.1", ui_port);
+        REQUIRE(connect(client, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0);
+        (void)ui.get_update();  // accepts the client
+
+        SECTION("returns selection update") {
+            std::string key_down = "\x1B\x5B\x42";
+            REQUIRE(write(client, key_down.data(), key_down.size()) == 3);
+
+            REQUIRE(ui.get_update() == msu::UP);
+        }
+
+        SECTION("returns timeshift commands") {
+            std::string key_left = "\x1B\x5B\x44";
+            REQUIRE(write(client, key_left.data(), key_left.size()) == 3);
+            REQUIRE(ui.get_update() == msu::REWIND);
+
+            REQUIRE(write(client, " ", 1) == 1);
+            REQUIRE(ui.get_update() == msu::PAUSE);
+        }
+
+        SECTION("sends rendered menu to client") {
+            ui.send_menu({"Other Station", "Some Station"}, std::make_optional<size_t>(1));
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            char rcv[4096];
+            ssize_t len = recv(client, rcv, sizeof(rcv), MSG_DONTWAIT);
+            REQUIRE(len > 0);
+            std::string received(rcv, rcv + len);
+
+            REQUIRE(received.find("  > Some Station") != std::string::npos);
+            REQUIRE(received.find("    Other Station") != std::string::npos);
+        }
+
+        SECTION("forgets disconnected client") {
+            close(client);
+            client = -1;
+
+            REQUIRE_FALSE(ui.get_update().has_value());
+            REQUIRE_NOTHROW(ui.send_menu({"Some Station"}, std::make_optional<size_t>(0)));
+        }
+
+        if (client >= 0) close(client);
+    }
+}
+
+TEST_CASE("timeshift") {
+    const std::string path = "/tmp/sikradio-test-timeshift";
+    using clock = sikradio::receiver::timeshift::clock;
+    // one page of recording, rewind by one second
+    sikradio::receiver::timeshift ts{path, 4096, std::chrono::seconds(1)};
+    auto start = clock::now();
+    auto chunk = [](char c) { return std::string(512, c); };
+    auto record = [&](char c, int at_ms) {
+        auto data = chunk(c);
+        return ts.record(data.data(), data.size(), start + std::chrono::milliseconds(at_ms));
+    };
+    auto play = [&](size_t len) {
+        auto [data, n] = ts.next_output(len);
+        return std::string(data, data + n);
+    };
+
+    // live chunks are played right away
+    REQUIRE(record('a', 0));
+    REQUIRE(record('b', 500));
+    REQUIRE(ts.is_live());
+    REQUIRE(play(512).empty());
+
+    SECTION("pause keeps position while recording continues") {
+        ts.toggle_pause();
+        REQUIRE_FALSE(record('c', 1000));
+        REQUIRE(play(512).empty());
+        REQUIRE(ts.get_delay() == 512);
+
+        // resumed playback catches up and becomes live
+        ts.toggle_pause();
+        REQUIRE(play(1024) == chunk('c'));
+        REQUIRE(ts.is_live());
+        REQUIRE(record('d', 1500));
+    }
+
+    SECTION("rewind goes back by recording time") {
+        REQUIRE(record('c', 1000));
+        REQUIRE(record('d', 1500));
+        ts.rewind();
+        REQUIRE(ts.get_delay() == 3*512);
+        REQUIRE(play(512) == chunk('b'));
+        REQUIRE_FALSE(record('e', 2000));
+
+        SECTION("to the oldest recording at most") {
+            ts.rewind();
+            ts.rewind();
+            REQUIRE(play(512) == chunk('a'));
+        }
+
+        SECTION("and returns to live stream") {
+            ts.go_live();
+            REQUIRE(ts.is_live());
+            REQUIRE(record('f', 2500));
+        }
+    }
+
+    SECTION("overwritten playback skips to the oldest recording") {
+        ts.toggle_pause();
+        // page holds 8 of 11 recorded chunks, paused position ('c') was overwritten
+        for (int i = 0; i < 9; i++) record(static_cast<char>('c' + i), 1000 + 500*i);
+        ts.toggle_pause();
+        REQUIRE(play(512) == chunk('d'));
+    }
+
+    std::remove(path.c_str());
+}
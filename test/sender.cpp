@@ -0,0 +1,401 @@
+#include "catch.hpp"
+
+#include <optional>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <fstream>
+#include <cstdio>
+#include <unistd.h>
+
+#include "../src/common/types.hpp"
+#include "../src/common/data_msg.hpp"
+#include "../src/common/fec_msg.hpp"
+#include "../src/sender/fec_encoder.hpp"
+#include "../src/sender/lockable_cache.hpp"
+#include "../src/sender/lockable_queue.hpp"
+#include "../src/sender/rexmit_scheduler.hpp"
+#include "../src/sender/rexmit_window.hpp"
+#include "../src/sender/input_source.hpp"
+#include "../src/sender/mapped_input.hpp"
+#include "../src/sender/archive.hpp"
+
+namespace {
+    const size_t psize = 4;
+
+    std::string write_file(const std::string& name, const std::string& content) {
+        auto path = "/tmp/sikradio-test-" + name;
+        std::ofstream file{path, std::ios::binary};
+        file << content;
+        return path;
+    }
+
+    std::string read_packets(sikradio::sender::input_source& input, size_t count) {
+        std::string ret;
+        sikradio::common::msg_t packet(psize);
+        for (size_t i = 0; i < count && input.read_packet(packet); i++)
+            ret += std::string(packet.begin(), packet.end());
+        return ret;
+    }
+
+    struct sockaddr_in receiver_address(in_port_t port) {
+        struct sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        return addr;
+    }
+
+    sikradio::common::data_msg msg(sikradio::common::msg_id_t id) {
+        auto byte = static_cast<sikradio::common::byte_t>(id / psize + 1);
+        return sikradio::common::data_msg(id, sikradio::common::msg_t(psize, byte));
+    }
+}
+
+TEST_CASE("fec encoder") {
+    size_t group_size = 3;
+    sikradio::sender::fec_encoder encoder{group_size, psize};
+
+    SECTION("returns parity after full group") {
+        REQUIRE_FALSE(encoder.push(msg(0), 5).has_value());
+        REQUIRE_FALSE(encoder.push(msg(4), 5).has_value());
+        auto parity = encoder.push(msg(8), 5);
+
+        REQUIRE(parity.has_value());
+        REQUIRE(parity.value().get_session_id() == 5);
+        REQUIRE(parity.value().get_first_id() == 0);
+        REQUIRE(parity.value().get_count() == group_size);
+        REQUIRE(parity.value().get_parity() == sikradio::common::msg_t(psize, 1 ^ 2 ^ 3));
+    }
+
+    SECTION("aligns groups to group size") {
+        REQUIRE_FALSE(encoder.push(msg(8), 5).has_value());
+        REQUIRE_FALSE(encoder.push(msg(12), 5).has_value());
+        REQUIRE_FALSE(encoder.push(msg(16), 5).has_value());
+        auto parity = encoder.push(msg(20), 5);
+
+        REQUIRE(parity.has_value());
+        REQUIRE(parity.value().get_first_id() == 12);
+    }
+
+    SECTION("ignores messages of different size") {
+        sikradio::common::data_msg short_msg{0, sikradio::common::msg_t(1, 1)};
+
+        REQUIRE_FALSE(encoder.push(short_msg, 5).has_value());
+    }
+}
+
+TEST_CASE("interleaved fec encoder") {
+    size_t group_size = 2;
+    size_t interleave = 3;
+    sikradio::sender::fec_encoder encoder{group_size, interleave, psize};
+    std::vector<sikradio::common::fec_msg> parities;
+    for (sikradio::common::msg_id_t id = 0; id < group_size*interleave*psize; id += psize) {
+        auto parity = encoder.push(msg(id), 5);
+        if (parity.has_value()) parities.push_back(parity.value());
+    }
+
+    REQUIRE(parities.size() == interleave);
+    for (size_t lane = 0; lane < interleave; lane++) {
+        REQUIRE(parities[lane].get_first_id() == lane*psize);
+        REQUIRE(parities[lane].get_stride() == interleave);
+        auto expected = static_cast<sikradio::common::byte_t>((lane + 1) ^ (lane + 1 + interleave));
+        REQUIRE(parities[lane].get_parity() == sikradio::common::msg_t(psize, expected));
+    }
+}
+
+TEST_CASE("lockable cache") {
+    sikradio::sender::lockable_cache cache{3, psize};
+
+    REQUIRE(cache.atomic_get(0) == std::nullopt);
+
+    for (sikradio::common::msg_id_t id = 0; id < 4*psize; id += psize)
+        cache.atomic_push(msg(id));
+
+    // oldest message was overwritten by the newest one
+    REQUIRE(cache.atomic_get(0).value().get_id() == 3*psize);
+    REQUIRE(cache.atomic_get(psize).value().get_id() == psize);
+    REQUIRE(cache.atomic_get(2*psize).value().get_id() == 2*psize);
+    REQUIRE(cache.atomic_get(3*psize).value().get_id() == 3*psize);
+}
+
+TEST_CASE("lockable queue size") {
+    sikradio::sender::lockable_queue q;
+    q.atomic_push(msg(0));
+    q.atomic_push(msg(psize));
+
+    REQUIRE(q.atomic_size() == 2);
+    (void)q.atomic_get_and_pop();
+    REQUIRE(q.atomic_size() == 1);
+}
+
+TEST_CASE("lockable queue batches") {
+    sikradio::sender::lockable_queue q;
+    for (size_t i = 0; i < 5; i++) q.atomic_push(msg(i*psize));
+
+    SECTION("are limited in size and keep order") {
+        auto batch = q.atomic_pop_batch(3);
+
+        REQUIRE(batch.size() == 3);
+        for (size_t i = 0; i < batch.size(); i++) REQUIRE(batch[i].get_id() == i*psize);
+        REQUIRE(q.atomic_size() == 2);
+    }
+
+    SECTION("take what is left") {
+        (void)q.atomic_pop_batch(3);
+        auto batch = q.atomic_pop_batch(3);
+
+        REQUIRE(batch.size() == 2);
+        REQUIRE(batch[0].get_id() == 3*psize);
+        REQUIRE(q.atomic_pop_batch(3).empty());
+    }
+}
+
+TEST_CASE("rexmit scheduler") {
+    // every message takes psize bytes of audio and 16 bytes of header from the budget
+    const size_t msg_cost = psize + 16;
+
+    SECTION("sends earliest deadline first and merges requests") {
+        sikradio::sender::rexmit_scheduler rexmits{0, 0};
+        REQUIRE(rexmits.atomic_push(msg(3*psize)));
+        REQUIRE(rexmits.atomic_push(msg(psize)));
+        REQUIRE_FALSE(rexmits.atomic_push(msg(3*psize)));
+        REQUIRE(rexmits.atomic_push(msg(2*psize)));
+        auto due = rexmits.atomic_pop_due(10);
+
+        REQUIRE(due.size() == 3);
+        for (size_t i = 0; i < due.size(); i++) REQUIRE(due[i].msg.get_id() == (i + 1)*psize);
+        REQUIRE(rexmits.atomic_size() == 0);
+    }
+
+    SECTION("keeps within budget") {
+        // refill at 1 byte per second is negligible during the test
+        sikradio::sender::rexmit_scheduler rexmits{1, 3*msg_cost};
+        for (size_t i = 0; i < 5; i++) (void)rexmits.atomic_push(msg(i*psize));
+
+        REQUIRE(rexmits.atomic_pop_due(10).size() == 3);
+        REQUIRE(rexmits.atomic_pop_due(10).empty());
+        REQUIRE(rexmits.atomic_size() == 2);
+    }
+
+    SECTION("refills budget over time") {
+        sikradio::sender::rexmit_scheduler rexmits{100*msg_cost, msg_cost};
+        for (size_t i = 0; i < 3; i++) (void)rexmits.atomic_push(msg(i*psize));
+        REQUIRE(rexmits.atomic_pop_due(10).size() == 1);
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+        // unused budget is capped, so only one more message fits
+        REQUIRE(rexmits.atomic_pop_due(10).size() == 1);
+    }
+
+    SECTION("drops messages that left the cache") {
+        sikradio::sender::rexmit_scheduler rexmits{0, 0};
+        (void)rexmits.atomic_push(msg(0));
+        (void)rexmits.atomic_push(msg(psize), false);
+        (void)rexmits.atomic_push(msg(2*psize));
+
+        REQUIRE(rexmits.atomic_drop_expired(2*psize) == 1);
+        auto due = rexmits.atomic_pop_due(10);
+        REQUIRE(due.size() == 2);
+        REQUIRE(due[0].msg.get_id() == psize);
+        REQUIRE(due[1].msg.get_id() == 2*psize);
+    }
+
+    SECTION("sends to few requesters directly") {
+        sikradio::sender::rexmit_scheduler rexmits{0, 0, 2};
+        auto first = receiver_address(1);
+        (void)rexmits.atomic_push(msg(0), true, first);
+        (void)rexmits.atomic_push(msg(0), true, first);
+        (void)rexmits.atomic_push(msg(0), true, receiver_address(2));
+        auto due = rexmits.atomic_pop_due(10);
+
+        REQUIRE(due.size() == 1);
+        REQUIRE(due[0].requesters.size() == 2);
+        REQUIRE(due[0].requesters[0].sin_port == first.sin_port);
+    }
+
+    SECTION("multicasts messages requested widely or by unknown receivers") {
+        sikradio::sender::rexmit_scheduler rexmits{0, 0, 2};
+        for (in_port_t i = 1; i <= 3; i++) (void)rexmits.atomic_push(msg(0), true, receiver_address(i));
+        (void)rexmits.atomic_push(msg(psize), true, receiver_address(1));
+        (void)rexmits.atomic_push(msg(psize));
+        auto due = rexmits.atomic_pop_due(10);
+
+        REQUIRE(due.size() == 2);
+        REQUIRE(due[0].requesters.empty());
+        REQUIRE(due[1].requesters.empty());
+    }
+
+    SECTION("counts requesters of messages that were already sent") {
+        sikradio::sender::rexmit_scheduler rexmits{0, 0, 2, std::chrono::milliseconds(50)};
+        auto first = receiver_address(1);
+        (void)rexmits.atomic_push(msg(0), true, first);
+        REQUIRE(rexmits.atomic_pop_due(10)[0].requesters.size() == 1);
+
+        SECTION("and sends directly only to new requesters") {
+            (void)rexmits.atomic_push(msg(0), true, receiver_address(2));
+            auto due = rexmits.atomic_pop_due(10);
+
+            REQUIRE(due[0].requesters.size() == 1);
+            REQUIRE(due[0].requesters[0].sin_port == receiver_address(2).sin_port);
+        }
+
+        SECTION("and does not count repeated requests twice") {
+            (void)rexmits.atomic_push(msg(0), true, first);
+            (void)rexmits.atomic_push(msg(0), true, receiver_address(2));
+
+            REQUIRE(rexmits.atomic_pop_due(10)[0].requesters.size() == 2);
+        }
+
+        SECTION("and multicasts after too many of them") {
+            (void)rexmits.atomic_push(msg(0), true, receiver_address(2));
+            (void)rexmits.atomic_pop_due(10);
+            (void)rexmits.atomic_push(msg(0), true, receiver_address(3));
+
+            REQUIRE(rexmits.atomic_pop_due(10)[0].requesters.empty());
+        }
+
+        SECTION("and forgets them after interval") {
+            std::this_thread::sleep_for(std::chrono::milliseconds(60));
+            (void)rexmits.atomic_push(msg(0), true, receiver_address(2));
+            (void)rexmits.atomic_push(msg(0), true, receiver_address(3));
+
+            REQUIRE(rexmits.atomic_pop_due(10)[0].requesters.size() == 2);
+        }
+    }
+
+    SECTION("charges budget for every direct retransmission") {
+        sikradio::sender::rexmit_scheduler rexmits{1, 3*msg_cost, 2};
+        (void)rexmits.atomic_push(msg(0), true, receiver_address(1));
+        (void)rexmits.atomic_push(msg(0), true, receiver_address(2));
+        (void)rexmits.atomic_push(msg(psize), true, receiver_address(1));
+        (void)rexmits.atomic_push(msg(psize), true, receiver_address(2));
+
+        REQUIRE(rexmits.atomic_pop_due(10).size() == 1);
+    }
+}
+
+TEST_CASE("rexmit window") {
+    sikradio::sender::rexmit_window window{4, psize, std::chrono::milliseconds(50)};
+
+    SECTION("suppresses sent messages") {
+        window.atomic_mark_sent(psize);
+
+        REQUIRE(window.atomic_is_suppressed(psize));
+        REQUIRE_FALSE(window.atomic_is_suppressed(2*psize));
+    }
+
+    SECTION("does not mistake messages sharing a slot") {
+        window.atomic_mark_sent(psize);
+
+        REQUIRE_FALSE(window.atomic_is_suppressed(5*psize));
+        window.atomic_mark_sent(5*psize);
+        REQUIRE_FALSE(window.atomic_is_suppressed(psize));
+    }
+
+    SECTION("forgets messages after two intervals") {
+        window.atomic_mark_sent(psize);
+        std::this_thread::sleep_for(std::chrono::milliseconds(110));
+
+        REQUIRE_FALSE(window.atomic_is_suppressed(psize));
+    }
+
+    SECTION("does nothing with interval of 0") {
+        sikradio::sender::rexmit_window disabled{4, psize, std::chrono::milliseconds(0)};
+        disabled.atomic_mark_sent(psize);
+
+        REQUIRE_FALSE(disabled.atomic_is_suppressed(psize));
+    }
+}
+
+TEST_CASE("descriptor input") {
+    int pipe_fds[2];
+    REQUIRE(pipe(pipe_fds) == 0);
+    std::string data = "abcdefghij";
+    REQUIRE(write(pipe_fds[1], data.data(), data.size()) == static_cast<ssize_t>(data.size()));
+
+    // packets are sliced across reads, which return only what is available
+    sikradio::sender::fd_input input{pipe_fds[0], 1};
+    REQUIRE(read_packets(input, 2) == "abcdefgh");
+    REQUIRE(write(pipe_fds[1], "kl", 2) == 2);
+    REQUIRE(read_packets(input, 1) == "ijkl");
+
+    // partial packet at the end of input is padded, instead of repeating previous data
+    REQUIRE(write(pipe_fds[1], "m", 1) == 1);
+    close(pipe_fds[1]);
+    REQUIRE(read_packets(input, 1) == std::string("m\0\0\0", 4));
+    REQUIRE(read_packets(input, 1).empty());
+    close(pipe_fds[0]);
+}
+
+TEST_CASE("playlist input") {
+    auto first = write_file("first", "abcdef");
+    auto empty = write_file("empty", "");
+    auto second = write_file("second", "ghi");
+
+    SECTION("packets span files and the last one is padded") {
+        sikradio::sender::playlist_input input{{first, empty, second}, false, 0};
+        REQUIRE(read_packets(input, 10) == std::string("abcdefghi\0\0\0", 12));
+    }
+
+    SECTION("looped playlist starts over") {
+        sikradio::sender::playlist_input input{{first, second}, true, 0};
+        REQUIRE(read_packets(input, 5) == "abcdefghiabcdefghiab");
+    }
+
+    SECTION("empty playlist is not looped") {
+        sikradio::sender::playlist_input input{{empty}, true, 0};
+        REQUIRE(read_packets(input, 1).empty());
+    }
+
+    SECTION("missing file is reported at construction") {
+        REQUIRE_THROWS_AS(
+            sikradio::sender::playlist_input({first, "/nonexistent/sikradio"}, false, 0),
+            sikradio::common::exceptions::input_exception);
+    }
+
+    std::remove(first.c_str());
+    std::remove(empty.c_str());
+    std::remove(second.c_str());
+}
+
+TEST_CASE("pacer") {
+    sikradio::sender::pacer pacer{4000};
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 11; i++) pacer.wait(psize*10);
+    // 10 packets of 40 bytes at 4000 B/s, first one is released immediately
+    REQUIRE(std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(100));
+}
+
+TEST_CASE("archive") {
+    auto path = write_file("archive", "");
+    const sikradio::common::msg_id_t session = 7;
+    {
+        // 10 bytes of capacity are rounded up to 3 packages
+        sikradio::sender::archive archive{path, 10, psize};
+        REQUIRE(archive.get_capacity() == 3);
+        REQUIRE_FALSE(archive.atomic_get(0, session).has_value());
+
+        for (sikradio::common::msg_id_t id = 0; id < 5*psize; id += psize) archive.atomic_push(msg(id), session);
+        // oldest messages were overwritten
+        REQUIRE_FALSE(archive.atomic_get(0, session).has_value());
+        REQUIRE_FALSE(archive.atomic_get(psize, session).has_value());
+        auto archived = archive.atomic_get(3*psize, session);
+        REQUIRE(archived.has_value());
+        REQUIRE(archived.value().get_id() == 3*psize);
+        REQUIRE(archived.value().get_data() == msg(3*psize).get_data());
+        // messages of other sessions are not served
+        REQUIRE_FALSE(archive.atomic_get(3*psize, session + 1).has_value());
+    }
+    {
+        // file outlives the sender
+        sikradio::sender::archive archive{path, 10, psize};
+        REQUIRE(archive.atomic_get(4*psize, session).has_value());
+    }
+    std::remove(path.c_str());
+
+    REQUIRE_THROWS_AS(
+        sikradio::sender::archive("/nonexistent/sikradio", 10, psize),
+        sikradio::common::exceptions::archive_exception);
+}